@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# ETDK - Chunk Size Benchmark
+# Encrypts the same test file with different --chunk-size values and
+# reports the elapsed time and throughput printed by etdk.
+#
+# Usage: ./bench_etdk.sh [size_mb] [chunk sizes...]
+# Example: ./bench_etdk.sh 1024 4K 64K 1M 4M 16M
+
+set -e
+
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+ETDK_BIN="$SCRIPT_DIR/build/etdk"
+OUTPUT="$SCRIPT_DIR/bench_output.txt"
+
+SIZE_MB="${1:-512}"
+shift || true
+CHUNKS=("$@")
+if [ ${#CHUNKS[@]} -eq 0 ]; then
+    CHUNKS=(4K 64K 1M 4M 16M 64M)
+fi
+
+echo "=========================================="
+echo "ETDK - Chunk Size Benchmark"
+echo "=========================================="
+echo ""
+
+# Check if etdk binary exists
+if [ ! -f "$ETDK_BIN" ]; then
+    echo "Error: etdk binary not found at $ETDK_BIN"
+    echo "Please build the project first with: cmake --build build"
+    exit 1
+fi
+
+# Create benchmark directory
+BENCH_DIR="${TMPDIR:-/tmp}/etdk_bench_$$"
+mkdir -p "$BENCH_DIR"
+trap 'rm -rf "$BENCH_DIR"' EXIT
+
+echo "Benchmark Directory: $BENCH_DIR"
+echo "Test file size:      ${SIZE_MB} MB"
+echo ""
+
+# Generate the source data once and copy it for each run
+dd if=/dev/urandom of="$BENCH_DIR/source.bin" bs=1M count="$SIZE_MB" status=none
+
+{
+    printf "%-10s %12s %12s\n" "CHUNK" "SECONDS" "MB/s"
+    printf "%-10s %12s %12s\n" "-----" "-------" "----"
+} | tee "$OUTPUT"
+
+for chunk in "${CHUNKS[@]}"; do
+    cp "$BENCH_DIR/source.bin" "$BENCH_DIR/target.bin"
+    sync
+
+    echo "YES" | "$ETDK_BIN" --chunk-size "$chunk" "$BENCH_DIR/target.bin" > "$BENCH_DIR/run.txt" 2>&1
+
+    # Elapsed: 1.234 s (415.2 MB/s)
+    seconds=$(sed -n 's/^Elapsed: \([0-9.]*\) s.*/\1/p' "$BENCH_DIR/run.txt")
+    rate=$(sed -n 's/^Elapsed: .*(\([0-9.]*\) MB\/s).*/\1/p' "$BENCH_DIR/run.txt")
+    printf "%-10s %12s %12s\n" "$chunk" "${seconds:-n/a}" "${rate:-n/a}" | tee -a "$OUTPUT"
+done
+
+echo ""
+echo "Results saved to: $OUTPUT"
@@ -0,0 +1,206 @@
+#!/bin/bash
+
+# ETDK - Synthetic Workload Benchmark
+# Generates reproducible workloads, encrypts each with etdk and compares
+# the throughput with the last saved baseline, so performance regressions
+# show up between commits.
+#
+# Workloads (data is AES-CTR keystream of a fixed key, identical on every run):
+#   large-cbc      one large file, CBC copy format        (crypto_encrypt_file)
+#   large-ctr      the same file with --in-place CTR       (crypto_encrypt_file_inplace)
+#   small-files    thousands of small files, -r            (crypto_encrypt_paths)
+#   small-uring    the same files in io_uring batches      (io_uring_batch_run)
+#   sparse-xts     sparse image, --in-place XTS            (hole skipping)
+#   loop-device    loop-backed image, XTS                  (crypto_encrypt_device, root only)
+#
+# "FUNC s" is the time etdk spends inside the encryption call (from the
+# --progress-fd run record), "CLI s" the wall time of the whole process.
+#
+# Usage: ./bench_workloads.sh [--save-baseline]
+# Sizes: BENCH_LARGE_MB (1024), BENCH_SMALL_FILES (2000), BENCH_SMALL_KB (16),
+#        BENCH_SPARSE_MB (2048), BENCH_DEVICE_MB (512), BENCH_RUNS (3, best run counts)
+# Also: cmake --build build --target benchmark (or benchmark-baseline)
+
+set -e
+
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+ETDK_BIN="${ETDK_BIN:-$SCRIPT_DIR/build/etdk}"
+OUTPUT="$SCRIPT_DIR/bench_workloads.txt"
+BASELINE="$SCRIPT_DIR/bench_baseline.txt"
+
+LARGE_MB="${BENCH_LARGE_MB:-1024}"
+SMALL_FILES="${BENCH_SMALL_FILES:-2000}"
+SMALL_KB="${BENCH_SMALL_KB:-16}"
+SPARSE_MB="${BENCH_SPARSE_MB:-2048}"
+DEVICE_MB="${BENCH_DEVICE_MB:-512}"
+RUNS="${BENCH_RUNS:-3}"
+
+SAVE_BASELINE=0
+if [ "$1" = "--save-baseline" ]; then
+    SAVE_BASELINE=1
+fi
+
+echo "=========================================="
+echo "ETDK - Synthetic Workload Benchmark"
+echo "=========================================="
+echo ""
+
+# Check if etdk binary exists
+if [ ! -f "$ETDK_BIN" ]; then
+    echo "Error: etdk binary not found at $ETDK_BIN"
+    echo "Please build the project first with: cmake --build build"
+    exit 1
+fi
+if ! command -v openssl > /dev/null; then
+    echo "Error: openssl is needed to generate the workloads"
+    exit 1
+fi
+
+# Create benchmark directory
+BENCH_DIR="${TMPDIR:-/tmp}/etdk_workloads_$$"
+mkdir -p "$BENCH_DIR"
+LOOP_DEVICE=""
+cleanup() {
+    if [ -n "$LOOP_DEVICE" ]; then
+        losetup -d "$LOOP_DEVICE" 2> /dev/null || true
+    fi
+    rm -rf "$BENCH_DIR"
+}
+trap cleanup EXIT
+
+# Seconds since the epoch with sub-second resolution
+now() {
+    if [ -n "$EPOCHREALTIME" ]; then
+        echo "${EPOCHREALTIME/,/.}"
+    else
+        date +%s.%N
+    fi
+}
+
+# Reproducible pseudo-random bytes: AES-256-CTR keystream of a fixed key
+generate() { # <bytes> <file>
+    openssl enc -aes-256-ctr -nosalt -K "$(printf '%064d' 0)" -iv "$(printf '%032d' 0)" -in /dev/zero 2> /dev/null |
+        head -c "$1" > "$2"
+}
+
+echo "Benchmark Directory: $BENCH_DIR"
+echo "Generating workloads..."
+
+generate $((LARGE_MB * 1024 * 1024)) "$BENCH_DIR/large.bin"
+
+mkdir -p "$BENCH_DIR/small"
+generate $((SMALL_FILES * SMALL_KB * 1024)) "$BENCH_DIR/small.seed"
+(cd "$BENCH_DIR/small" && split -b "${SMALL_KB}K" -a 5 ../small.seed file_)
+rm -f "$BENCH_DIR/small.seed"
+
+# Sparse image: 32 extents of 4 MB spread over the apparent size
+truncate -s "${SPARSE_MB}M" "$BENCH_DIR/sparse.img"
+generate $((4 * 1024 * 1024)) "$BENCH_DIR/extent.bin"
+for i in $(seq 0 31); do
+    dd if="$BENCH_DIR/extent.bin" of="$BENCH_DIR/sparse.img" bs=1M seek=$((i * SPARSE_MB / 32)) conv=notrunc \
+        status=none
+done
+rm -f "$BENCH_DIR/extent.bin"
+
+generate $((DEVICE_MB * 1024 * 1024)) "$BENCH_DIR/device.img"
+echo ""
+
+# Run one workload BENCH_RUNS times on a fresh copy (or a fresh device image), keep the fastest run
+# Writes "<bytes> <function seconds> <cli seconds>" to $BENCH_DIR/workload.txt. Not to be called in
+# $(...): a failed run must end the whole script, not a subshell, before any row is reported or saved
+run_workload() { # <source> <target> <etdk options...>
+    local source="$1" target="$2"
+    shift 2
+    local best_bytes="" best_func="" best_cli=""
+    for _ in $(seq 1 "$RUNS"); do
+        if [ -b "$target" ]; then
+            dd if="$source" of="$target" bs=4M conv=fsync status=none
+        else
+            rm -rf "$target"
+            cp -a --sparse=always "$source" "$target" 2> /dev/null || cp -a "$source" "$target"
+            sync
+        fi
+        local start end record
+        start=$(now)
+        local status=0
+        echo "YES" | "$ETDK_BIN" --progress-fd 3 "$@" "$target" > "$BENCH_DIR/run.txt" 2>&1 3> "$BENCH_DIR/run.jsonl" ||
+            status=$?
+        end=$(now)
+        # {"event":"run","result":"ok","targets":1,"bytes":N,"elapsed_s":S,...}
+        record=$(grep '"event":"run"' "$BENCH_DIR/run.jsonl" || true)
+        if [ "$status" != 0 ] || ! echo "$record" | grep -q '"result":"ok"'; then
+            echo "Error: etdk $* $target failed, see output:" >&2
+            cat "$BENCH_DIR/run.txt" >&2
+            exit 1
+        fi
+        local bytes func
+        bytes=$(echo "$record" | sed -n 's/.*"bytes":\([0-9]*\).*/\1/p')
+        func=$(echo "$record" | sed -n 's/.*"elapsed_s":\([0-9.]*\).*/\1/p')
+        if [ -z "$best_func" ] || awk -v a="$func" -v b="$best_func" 'BEGIN { exit !(a < b) }'; then
+            best_bytes="$bytes"
+            best_func="$func"
+            best_cli=$(awk -v a="$start" -v b="$end" 'BEGIN { printf "%.3f", b - a }')
+        fi
+    done
+    echo "$best_bytes $best_func $best_cli" > "$BENCH_DIR/workload.txt"
+}
+
+# Workload name, options
+WORKLOADS=(
+    "large-cbc|large.bin|--mode cbc"
+    "large-ctr|large.bin|--in-place --mode ctr"
+    "small-files|small|-r"
+    "small-uring|small|-r --engine io_uring"
+    "sparse-xts|sparse.img|--in-place --mode xts"
+)
+
+{
+    printf "%-12s %12s %9s %9s %9s %10s %8s\n" "WORKLOAD" "BYTES" "FUNC s" "CLI s" "MB/s" "BASE MB/s" "DELTA"
+    printf "%-12s %12s %9s %9s %9s %10s %8s\n" "--------" "-----" "------" "-----" "----" "---------" "-----"
+} | tee "$BENCH_DIR/results.txt"
+
+report() { # <name> <bytes> <func> <cli>
+    local rate base="n/a" delta="n/a"
+    rate=$(awk -v b="$2" -v s="$3" 'BEGIN { printf "%.1f", (s > 0 ? b / 1048576 / s : 0) }')
+    if [ -f "$BASELINE" ]; then
+        base=$(awk -v name="$1" '$1 == name { print $5 }' "$BASELINE")
+        base="${base:-n/a}"
+    fi
+    if [ "$base" != "n/a" ]; then
+        # "!" marks a run more than 10% slower than the baseline
+        delta=$(awk -v r="$rate" -v b="$base" 'BEGIN { printf "%+.1f%%%s", (r - b) * 100 / b, (r < b * 0.9 ? " !" : "") }')
+    fi
+    printf "%-12s %12s %9s %9s %9s %10s %8s\n" "$1" "$2" "$3" "$4" "$rate" "$base" "$delta" |
+        tee -a "$BENCH_DIR/results.txt"
+}
+
+for workload in "${WORKLOADS[@]}"; do
+    IFS='|' read -r name source options <<< "$workload"
+    # shellcheck disable=SC2086 # options are split on purpose
+    run_workload "$BENCH_DIR/$source" "$BENCH_DIR/target_$source" $options
+    read -r bytes func cli < "$BENCH_DIR/workload.txt"
+    report "$name" "$bytes" "$func" "$cli"
+done
+
+# Block device path: needs root and losetup
+if [ "$(id -u)" = 0 ] && command -v losetup > /dev/null; then
+    cp "$BENCH_DIR/device.img" "$BENCH_DIR/loop.img"
+    LOOP_DEVICE=$(losetup --find --show "$BENCH_DIR/loop.img")
+    run_workload "$BENCH_DIR/device.img" "$LOOP_DEVICE" --mode xts
+    read -r bytes func cli < "$BENCH_DIR/workload.txt"
+    report "loop-device" "$bytes" "$func" "$cli"
+else
+    echo "loop-device  skipped (needs root and losetup)"
+fi
+
+cp "$BENCH_DIR/results.txt" "$OUTPUT"
+echo ""
+echo "Results saved to: $OUTPUT"
+if [ "$SAVE_BASELINE" = 1 ]; then
+    cp "$OUTPUT" "$BASELINE"
+    echo "Baseline saved to: $BASELINE"
+elif [ ! -f "$BASELINE" ]; then
+    echo "No baseline yet: run with --save-baseline (or the benchmark-baseline target) to record one"
+else
+    echo "Compared with: $BASELINE (\"!\" = more than 10% slower)"
+fi
@@ -0,0 +1,30 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/bench.c" "CMakeFiles/etdk.dir/src/bench.c.o" "gcc" "CMakeFiles/etdk.dir/src/bench.c.o.d"
+  "/root/repo/src/crypto.c" "CMakeFiles/etdk.dir/src/crypto.c.o" "gcc" "CMakeFiles/etdk.dir/src/crypto.c.o.d"
+  "/root/repo/src/decrypt.c" "CMakeFiles/etdk.dir/src/decrypt.c.o" "gcc" "CMakeFiles/etdk.dir/src/decrypt.c.o.d"
+  "/root/repo/src/io.c" "CMakeFiles/etdk.dir/src/io.c.o" "gcc" "CMakeFiles/etdk.dir/src/io.c.o.d"
+  "/root/repo/src/journal.c" "CMakeFiles/etdk.dir/src/journal.c.o" "gcc" "CMakeFiles/etdk.dir/src/journal.c.o.d"
+  "/root/repo/src/main.c" "CMakeFiles/etdk.dir/src/main.c.o" "gcc" "CMakeFiles/etdk.dir/src/main.c.o.d"
+  "/root/repo/src/parallel.c" "CMakeFiles/etdk.dir/src/parallel.c.o" "gcc" "CMakeFiles/etdk.dir/src/parallel.c.o.d"
+  "/root/repo/src/platform.c" "CMakeFiles/etdk.dir/src/platform.c.o" "gcc" "CMakeFiles/etdk.dir/src/platform.c.o.d"
+  "/root/repo/src/progress.c" "CMakeFiles/etdk.dir/src/progress.c.o" "gcc" "CMakeFiles/etdk.dir/src/progress.c.o.d"
+  "/root/repo/src/session.c" "CMakeFiles/etdk.dir/src/session.c.o" "gcc" "CMakeFiles/etdk.dir/src/session.c.o.d"
+  "/root/repo/src/tree.c" "CMakeFiles/etdk.dir/src/tree.c.o" "gcc" "CMakeFiles/etdk.dir/src/tree.c.o.d"
+  "/root/repo/src/uring.c" "CMakeFiles/etdk.dir/src/uring.c.o" "gcc" "CMakeFiles/etdk.dir/src/uring.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
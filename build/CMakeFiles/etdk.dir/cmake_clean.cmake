@@ -0,0 +1,33 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/etdk.dir/src/bench.c.o"
+  "CMakeFiles/etdk.dir/src/bench.c.o.d"
+  "CMakeFiles/etdk.dir/src/crypto.c.o"
+  "CMakeFiles/etdk.dir/src/crypto.c.o.d"
+  "CMakeFiles/etdk.dir/src/decrypt.c.o"
+  "CMakeFiles/etdk.dir/src/decrypt.c.o.d"
+  "CMakeFiles/etdk.dir/src/io.c.o"
+  "CMakeFiles/etdk.dir/src/io.c.o.d"
+  "CMakeFiles/etdk.dir/src/journal.c.o"
+  "CMakeFiles/etdk.dir/src/journal.c.o.d"
+  "CMakeFiles/etdk.dir/src/main.c.o"
+  "CMakeFiles/etdk.dir/src/main.c.o.d"
+  "CMakeFiles/etdk.dir/src/parallel.c.o"
+  "CMakeFiles/etdk.dir/src/parallel.c.o.d"
+  "CMakeFiles/etdk.dir/src/platform.c.o"
+  "CMakeFiles/etdk.dir/src/platform.c.o.d"
+  "CMakeFiles/etdk.dir/src/progress.c.o"
+  "CMakeFiles/etdk.dir/src/progress.c.o.d"
+  "CMakeFiles/etdk.dir/src/session.c.o"
+  "CMakeFiles/etdk.dir/src/session.c.o.d"
+  "CMakeFiles/etdk.dir/src/tree.c.o"
+  "CMakeFiles/etdk.dir/src/tree.c.o.d"
+  "CMakeFiles/etdk.dir/src/uring.c.o"
+  "CMakeFiles/etdk.dir/src/uring.c.o.d"
+  "etdk"
+  "etdk.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/etdk.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -15,8 +15,10 @@
 #define ETDK_H
 
 // cppcheck-suppress-begin missingIncludeSystem
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 // cppcheck-suppress-end missingIncludeSystem
 
 /** @brief Version string for ETDK */
@@ -49,20 +51,173 @@
 /** @brief Platform-specific operation failed */
 #define ETDK_ERROR_PLATFORM -4
 
+/** @brief Target was replaced by a symbolic link after it was listed; left alone */
+#define ETDK_ERROR_SYMLINK -5
+
 /** @} */ // end of ReturnCodes
 
+/**
+ * @defgroup Modes Cipher Modes
+ * @brief Values for crypto_context_t::mode
+ * @{
+ */
+
+/** @brief AES-256-CBC: one chain over the whole target (default, openssl enc compatible) */
+#define ETDK_MODE_CBC 0
+
+/** @brief AES-256-XTS: each data unit (sector) encrypted independently, tweak = sector number */
+#define ETDK_MODE_XTS 1
+
+/** @brief AES-256-CTR: length-preserving stream, counter = IV + block number (in-place files) */
+#define ETDK_MODE_CTR 2
+
+/** @} */ // end of Modes
+
+/** @brief Buffers in the single-stage read/encrypt/write pipeline (read, encrypt, write, spare) */
+#define ETDK_PIPELINE_BUFFERS 4
+
+/** @brief Default number of bytes processed per I/O request (4 MB) */
+#define ETDK_DEFAULT_CHUNK_SIZE (4 * 1024 * 1024)
+
+/** @brief Automatic chunk size on spinning disks, where every switch between reading and writing is a seek (16 MB) */
+#define ETDK_ROTATIONAL_CHUNK_SIZE (16 * 1024 * 1024)
+
+/** @brief Upper bound for the automatic chunk size (64 MB) */
+#define ETDK_MAX_AUTO_CHUNK_SIZE (64 * 1024 * 1024)
+
+/** @brief Write-behind window: buffered writers keep at most two of these dirty or cached (8 MB) */
+#define ETDK_WRITEBACK_WINDOW (8 * 1024 * 1024)
+
+/** @brief Seconds of tokens a rate limiter bucket can hold (burst after idling) */
+#define ETDK_LIMITER_BURST 0.1
+
+/** @brief Largest file taken by the one-read, one-write small-file path (64 KB) */
+#define ETDK_SMALL_FILE_MAX (64 * 1024)
+
+/** @brief Buffer size of the small-file path: the file, one byte to detect growth, and CBC padding */
+#define ETDK_SMALL_FILE_BUFFER (ETDK_SMALL_FILE_MAX + 2 * AES_BLOCK_SIZE)
+
+/** @brief Alignment of buffered I/O buffers (one page) */
+#define ETDK_BUFFER_ALIGNMENT 4096
+
+/** @brief Default number of requests kept in flight by the io_uring engine */
+#define ETDK_DEFAULT_QUEUE_DEPTH 8
+
+/** @brief Upper bound for the automatic io_uring queue depth (each slot holds two chunk buffers) */
+#define ETDK_MAX_AUTO_QUEUE_DEPTH 32
+
+/** @brief Upper bound for the io_uring queue depth */
+#define ETDK_MAX_QUEUE_DEPTH 256
+
+/** @brief Upper bound for the number of cipher worker threads */
+#define ETDK_MAX_THREADS 256
+
+/**
+ * @defgroup Engines I/O Engines
+ * @brief Values for etdk_options_t::io_engine
+ * @{
+ */
+
+/** @brief Synchronous pread/encrypt/pwrite loop */
+#define ETDK_ENGINE_SYNC 0
+
+/** @brief Asynchronous io_uring engine (falls back to sync if unavailable) */
+#define ETDK_ENGINE_IO_URING 1
+
+/** @} */ // end of Engines
+
+/**
+ * @defgroup Offload Device Offload Operations
+ * @brief Values for platform_offload_device(): work the device does itself
+ * @{
+ */
+
+/** @brief No offload pass */
+#define ETDK_OFFLOAD_NONE 0
+
+/** @brief BLKDISCARD: unmap the blocks (reads afterwards are device specific) */
+#define ETDK_OFFLOAD_DISCARD 1
+
+/** @brief BLKSECDISCARD: unmap and erase every copy of the blocks */
+#define ETDK_OFFLOAD_SECURE_DISCARD 2
+
+/** @brief BLKZEROOUT: zero the blocks (write-zeroes command, or kernel writes zero pages) */
+#define ETDK_OFFLOAD_ZEROOUT 3
+
+/** @brief Bytes per offload ioctl, so progress can be shown between requests */
+#define ETDK_OFFLOAD_RANGE (1024ULL * 1024 * 1024)
+
+/** @} */ // end of Offload
+
+/**
+ * @struct io_limiter_t
+ * @brief Token-bucket limiter on bytes and I/O requests per second
+ *
+ * Shared by every engine and thread of a run; see io_limiter_wait().
+ */
+typedef struct {
+    pthread_mutex_t lock; /**< Protects the buckets */
+    double bytes_rate;    /**< Bytes per second, 0 = unlimited */
+    double ops_rate;      /**< Requests per second, 0 = unlimited */
+    double bytes_tokens;  /**< Available bytes (negative = debt being slept off) */
+    double ops_tokens;    /**< Available requests */
+    double last;          /**< Time of the last refill (platform_monotonic_seconds) */
+    double slept;         /**< Total seconds callers were delayed */
+} io_limiter_t;
+
+struct etdk_session;
+
+/**
+ * @struct etdk_options_t
+ * @brief Tunable I/O options for file and device encryption
+ *
+ * Initialize with etdk_options_init() before changing individual fields.
+ */
+typedef struct {
+    size_t chunk_size; /**< Bytes processed per read/write request (0 = derived from the device topology) */
+    int direct_io;     /**< Non-zero to bypass the page cache (O_DIRECT) for devices */
+    int io_engine;     /**< ETDK_ENGINE_SYNC or ETDK_ENGINE_IO_URING */
+    unsigned queue_depth; /**< Reads (and writes) kept in flight by the io_uring engine (0 = automatic) */
+    unsigned threads;     /**< Cipher worker threads for XTS/CTR, or file workers for trees (0 = online CPUs) */
+    int in_place;         /**< Non-zero to encrypt regular files in place (CTR/XTS, no temp file) */
+    int quiet;            /**< Non-zero to suppress per-target banners and progress output */
+    int keystream_only;   /**< Non-zero to overwrite with CTR keystream without reading (no recovery) */
+    const char *journal_path;  /**< Checkpoint journal for in-place encryption, NULL for none */
+    uint64_t checkpoint_bytes; /**< Bytes between two checkpoints (0 = ETDK_DEFAULT_CHECKPOINT) */
+    int resume;                /**< Non-zero to continue after the last checkpoint in journal_path */
+    io_limiter_t *limiter;     /**< Rate limiter shared by all targets and threads, NULL for none */
+    int progress_fd;           /**< Descriptor for JSON-lines progress records, -1 for none */
+    int decrypt;               /**< Non-zero to decrypt in place instead of encrypting (etdk decrypt) */
+    struct etdk_session *session; /**< Per-file keys derived from a session master key, NULL for one shared key */
+} etdk_options_t;
+
+/**
+ * @struct etdk_tree_stats_t
+ * @brief Counters collected while encrypting a directory tree
+ */
+typedef struct {
+    uint64_t files;       /**< Regular files encrypted */
+    uint64_t failed;      /**< Files or directories that could not be processed */
+    uint64_t directories; /**< Directories scanned */
+    uint64_t skipped;     /**< Entries left alone (symlinks, devices, sockets, FIFOs) */
+    uint64_t bytes;       /**< Plaintext bytes encrypted */
+} etdk_tree_stats_t;
+
 /**
  * @struct crypto_context_t
  * @brief Encryption context containing key, IV, and cipher state
  *
  * This structure holds all cryptographic material needed for
- * AES-256-CBC encryption. It MUST be securely wiped after use
- * using crypto_secure_wipe_key() to prevent key recovery.
+ * AES-256-CBC or AES-256-XTS encryption. It MUST be securely wiped
+ * after use using crypto_secure_wipe_key() to prevent key recovery.
  */
 typedef struct {
-    uint8_t key[AES_KEY_SIZE];  /**< 256-bit AES encryption key */
-    uint8_t iv[AES_BLOCK_SIZE]; /**< 128-bit initialization vector */
-    void *cipher_ctx;           /**< OpenSSL cipher context (internal) */
+    uint8_t key[AES_KEY_SIZE];       /**< 256-bit AES encryption key */
+    uint8_t tweak_key[AES_KEY_SIZE]; /**< 256-bit XTS tweak key (second half of the XTS key) */
+    uint8_t iv[AES_BLOCK_SIZE];      /**< 128-bit initialization vector (CBC) */
+    int mode;                        /**< ETDK_MODE_* cipher mode */
+    uint32_t data_unit;              /**< XTS data unit size in bytes (set by crypto_encrypt_device) */
+    void *cipher_ctx;                /**< OpenSSL cipher context, re-keyed per target (internal, NULL in copies) */
 } crypto_context_t;
 
 /**
@@ -71,6 +226,20 @@ typedef struct {
  * @{
  */
 
+/**
+ * @brief Fill options with default values
+ * @param opts Pointer to etdk_options_t to initialize
+ */
+void etdk_options_init(etdk_options_t *opts);
+
+/**
+ * @brief Parse a byte size with optional K/M/G suffix (powers of 1024)
+ * @param text String to parse (e.g. "4M")
+ * @param size Receives the size in bytes
+ * @return 0 on success, -1 on invalid input
+ */
+int etdk_parse_size(const char *text, size_t *size);
+
 /**
  * @brief Initialize crypto context with random key and IV
  * @param ctx Pointer to crypto_context_t to initialize
@@ -78,6 +247,13 @@ typedef struct {
  */
 int crypto_init(crypto_context_t *ctx);
 
+/**
+ * @brief Human readable name of a cipher mode
+ * @param mode ETDK_MODE_* value
+ * @return Static string such as "AES-256-CBC"
+ */
+const char *crypto_mode_name(int mode);
+
 /**
  * @brief Generate cryptographically secure random key
  * @param key Buffer to store generated key
@@ -91,17 +267,91 @@ int crypto_generate_key(uint8_t *key, size_t key_size);
  * @param input_path Path to input file
  * @param output_path Path to output encrypted file
  * @param ctx Initialized crypto context
- * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_CRYPTO
+ * @param opts I/O options (chunk_size), or NULL for defaults
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, ETDK_ERROR_CRYPTO, or ETDK_ERROR_MEMORY
  */
-int crypto_encrypt_file(const char *input_path, const char *output_path, crypto_context_t *ctx);
+int crypto_encrypt_file(const char *input_path, const char *output_path, crypto_context_t *ctx,
+                        const etdk_options_t *opts);
 
 /**
- * @brief Encrypt block device using AES-256-CBC
+ * @brief Encrypt block device in place using ctx->mode (CBC, XTS or CTR)
  * @param device_path Path to block device (e.g., /dev/sdb)
  * @param ctx Initialized crypto context
- * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_CRYPTO
+ * @param opts I/O options, or NULL for defaults
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, ETDK_ERROR_CRYPTO, or ETDK_ERROR_MEMORY
+ */
+int crypto_encrypt_device(const char *device_path, crypto_context_t *ctx, const etdk_options_t *opts);
+
+/**
+ * @brief Encrypt regular file in place with a length-preserving mode (CTR or XTS)
+ * @param path Path to the file
+ * @param ctx Initialized crypto context (mode must not be CBC)
+ * @param opts I/O options, or NULL for defaults
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, ETDK_ERROR_CRYPTO, or ETDK_ERROR_MEMORY
+ */
+int crypto_encrypt_file_inplace(const char *path, crypto_context_t *ctx, const etdk_options_t *opts);
+
+/**
+ * @brief Encrypt a whole file held in memory, as crypto_encrypt_file() or crypto_encrypt_file_inplace() would
+ * @param ctx Initialized crypto context
+ * @param buf File contents, encrypted in place (room for len + AES_BLOCK_SIZE bytes)
+ * @param len File size in bytes
+ * @param out_len Receives the ciphertext length (CBC adds its padding)
+ * @return ETDK_SUCCESS or ETDK_ERROR_CRYPTO
  */
-int crypto_encrypt_device(const char *device_path, crypto_context_t *ctx);
+int crypto_encrypt_buffer(crypto_context_t *ctx, unsigned char *buf, size_t len, size_t *out_len);
+
+/**
+ * @brief Encrypt a file of at most ETDK_SMALL_FILE_MAX bytes with one read and one write
+ *
+ * Same result as crypto_encrypt_file() onto a temporary file that replaces
+ * the original (CBC), or crypto_encrypt_file_inplace() (XTS, CTR).
+ *
+ * @param path Path to the file
+ * @param ctx Initialized crypto context
+ * @param opts I/O options, or NULL for defaults
+ * @param buf Buffer of ETDK_SMALL_FILE_BUFFER bytes
+ * @return ETDK_SUCCESS, ETDK_ERROR_PLATFORM if the file needs the general path (not writable, grown),
+ *         ETDK_ERROR_SYMLINK if the path is a symbolic link (never followed), ETDK_ERROR_IO, or ETDK_ERROR_CRYPTO
+ */
+int crypto_encrypt_small_file(const char *path, crypto_context_t *ctx, const etdk_options_t *opts,
+                              unsigned char *buf);
+
+/**
+ * @brief Decrypt a device or file in place with a known key (recovery)
+ *
+ * Reverses crypto_encrypt_device(), crypto_encrypt_file_inplace() and, for
+ * CBC files, crypto_encrypt_file() (the padding is checked and removed).
+ *
+ * @param path Path to the block device or regular file
+ * @param ctx Crypto context holding the key, tweak key and IV used to encrypt
+ * @param opts I/O options (threads = cipher workers, also for CBC), or NULL for defaults
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, ETDK_ERROR_CRYPTO, or ETDK_ERROR_MEMORY
+ */
+int crypto_decrypt_target(const char *path, crypto_context_t *ctx, const etdk_options_t *opts);
+
+/**
+ * @brief Encrypt every regular file below a directory with a work-stealing thread pool
+ * @param root Directory to walk (symbolic links below it are not followed)
+ * @param ctx Initialized crypto context (CBC, or XTS with opts->in_place)
+ * @param opts I/O options (threads = file workers), or NULL for defaults
+ * @param stats Optional pointer where counters will be stored
+ * @return ETDK_SUCCESS if every file was encrypted, ETDK_ERROR_IO if some failed, or another error code
+ */
+int crypto_encrypt_tree(const char *root, crypto_context_t *ctx, const etdk_options_t *opts,
+                        etdk_tree_stats_t *stats);
+
+/**
+ * @brief Encrypt many files and directory trees with one work-stealing thread pool
+ * @param paths Files and directories to encrypt (directories are walked recursively)
+ * @param count Number of paths
+ * @param ctx Initialized crypto context (CBC, or XTS with opts->in_place)
+ * @param opts I/O options (threads = file workers), or NULL for defaults
+ * @param stats Optional pointer where counters will be stored
+ * @return ETDK_SUCCESS if every file was encrypted, ETDK_ERROR_IO if some failed, or another error code
+ */
+int crypto_encrypt_paths(const char *const *paths, size_t count, crypto_context_t *ctx, const etdk_options_t *opts,
+                         etdk_tree_stats_t *stats);
 
 /**
  * @brief Display encryption key in hexadecimal (ONE TIME ONLY)
@@ -110,7 +360,7 @@ int crypto_encrypt_device(const char *device_path, crypto_context_t *ctx);
 void crypto_display_key(const crypto_context_t *ctx);
 
 /**
- * @brief Securely wipe encryption key using 7-pass Gutmann method
+ * @brief Securely wipe encryption key using 7-pass Gutmann method (also frees the cached cipher context)
  * @param ctx Crypto context containing key to wipe
  * @return ETDK_SUCCESS or ETDK_ERROR_CRYPTO
  */
@@ -122,8 +372,82 @@ int crypto_secure_wipe_key(crypto_context_t *ctx);
  */
 void crypto_cleanup(crypto_context_t *ctx);
 
+/**
+ * @struct crypto_bench_result_t
+ * @brief Outcome of one crypto_bench_cipher() measurement
+ */
+typedef struct {
+    uint64_t bytes;     /**< Bytes encrypted by all threads */
+    double seconds;     /**< Wall time around all threads */
+    double cpu_seconds; /**< CPU time summed over all threads */
+} crypto_bench_result_t;
+
+/**
+ * @brief Measure cipher throughput in memory with the device engine's chunk function
+ * @param ctx Initialized crypto context (mode and, for XTS, data_unit set)
+ * @param buffer_size Bytes per chunk (multiple of AES_BLOCK_SIZE and of the XTS data unit)
+ * @param threads Number of threads, each with its own cipher context
+ * @param seconds Minimum run time per thread
+ * @param result Receives bytes, wall time and CPU time
+ * @return ETDK_SUCCESS, ETDK_ERROR_CRYPTO, ETDK_ERROR_MEMORY or ETDK_ERROR_PLATFORM
+ */
+int crypto_bench_cipher(const crypto_context_t *ctx, size_t buffer_size, unsigned threads, double seconds,
+                        crypto_bench_result_t *result);
+
+/**
+ * @struct crypto_bench_setup_t
+ * @brief Outcome of one crypto_bench_setup() measurement
+ */
+typedef struct {
+    double fresh_seconds;   /**< Per target: new context, implicit cipher fetch, free (one context per file) */
+    double rekeyed_seconds; /**< Per target: re-keying the cached context of the crypto_context_t */
+} crypto_bench_setup_t;
+
+/**
+ * @brief Measure the cipher setup cost paid for every file of a batch
+ * @param ctx Initialized crypto context (mode set)
+ * @param seconds Minimum run time of each variant
+ * @param result Receives the time per target of both variants
+ * @return ETDK_SUCCESS, ETDK_ERROR_CRYPTO or ETDK_ERROR_MEMORY
+ */
+int crypto_bench_setup(const crypto_context_t *ctx, double seconds, crypto_bench_setup_t *result);
+
 /** @} */ // end of Crypto
 
+/**
+ * @struct platform_device_info_t
+ * @brief Size and I/O topology of a device or file
+ *
+ * Filled by platform_get_device_info() with one open() of the target.
+ * Fields the platform does not report are 0 (rotational: -1).
+ */
+typedef struct {
+    uint64_t size;             /**< Size in bytes */
+    uint32_t logical_sector;   /**< Smallest addressable unit (BLKSSZGET) */
+    uint32_t physical_sector;  /**< Unit the device writes internally (BLKPBSZGET), O_DIRECT alignment */
+    uint32_t minimum_io;       /**< Preferred minimum request size (BLKIOMIN) */
+    uint32_t optimal_io;       /**< Preferred request size, e.g. RAID stripe width (BLKIOOPT), 0 if none */
+    int rotational;            /**< 1 spinning disk, 0 solid state, -1 unknown */
+    uint64_t max_hw_bytes;     /**< Largest request the hardware accepts (max_hw_sectors_kb) */
+    uint32_t nr_requests;      /**< Requests the block layer queues per hardware queue */
+    int is_device;             /**< 1 for a block device, 0 for a regular file */
+} platform_device_info_t;
+
+/**
+ * @struct platform_offload_caps_t
+ * @brief Offload commands a block device advertises
+ *
+ * Filled by platform_get_offload_caps() from /sys/block/<dev>/queue.
+ */
+typedef struct {
+    int discard;                     /**< 1 if BLKDISCARD is supported */
+    int secure_discard;              /**< 1 supported, 0 not, -1 unknown until issued (no sysfs attribute) */
+    int write_zeroes;                /**< 1 if BLKZEROOUT maps to a device command, 0 if the kernel writes zeros */
+    uint64_t discard_granularity;    /**< Smallest unit the device discards, in bytes */
+    uint64_t discard_max_bytes;      /**< Largest single discard request, in bytes */
+    uint64_t write_zeroes_max_bytes; /**< Largest single write-zeroes request, in bytes */
+} platform_offload_caps_t;
+
 /**
  * @defgroup Platform Platform-Specific Functions
  * @brief Cross-platform abstractions for device access and memory locking
@@ -138,6 +462,23 @@ void crypto_cleanup(crypto_context_t *ctx);
  */
 int platform_get_device_size(const char *device_path, uint64_t *size);
 
+/**
+ * @brief Get size and I/O topology of a device or file in one call
+ * @param device_path Path to device or file
+ * @param info Pointer to store the topology
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_PLATFORM
+ */
+int platform_get_device_info(const char *device_path, platform_device_info_t *info);
+
+/**
+ * @brief Get logical and physical sector size of a device
+ * @param device_path Path to device or file
+ * @param logical Pointer to store logical sector size (addressing unit)
+ * @param physical Pointer to store physical sector size (O_DIRECT alignment)
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_PLATFORM
+ */
+int platform_get_sector_size(const char *device_path, uint32_t *logical, uint32_t *physical);
+
 /**
  * @brief Check if path points to a block device
  * @param path Path to check
@@ -145,6 +486,13 @@ int platform_get_device_size(const char *device_path, uint64_t *size);
  */
 int platform_is_device(const char *path);
 
+/**
+ * @brief Check if path points to a directory
+ * @param path Path to check
+ * @return 1 if directory, 0 otherwise
+ */
+int platform_is_directory(const char *path);
+
 /**
  * @brief Lock memory pages to prevent swapping to disk
  * @param addr Starting address of memory region
@@ -161,6 +509,707 @@ int platform_lock_memory(void *addr, size_t len);
  */
 int platform_unlock_memory(void *addr, size_t len);
 
+/**
+ * @brief Run all further I/O of the process in the idle I/O class (ioprio_set)
+ * @return ETDK_SUCCESS or ETDK_ERROR_PLATFORM
+ */
+int platform_set_idle_io_priority(void);
+
+/**
+ * @brief Set the CPU niceness of the process (setpriority)
+ * @param value Niceness from -20 to 19
+ * @return ETDK_SUCCESS or ETDK_ERROR_PLATFORM
+ */
+int platform_set_nice(int value);
+
+/**
+ * @brief Read a monotonic clock for elapsed-time measurements
+ * @return Seconds since an unspecified starting point
+ */
+double platform_monotonic_seconds(void);
+
+/**
+ * @brief CPU time consumed by the calling thread
+ * @return Seconds of user and system time
+ */
+double platform_thread_cpu_seconds(void);
+
+/**
+ * @brief Nominal CPU clock rate, used to convert CPU time into cycles
+ * @return Cycles per second, 0 if unknown
+ */
+uint64_t platform_cpu_hz(void);
+
+/**
+ * @brief Probe discard, secure-discard and write-zeroes support of a block device
+ * @param device_path Path to block device
+ * @param caps Pointer to store the capabilities (all zero if unsupported)
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_PLATFORM (not Linux or not a block device)
+ */
+int platform_get_offload_caps(const char *device_path, platform_offload_caps_t *caps);
+
+/**
+ * @brief Human readable name of an offload operation
+ * @param op ETDK_OFFLOAD_* value
+ * @return Static string such as "BLKZEROOUT"
+ */
+const char *platform_offload_name(int op);
+
+/**
+ * @brief Let the device discard or zero a whole block device
+ *
+ * Issues @p op in ranges of ETDK_OFFLOAD_RANGE bytes from start to end.
+ *
+ * @param device_path Path to block device
+ * @param op ETDK_OFFLOAD_DISCARD, ETDK_OFFLOAD_SECURE_DISCARD or ETDK_OFFLOAD_ZEROOUT
+ * @param show_progress Non-zero to print a progress line between ranges
+ * @param bytes Pointer to store the number of bytes processed (may be NULL)
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_PLATFORM (operation not supported)
+ */
+int platform_offload_device(const char *device_path, int op, int show_progress, uint64_t *bytes);
+
 /** @} */ // end of Platform
 
+/**
+ * @defgroup Journal Checkpoint Journal
+ * @brief Resumable in-place encryption: completed ranges recorded off the target
+ * @{
+ */
+
+/** @brief Default bytes between two checkpoints (1 GB) */
+#define ETDK_DEFAULT_CHECKPOINT (1024ULL * 1024 * 1024)
+
+/** @brief Runs (one range each) a journal can record */
+#define ETDK_JOURNAL_MAX_RANGES 64
+
+/** @brief Longest target path stored in a journal */
+#define ETDK_JOURNAL_PATH_MAX 4096
+
+/**
+ * @struct etdk_journal_range_t
+ * @brief Bytes encrypted by one run, all under that run's key
+ */
+typedef struct {
+    uint64_t start; /**< First byte of the range */
+    uint64_t end;   /**< Byte offset up to which the data is durable */
+    int mode;       /**< ETDK_MODE_* of the run */
+} etdk_journal_range_t;
+
+/**
+ * @struct etdk_journal_t
+ * @brief In-memory copy of a checkpoint journal
+ */
+typedef struct {
+    char target[ETDK_JOURNAL_PATH_MAX];                    /**< Canonical path of the target */
+    uint64_t size;                                         /**< Target size in bytes */
+    size_t count;                                          /**< Number of ranges */
+    etdk_journal_range_t ranges[ETDK_JOURNAL_MAX_RANGES]; /**< Contiguous ranges from offset 0 */
+} etdk_journal_t;
+
+/**
+ * @brief Start an empty journal for a target
+ * @param journal Journal to initialize
+ * @param target Canonical path of the target
+ * @param size Target size in bytes
+ * @return ETDK_SUCCESS or ETDK_ERROR_IO
+ */
+int journal_init(etdk_journal_t *journal, const char *target, uint64_t size);
+
+/**
+ * @brief Read a journal file
+ * @param path Journal file
+ * @param journal Journal to fill
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO if missing or damaged
+ */
+int journal_load(const char *path, etdk_journal_t *journal);
+
+/**
+ * @brief Bytes encrypted by all recorded runs
+ * @param journal Journal
+ * @return End offset of the last range
+ */
+uint64_t journal_done(const etdk_journal_t *journal);
+
+/**
+ * @brief Append a range for the current run, starting where the last one ended
+ * @param journal Journal
+ * @param mode ETDK_MODE_* of the current run
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO if the journal is full
+ */
+int journal_begin_range(etdk_journal_t *journal, int mode);
+
+/**
+ * @brief Atomically write the journal (temporary file, fsync, rename)
+ * @param path Journal file
+ * @param journal Journal to write
+ * @return ETDK_SUCCESS or ETDK_ERROR_IO
+ */
+int journal_commit(const char *path, const etdk_journal_t *journal);
+
+/** @} */ // end of Journal
+
+/**
+ * @defgroup Progress Progress Reporting
+ * @brief Rate-limited terminal progress line and JSON-lines progress stream
+ * @{
+ */
+
+/** @brief Seconds between two progress updates (terminal line and JSON records) */
+#define ETDK_PROGRESS_INTERVAL 0.5
+
+/** @brief Weight of the newest sample in the smoothed (EWMA) throughput */
+#define ETDK_PROGRESS_EWMA_WEIGHT 0.2
+
+/** @brief Phase: reading, encrypting and writing the main range */
+#define ETDK_PHASE_ENCRYPT 0
+
+/** @brief Phase: flushing the target and writing a journal checkpoint */
+#define ETDK_PHASE_CHECKPOINT 1
+
+/** @brief Phase: the tail after the last whole chunk or sector */
+#define ETDK_PHASE_TAIL 2
+
+/** @brief Phase: final write-back and fsync */
+#define ETDK_PHASE_FLUSH 3
+
+/** @brief Number of ETDK_PHASE_* values */
+#define ETDK_PHASE_COUNT 4
+
+/**
+ * @struct etdk_progress_t
+ * @brief Progress of one target
+ *
+ * Updated by one thread at a time: the caller of the in-order engines or
+ * the writer thread of the pipeline and worker pool.
+ */
+typedef struct {
+    const char *target;    /**< Target path used in the JSON records */
+    int show;              /**< Non-zero to print the terminal progress line */
+    int fd;                /**< JSON-lines descriptor, -1 for none (set to -1 after a write error) */
+    uint64_t total;        /**< Target size in bytes */
+    uint64_t first;        /**< Offset this run started at (non-zero when resuming) */
+    uint64_t done;         /**< Offset processed so far */
+    uint64_t last_done;    /**< done at the last update */
+    double started;        /**< Start of the run (platform_monotonic_seconds) */
+    double last;           /**< Time of the last update */
+    double rate;           /**< Throughput between the last two updates in bytes per second */
+    double ewma;           /**< Smoothed throughput in bytes per second, 0 before the first sample */
+    int phase;             /**< Current ETDK_PHASE_* */
+    double phase_started;  /**< Start of the current phase */
+    double phase_seconds[ETDK_PHASE_COUNT]; /**< Time spent in each phase */
+} etdk_progress_t;
+
+/**
+ * @brief Start reporting progress for a target, emits a "start" record
+ * @param progress Progress to initialize
+ * @param target Target path
+ * @param total Target size in bytes
+ * @param first Offset the run starts at
+ * @param show Non-zero to print the terminal progress line
+ * @param fd JSON-lines descriptor, -1 for none
+ */
+void progress_init(etdk_progress_t *progress, const char *target, uint64_t total, uint64_t first, int show, int fd);
+
+/**
+ * @brief Record progress, printing and emitting at most every ETDK_PROGRESS_INTERVAL
+ * @param progress Progress, NULL for none
+ * @param done Offset processed so far
+ */
+void progress_update(etdk_progress_t *progress, uint64_t done);
+
+/**
+ * @brief Switch to another phase, emits a "phase" record
+ * @param progress Progress, NULL for none
+ * @param phase ETDK_PHASE_*
+ */
+void progress_phase(etdk_progress_t *progress, int phase);
+
+/**
+ * @brief Print the final progress line and emit a "summary" record
+ * @param progress Progress
+ * @param result ETDK_SUCCESS or the error code of the run
+ */
+void progress_finish(etdk_progress_t *progress, int result);
+
+/**
+ * @brief Emit the "run" record after all targets
+ * @param fd JSON-lines descriptor, -1 for none
+ * @param result ETDK_SUCCESS, or an error code if any target failed
+ * @param targets Number of targets
+ * @param bytes Bytes encrypted in total
+ * @param elapsed Seconds for all targets
+ * @param throttled Seconds held back by the rate limiter
+ */
+void progress_report_run(int fd, int result, size_t targets, uint64_t bytes, double elapsed, double throttled);
+
+/** @} */ // end of Progress
+
+/**
+ * @defgroup Bench Benchmark
+ * @brief "etdk bench": cipher throughput and sequential I/O of this machine
+ * @{
+ */
+
+/**
+ * @brief Run the bench subcommand
+ * @param argc Argument count, argv[0] is "bench"
+ * @param argv Arguments after the program name
+ * @param program_name Name of the executable for the usage text
+ * @return Process exit code (0 on success)
+ */
+int bench_main(int argc, char *argv[], const char *program_name);
+
+/** @} */ // end of Bench
+
+/**
+ * @defgroup Decrypt Recovery Decryption
+ * @brief "etdk decrypt": reverse an encryption run when the key was kept
+ * @{
+ */
+
+/**
+ * @brief Run the decrypt subcommand
+ * @param argc Argument count, argv[0] is "decrypt"
+ * @param argv Arguments after the program name
+ * @param program_name Name of the executable for the usage text
+ * @return Process exit code (0 on success)
+ */
+int decrypt_main(int argc, char *argv[], const char *program_name);
+
+/** @} */ // end of Decrypt
+
+/**
+ * @defgroup Session Key Derivation Sessions
+ * @brief One master key and a manifest for many files, each with its own derived key
+ * @{
+ */
+
+/**
+ * @struct etdk_session_t
+ * @brief Session master key and manifest (allocated in one locked page by session_create())
+ */
+typedef struct etdk_session {
+    crypto_context_t master;   /**< master.key is the master key, master.cipher_ctx the AES-256-ECB KDF */
+    int mode;                  /**< ETDK_MODE_* of every target of the session */
+    uint64_t next_index;       /**< Index of the next target (protected by lock) */
+    FILE *manifest;            /**< Open manifest, one line per target */
+    const char *manifest_path; /**< Manifest path for messages */
+    uint64_t manifest_dev;     /**< Device of the manifest (trees skip it) */
+    uint64_t manifest_ino;     /**< Inode of the manifest */
+    int write_error;           /**< Non-zero once a manifest write failed */
+    pthread_mutex_t lock;      /**< Serializes index assignment and manifest lines */
+    int lock_initialized;      /**< Non-zero once lock is initialized */
+    size_t size;               /**< Bytes allocated and locked */
+} etdk_session_t;
+
+/**
+ * @struct etdk_manifest_entry_t
+ * @brief One target recorded in a manifest
+ */
+typedef struct {
+    uint64_t index; /**< Index the target's keys are derived from */
+    uint64_t size;  /**< Size when it was encrypted */
+    char *path;     /**< Path of the target */
+    int failed;     /**< Non-zero if it was not (completely) encrypted */
+} etdk_manifest_entry_t;
+
+/**
+ * @brief Start a session with a random master key and a new manifest
+ * @param manifest_path Manifest to create exclusively (keep it off the targets)
+ * @param mode ETDK_MODE_* of every target
+ * @return Session, or NULL on failure
+ */
+etdk_session_t *session_create(const char *manifest_path, int mode);
+
+/**
+ * @brief Assign the next index to a target, derive its keys and record it in the manifest (thread-safe)
+ * @param session Session
+ * @param path Target path as recorded for recovery
+ * @param size Target size in bytes
+ * @param ctx Receives key, tweak_key and iv (mode and data_unit are kept)
+ * @param index Receives the target's index
+ * @return ETDK_SUCCESS, ETDK_ERROR_CRYPTO or ETDK_ERROR_IO
+ */
+int session_begin(etdk_session_t *session, const char *path, uint64_t size, crypto_context_t *ctx,
+                  uint64_t *index);
+
+/**
+ * @brief Record that a target of the session was not (completely) encrypted
+ * @param session Session
+ * @param index Index from session_begin()
+ */
+void session_fail(etdk_session_t *session, uint64_t index);
+
+/**
+ * @brief Display the master key and the manifest path (ONE TIME ONLY)
+ * @param session Session
+ */
+void session_display(const etdk_session_t *session);
+
+/**
+ * @brief Flush the manifest, wipe the master key and free the session
+ * @param session Session (may be NULL)
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO if the manifest could not be written completely
+ */
+int session_close(etdk_session_t *session);
+
+/**
+ * @brief Derive a target's keys from a saved master key (recovery)
+ * @param master_key Master key (AES_KEY_SIZE bytes)
+ * @param index Index from the manifest
+ * @param ctx Receives key, tweak_key and iv (mode and data_unit are kept)
+ * @return ETDK_SUCCESS or ETDK_ERROR_CRYPTO
+ */
+int session_derive_key(const uint8_t *master_key, uint64_t index, crypto_context_t *ctx);
+
+/**
+ * @brief Read a manifest
+ * @param path Manifest file
+ * @param mode Receives the ETDK_MODE_* of the session
+ * @param entries Receives the entries (free with session_free_manifest())
+ * @param count Receives the number of entries
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO (missing or damaged) or ETDK_ERROR_MEMORY
+ */
+int session_load_manifest(const char *path, int *mode, etdk_manifest_entry_t **entries, size_t *count);
+
+/**
+ * @brief Free manifest entries
+ * @param entries Entries from session_load_manifest() (may be NULL)
+ * @param count Number of entries
+ */
+void session_free_manifest(etdk_manifest_entry_t *entries, size_t count);
+
+/** @} */ // end of Session
+
+/**
+ * @defgroup IO Positional I/O
+ * @brief File descriptor based pread/pwrite helpers used for files and devices
+ * @{
+ */
+
+/**
+ * @brief Read up to len bytes at an absolute offset (retries short reads)
+ * @param fd Open file descriptor
+ * @param buf Destination buffer
+ * @param len Number of bytes to read
+ * @param offset Absolute byte offset
+ * @param done Pointer to store number of bytes read (less than len only at EOF)
+ * @return ETDK_SUCCESS or ETDK_ERROR_IO
+ */
+int io_pread_full(int fd, void *buf, size_t len, uint64_t offset, size_t *done);
+
+/**
+ * @brief Write exactly len bytes at an absolute offset (retries short writes)
+ * @param fd Open file descriptor
+ * @param buf Source buffer
+ * @param len Number of bytes to write
+ * @param offset Absolute byte offset
+ * @return ETDK_SUCCESS or ETDK_ERROR_IO
+ */
+int io_pwrite_full(int fd, const void *buf, size_t len, uint64_t offset);
+
+/**
+ * @brief Open a file or device, optionally bypassing the page cache
+ *
+ * With direct set, O_DIRECT (Linux) or F_NOCACHE (macOS) is requested.
+ * If the filesystem refuses direct I/O the path is opened buffered and
+ * *direct is cleared so the caller knows which mode it got.
+ *
+ * @param path Path to open
+ * @param flags open() access flags (e.g. O_RDWR)
+ * @param direct In: request direct I/O, Out: direct I/O actually enabled
+ * @return File descriptor, or -1 on error (errno set)
+ */
+int io_open(const char *path, int flags, int *direct);
+
+/**
+ * @brief Hint that a range will be read sequentially (POSIX_FADV_SEQUENTIAL)
+ * @param fd Open file descriptor
+ * @param offset First byte
+ * @param len Length in bytes (0 = to end of file)
+ */
+void io_advise_sequential(int fd, uint64_t offset, uint64_t len);
+
+/**
+ * @brief Drop clean cached pages of a processed range (POSIX_FADV_DONTNEED)
+ * @param fd Open file descriptor
+ * @param offset First byte
+ * @param len Length in bytes
+ */
+void io_drop_cache(int fd, uint64_t offset, uint64_t len);
+
+/**
+ * @struct io_writeback_t
+ * @brief Write-behind state that bounds dirty and cached pages of a buffered writer
+ */
+typedef struct {
+    int fd;             /**< Descriptor being written */
+    uint64_t window;    /**< Bytes per writeback window */
+    uint64_t submitted; /**< Writeback started up to this offset */
+    uint64_t evicted;   /**< Flushed and dropped from the cache up to this offset */
+} io_writeback_t;
+
+/**
+ * @brief Start write-behind tracking
+ * @param wb State to initialize
+ * @param fd Descriptor the data is written to
+ * @param offset Offset of the first write
+ * @param window Bytes per window (0 = ETDK_WRITEBACK_WINDOW)
+ */
+void io_writeback_init(io_writeback_t *wb, int fd, uint64_t offset, uint64_t window);
+
+/**
+ * @brief Start writeback of full windows and evict the window before (sync_file_range + DONTNEED)
+ * @param wb Write-behind state
+ * @param written Offset up to which data has been written
+ */
+void io_writeback_advance(io_writeback_t *wb, uint64_t written);
+
+/**
+ * @brief Flush and evict the remaining written range
+ * @param wb Write-behind state
+ * @param written Offset up to which data has been written
+ */
+void io_writeback_finish(io_writeback_t *wb, uint64_t written);
+
+/**
+ * @brief Initialize a token-bucket limiter
+ * @param limiter Limiter to initialize
+ * @param bytes_per_second Byte rate (0 = unlimited)
+ * @param ops_per_second Request rate (0 = unlimited)
+ * @return ETDK_SUCCESS or ETDK_ERROR_PLATFORM
+ */
+int io_limiter_init(io_limiter_t *limiter, uint64_t bytes_per_second, uint64_t ops_per_second);
+
+/**
+ * @brief Release a limiter
+ * @param limiter Limiter from io_limiter_init()
+ */
+void io_limiter_free(io_limiter_t *limiter);
+
+/**
+ * @brief Wait until a transfer of bytes in ops requests is allowed (thread-safe)
+ * @param limiter Limiter, NULL for none
+ * @param bytes Bytes about to be transferred
+ * @param ops Requests about to be issued
+ */
+void io_limiter_wait(io_limiter_t *limiter, uint64_t bytes, unsigned ops);
+
+/**
+ * @brief Find the next allocated range of a sparse file (SEEK_DATA/SEEK_HOLE)
+ *
+ * Filesystems without hole support report everything as data.
+ *
+ * @param fd Open file descriptor
+ * @param offset First byte to look at
+ * @param end Byte offset to stop at
+ * @param data_start Pointer to store the start of the allocated range
+ * @param data_end Pointer to store the end of the allocated range (at most end)
+ * @return 1 if a range was found, 0 if only holes remain before end
+ */
+int io_next_data(int fd, uint64_t offset, uint64_t end, uint64_t *data_start, uint64_t *data_end);
+
+/**
+ * @struct io_buffer_pool_t
+ * @brief Fixed set of equally sized, aligned I/O buffers
+ */
+typedef struct {
+    unsigned char **buffers; /**< Array of count buffer pointers */
+    size_t count;            /**< Number of buffers */
+    size_t size;             /**< Usable size of each buffer in bytes */
+    size_t alignment;        /**< Alignment of each buffer in bytes */
+} io_buffer_pool_t;
+
+/**
+ * @brief Allocate a pool of aligned buffers with posix_memalign()
+ * @param pool Pool to initialize
+ * @param count Number of buffers
+ * @param size Size of each buffer (rounded up to alignment)
+ * @param alignment Buffer alignment, power of two (e.g. physical sector size)
+ * @return ETDK_SUCCESS or ETDK_ERROR_MEMORY
+ */
+int io_pool_init(io_buffer_pool_t *pool, size_t count, size_t size, size_t alignment);
+
+/**
+ * @brief Free all buffers of a pool
+ * @param pool Pool to release (may be partially initialized)
+ */
+void io_pool_free(io_buffer_pool_t *pool);
+
+/**
+ * @brief In-place chunk transform called by the I/O engines
+ *
+ * Engines call the transform exactly once per chunk, in ascending offset
+ * order, between reading the chunk and writing it back.
+ *
+ * @param arg Caller supplied state
+ * @param buf Chunk data (transformed in place)
+ * @param len Chunk length in bytes
+ * @param offset Absolute offset of the chunk
+ * @return ETDK_SUCCESS or an error code to abort the run
+ */
+typedef int (*io_transform_fn)(void *arg, unsigned char *buf, size_t len, uint64_t offset);
+
+/**
+ * @brief Progress callback used by the I/O engines
+ * @param arg Caller supplied state
+ * @param processed Absolute offset up to which data has been written back
+ */
+typedef void (*io_progress_fn)(void *arg, uint64_t processed);
+
+/**
+ * @brief Transform a byte range in place with synchronous pread/pwrite
+ * @param fd Descriptor opened for read/write
+ * @param offset First byte to process
+ * @param end Byte offset to stop at
+ * @param buf Buffer of at least chunk_size bytes
+ * @param chunk_size Bytes per read/write
+ * @param transform In-place transform applied in offset order
+ * @param arg Passed to transform
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, or the transform's error code
+ */
+int io_sync_engine_run(int fd, uint64_t offset, uint64_t end, unsigned char *buf, size_t chunk_size,
+                       io_transform_fn transform, void *arg);
+
+/**
+ * @brief Transform a byte range in place using io_uring
+ *
+ * Keeps up to depth reads and depth writes in flight with registered
+ * fixed buffers. The pool must contain at least 2 * depth buffers of at
+ * least chunk_size bytes.
+ *
+ * @param fd Descriptor opened for read/write
+ * @param offset First byte to process
+ * @param end Byte offset to stop at
+ * @param pool Buffer pool (aligned for O_DIRECT if fd uses it)
+ * @param chunk_size Bytes per request
+ * @param depth Number of reads and writes in flight
+ * @param transform In-place transform applied in offset order
+ * @param arg Passed to transform
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, ETDK_ERROR_CRYPTO, or ETDK_ERROR_PLATFORM if io_uring is unavailable
+ */
+int io_uring_engine_run(int fd, uint64_t offset, uint64_t end, const io_buffer_pool_t *pool, size_t chunk_size,
+                        unsigned depth, io_transform_fn transform, void *arg);
+
+/**
+ * @struct io_batch_file_t
+ * @brief One whole-file rewrite of an io_uring batch (io_uring_batch_run())
+ */
+typedef struct {
+    const char *path;   /**< File to rewrite */
+    uint64_t size;      /**< Size the file had when it was listed */
+    unsigned char *buf; /**< Holds size + 1 bytes for the read, plus what the transform appends */
+    int result;         /**< Set by the engine: ETDK_SUCCESS, ETDK_ERROR_PLATFORM or ETDK_ERROR_SYMLINK (left
+                             untouched), or error */
+} io_batch_file_t;
+
+/**
+ * @brief Whole-file transform called by io_uring_batch_run()
+ *
+ * Called once per file, in completion order, after the file was read.
+ *
+ * @param arg Caller supplied state
+ * @param index Index of the file in the batch
+ * @param buf File contents (transformed in place)
+ * @param len File size in bytes
+ * @param out_len Receives the number of bytes to write back from offset 0
+ * @return ETDK_SUCCESS, or an error code to leave this file untouched
+ */
+typedef int (*io_batch_fn)(void *arg, size_t index, unsigned char *buf, size_t len, size_t *out_len);
+
+/**
+ * @brief Rewrite a batch of small files through linked io_uring chains
+ *
+ * Every file gets an openat -> read chain, then write -> fsync -> close,
+ * all submitted for the whole batch at once with direct descriptors, so
+ * the per-file system calls disappear into a few io_uring_enter() calls.
+ *
+ * Files that cannot be opened for writing or no longer have their listed
+ * size are closed untouched with result ETDK_ERROR_PLATFORM. If the
+ * ring stops accepting requests, the requests already in the kernel are
+ * waited for before returning ETDK_ERROR_IO; files not yet written then
+ * get ETDK_ERROR_PLATFORM, the others ETDK_ERROR_IO.
+ *
+ * @param files Files of the batch (results are stored in them)
+ * @param count Number of files
+ * @param flush Nonzero to fsync every file before closing it
+ * @param transform Whole-file transform
+ * @param arg Passed to transform
+ * @return ETDK_SUCCESS once every file has a result, ETDK_ERROR_IO if submitting failed, or
+ *         ETDK_ERROR_PLATFORM if the kernel lacks the needed io_uring features (no file was touched)
+ */
+int io_uring_batch_run(io_batch_file_t *files, size_t count, int flush, io_batch_fn transform, void *arg);
+
+/**
+ * @brief Per-stage timing of the reader / cipher / writer pipeline
+ *
+ * Busy is time spent in pread(), the transform and pwrite(); idle is time
+ * a stage waited for its input or for a free buffer. Cipher times are
+ * summed over all workers.
+ */
+typedef struct {
+    double read_busy;   /**< Seconds the reader spent reading */
+    double read_idle;   /**< Seconds the reader waited for a free buffer */
+    double cipher_busy; /**< Seconds the cipher workers spent transforming */
+    double cipher_idle; /**< Seconds the cipher workers waited for data */
+    double write_busy;  /**< Seconds the writer spent writing */
+    double write_idle;  /**< Seconds the writer waited for transformed data */
+} io_pipeline_stats_t;
+
+/**
+ * @brief Overwrite a byte range with generated data, never reading it
+ *
+ * The generator fills each chunk (it is called with the buffer contents
+ * undefined), which is then written with pwrite(). If a chunk write fails
+ * with EIO it is retried unit by unit; units the device still cannot
+ * write are counted in bad_units and skipped.
+ *
+ * @param fd Descriptor opened for writing
+ * @param offset First byte to overwrite
+ * @param end Byte offset to stop at
+ * @param buf Buffer of at least chunk_size bytes (aligned for O_DIRECT if needed)
+ * @param chunk_size Bytes per write
+ * @param unit Retry granularity after EIO (sector size, divides chunk_size)
+ * @param generate Fills the buffer for a given offset, called in ascending offset order
+ * @param arg Passed to generate
+ * @param bad_units Incremented for every unit that could not be written (may be NULL)
+ * @return ETDK_SUCCESS on success (even with bad units), error code on failure
+ */
+int io_fill_engine_run(int fd, uint64_t offset, uint64_t end, unsigned char *buf, size_t chunk_size, size_t unit,
+                       io_transform_fn generate, void *arg, uint64_t *bad_units);
+
+/**
+ * @brief Transform a byte range in place with a reader, cipher worker pool and writer
+ *
+ * A reader thread, threads cipher workers and the calling thread (writer)
+ * exchange chunk descriptors through bounded lock-free ring buffers.
+ * With several workers chunks are transformed concurrently and out of
+ * order, so the transform must not depend on chunk order (XTS, not CBC).
+ * With threads == 1 chunks are transformed in offset order, which makes
+ * it a double-buffered read/encrypt/write pipeline usable with CBC.
+ * Worker i calls the transform with worker_args[i], so every worker can
+ * own its own cipher context. The pool should hold at least
+ * 2 * threads + 2 buffers. After an error the reader stops; chunks it
+ * has already read are still transformed (a worker may wait for state
+ * another publishes, like the CBC decryption chain) but not written.
+ *
+ * @param fd Descriptor opened for read/write
+ * @param offset First byte to process
+ * @param end Byte offset to stop at
+ * @param pool Buffer pool
+ * @param chunk_size Bytes per chunk
+ * @param threads Number of cipher workers
+ * @param transform Order-independent in-place transform
+ * @param worker_args Array of threads transform arguments
+ * @param progress Optional callback after each write (may be NULL)
+ * @param progress_arg Passed to progress
+ * @param stats Optional per-stage busy/idle times (may be NULL)
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, ETDK_ERROR_MEMORY, ETDK_ERROR_PLATFORM, or the transform's error code
+ */
+int io_parallel_engine_run(int fd, uint64_t offset, uint64_t end, const io_buffer_pool_t *pool, size_t chunk_size,
+                           unsigned threads, io_transform_fn transform, void *const *worker_args,
+                           io_progress_fn progress, void *progress_arg, io_pipeline_stats_t *stats);
+
+/** @} */ // end of IO
+
 #endif // ETDK_H
@@ -0,0 +1,459 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * Bench Module - "etdk bench": cipher and sequential I/O benchmark
+ *
+ * Measures what a wipe can reach on this machine before a disk is
+ * touched: GB/s and cycles per byte of every cipher mode at several
+ * chunk sizes and thread counts (through crypto_bench_cipher(), i.e. the
+ * device engine's own chunk function), and optionally the sequential
+ * write and read bandwidth of a scratch file that etdk creates itself.
+ * Nothing but the scratch file is ever written.
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/** @brief Most entries in one --modes, --sizes or --threads list */
+#define BENCH_MAX_LIST 16
+
+/** @brief Default seconds per cipher measurement */
+#define BENCH_DEFAULT_SECONDS 0.5
+
+/** @brief Default size of the scratch file (256 MB) */
+#define BENCH_DEFAULT_SCRATCH_SIZE (256 * 1024 * 1024)
+
+/** @brief XTS data unit used by the cipher benchmark (512-byte logical sectors) */
+#define BENCH_XTS_DATA_UNIT 512
+
+/**
+ * @struct bench_io_result_t
+ * @brief Outcome of the scratch file measurement
+ */
+typedef struct {
+    uint64_t bytes;       /**< Bytes written and read */
+    size_t chunk_size;    /**< Bytes per request */
+    int direct;           /**< Whether direct I/O was active */
+    double write_seconds; /**< Writing including the final fsync */
+    double read_seconds;  /**< Reading back with a cold cache */
+} bench_io_result_t;
+
+/**
+ * @brief Print usage of the bench subcommand
+ * @param program_name The name of the program executable
+ */
+static void bench_usage(const char *program_name) {
+    printf("Usage: %s bench [options]\n\n", program_name);
+    printf("Measures cipher throughput in memory and, with --scratch, sequential I/O.\n\n");
+    printf("Options:\n");
+    printf("  --modes <list>           Cipher modes, comma separated (default: cbc,ctr,xts)\n");
+    printf("  --sizes <list>           Chunk sizes, K/M/G suffix allowed (default: 16K,256K,4M)\n");
+    printf("  --threads <list>         Thread counts (default: 1 and the number of online CPUs)\n");
+    printf("  --time <seconds>         Run time per cipher measurement (default: 0.5)\n");
+    printf("  --scratch <file>         Also measure sequential write and read on a new file <file>\n");
+    printf("                           (must not exist, removed afterwards)\n");
+    printf("  --scratch-size <size>    Size of the scratch file (default: 256M)\n");
+    printf("  --chunk-size <size>      Bytes per scratch I/O request (default: 4M)\n");
+    printf("  --buffered               Scratch I/O through the page cache instead of direct I/O\n");
+    printf("  --json                   Print one JSON document instead of the tables\n");
+    printf("  -h, --help               Show this help message\n\n");
+    printf("Example:\n");
+    printf("  %s bench --threads 1,4,8 --scratch /mnt/target/etdk.scratch\n", program_name);
+}
+
+/**
+ * @brief Split a comma separated list
+ * @param text List to split (modified)
+ * @param items Receives pointers into text
+ * @return Number of items, -1 if there are more than BENCH_MAX_LIST or an empty one
+ */
+static int split_list(char *text, char **items) {
+    int count = 0;
+    char *save = NULL;
+
+    for (char *item = strtok_r(text, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        if (count == BENCH_MAX_LIST)
+            return -1;
+        items[count++] = item;
+    }
+    return count > 0 ? count : -1;
+}
+
+/**
+ * @brief Short lowercase mode name as used on the command line
+ * @param mode ETDK_MODE_* value
+ * @return "cbc", "xts" or "ctr"
+ */
+static const char *bench_mode_name(int mode) {
+    return mode == ETDK_MODE_XTS ? "xts" : (mode == ETDK_MODE_CTR ? "ctr" : "cbc");
+}
+
+/**
+ * @brief Write and read back a new scratch file sequentially
+ *
+ * The file is created exclusively, so an existing file or a device is
+ * never overwritten. Written data is not zeros, so compressing or
+ * deduplicating storage cannot shortcut it. The write time includes the
+ * final fsync; buffered reads start from a dropped page cache.
+ *
+ * @param path Scratch file to create
+ * @param size Bytes to write (rounded up to whole chunks)
+ * @param chunk_size Bytes per request
+ * @param direct Non-zero to try direct I/O
+ * @param result Receives the timings
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO / ETDK_ERROR_MEMORY on failure
+ */
+static int bench_io(const char *path, uint64_t size, size_t chunk_size, int direct, bench_io_result_t *result) {
+    int create = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (create < 0) {
+        fprintf(stderr, "Cannot create scratch file %s: %s\n", path, strerror(errno));
+        return ETDK_ERROR_IO;
+    }
+    close(create);
+
+    int fd = io_open(path, O_RDWR, &direct);
+    io_buffer_pool_t pool;
+    if (fd < 0 || io_pool_init(&pool, 1, chunk_size, ETDK_BUFFER_ALIGNMENT) != ETDK_SUCCESS) {
+        fprintf(stderr, "Cannot open scratch file %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        remove(path);
+        return fd < 0 ? ETDK_ERROR_IO : ETDK_ERROR_MEMORY;
+    }
+
+    // xorshift64: cheap, incompressible enough for SSD controllers
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    uint64_t *words = (uint64_t *)pool.buffers[0];
+    for (size_t i = 0; i < chunk_size / sizeof(uint64_t); i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        words[i] = state;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->bytes = (size + chunk_size - 1) / chunk_size * chunk_size;
+    result->chunk_size = chunk_size;
+    result->direct = direct;
+
+    int status = ETDK_SUCCESS;
+    double start = platform_monotonic_seconds();
+    for (uint64_t offset = 0; status == ETDK_SUCCESS && offset < result->bytes; offset += chunk_size) {
+        status = io_pwrite_full(fd, pool.buffers[0], chunk_size, offset);
+    }
+    if (status == ETDK_SUCCESS && fsync(fd) != 0)
+        status = ETDK_ERROR_IO;
+    result->write_seconds = platform_monotonic_seconds() - start;
+
+    if (status == ETDK_SUCCESS && !direct)
+        io_drop_cache(fd, 0, result->bytes);
+
+    start = platform_monotonic_seconds();
+    for (uint64_t offset = 0; status == ETDK_SUCCESS && offset < result->bytes; offset += chunk_size) {
+        size_t done = 0;
+        status = io_pread_full(fd, pool.buffers[0], chunk_size, offset, &done);
+        if (status == ETDK_SUCCESS && done != chunk_size)
+            status = ETDK_ERROR_IO;
+    }
+    result->read_seconds = platform_monotonic_seconds() - start;
+
+    if (status != ETDK_SUCCESS)
+        fprintf(stderr, "Scratch I/O failed on %s: %s\n", path, strerror(errno));
+    io_pool_free(&pool);
+    close(fd);
+    remove(path);
+    return status;
+}
+
+/**
+ * @brief Entry point of "etdk bench"
+ *
+ * Runs every combination of --modes, --sizes and --threads through
+ * crypto_bench_cipher() with a fresh random key (wiped afterwards), then
+ * the optional scratch file measurement, and prints either two tables or
+ * one JSON document.
+ *
+ * @param argc Argument count, argv[0] is "bench"
+ * @param argv Arguments after the program name
+ * @param program_name Name of the executable for the usage text
+ * @return 0 on success, 1 on error
+ */
+int bench_main(int argc, char *argv[], const char *program_name) {
+    int modes[BENCH_MAX_LIST] = {ETDK_MODE_CBC, ETDK_MODE_CTR, ETDK_MODE_XTS};
+    int mode_count = 3;
+    size_t sizes[BENCH_MAX_LIST] = {16 * 1024, 256 * 1024, 4 * 1024 * 1024};
+    int size_count = 3;
+    unsigned threads[BENCH_MAX_LIST] = {1};
+    int thread_count = 1;
+    double seconds = BENCH_DEFAULT_SECONDS;
+    const char *scratch = NULL;
+    size_t scratch_size = BENCH_DEFAULT_SCRATCH_SIZE;
+    size_t chunk_size = ETDK_DEFAULT_CHUNK_SIZE;
+    int direct = 1;
+    int json = 0;
+    char *items[BENCH_MAX_LIST];
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 1) {
+        threads[thread_count++] = online > ETDK_MAX_THREADS ? ETDK_MAX_THREADS : (unsigned)online;
+    }
+
+    enum {
+        OPT_MODES = 256,
+        OPT_SIZES,
+        OPT_THREADS,
+        OPT_TIME,
+        OPT_SCRATCH,
+        OPT_SCRATCH_SIZE,
+        OPT_CHUNK_SIZE,
+        OPT_BUFFERED,
+        OPT_JSON
+    };
+    static const struct option long_options[] = {
+        {"modes", required_argument, NULL, OPT_MODES},
+        {"sizes", required_argument, NULL, OPT_SIZES},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {"time", required_argument, NULL, OPT_TIME},
+        {"scratch", required_argument, NULL, OPT_SCRATCH},
+        {"scratch-size", required_argument, NULL, OPT_SCRATCH_SIZE},
+        {"chunk-size", required_argument, NULL, OPT_CHUNK_SIZE},
+        {"buffered", no_argument, NULL, OPT_BUFFERED},
+        {"json", no_argument, NULL, OPT_JSON},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case OPT_MODES:
+            mode_count = split_list(optarg, items);
+            for (int i = 0; i < mode_count; i++) {
+                if (strcmp(items[i], "cbc") == 0) {
+                    modes[i] = ETDK_MODE_CBC;
+                } else if (strcmp(items[i], "xts") == 0) {
+                    modes[i] = ETDK_MODE_XTS;
+                } else if (strcmp(items[i], "ctr") == 0) {
+                    modes[i] = ETDK_MODE_CTR;
+                } else {
+                    mode_count = -1;
+                }
+            }
+            if (mode_count < 0) {
+                fprintf(stderr, "Error: Invalid mode list (use cbc, xts and ctr)\n");
+                return 1;
+            }
+            break;
+        case OPT_SIZES:
+            size_count = split_list(optarg, items);
+            for (int i = 0; i < size_count; i++) {
+                if (etdk_parse_size(items[i], &sizes[i]) != 0 || sizes[i] % BENCH_XTS_DATA_UNIT != 0 ||
+                    sizes[i] > (size_t)1024 * 1024 * 1024) {
+                    size_count = -1;
+                }
+            }
+            if (size_count < 0) {
+                fprintf(stderr, "Error: Invalid size list (multiples of %d bytes, at most 1G)\n",
+                        BENCH_XTS_DATA_UNIT);
+                return 1;
+            }
+            break;
+        case OPT_THREADS:
+            thread_count = split_list(optarg, items);
+            for (int i = 0; i < thread_count; i++) {
+                char *end = NULL;
+                unsigned long value = strtoul(items[i], &end, 10);
+                if (end == items[i] || *end != '\0' || value == 0 || value > ETDK_MAX_THREADS) {
+                    thread_count = -1;
+                } else {
+                    threads[i] = (unsigned)value;
+                }
+            }
+            if (thread_count < 0) {
+                fprintf(stderr, "Error: Thread counts must be between 1 and %d\n", ETDK_MAX_THREADS);
+                return 1;
+            }
+            break;
+        case OPT_TIME: {
+            char *end = NULL;
+            seconds = strtod(optarg, &end);
+            if (end == optarg || *end != '\0' || seconds <= 0 || seconds > 3600) {
+                fprintf(stderr, "Error: Invalid time '%s' (seconds per measurement)\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case OPT_SCRATCH:
+            scratch = optarg;
+            break;
+        case OPT_SCRATCH_SIZE:
+            if (etdk_parse_size(optarg, &scratch_size) != 0) {
+                fprintf(stderr, "Error: Invalid scratch size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_CHUNK_SIZE:
+            if (etdk_parse_size(optarg, &chunk_size) != 0 || chunk_size % ETDK_BUFFER_ALIGNMENT != 0 ||
+                chunk_size > (size_t)1024 * 1024 * 1024) {
+                fprintf(stderr, "Error: Invalid chunk size '%s' (multiple of %d bytes, at most 1G)\n", optarg,
+                        ETDK_BUFFER_ALIGNMENT);
+                return 1;
+            }
+            break;
+        case OPT_BUFFERED:
+            direct = 0;
+            break;
+        case OPT_JSON:
+            json = 1;
+            break;
+        case 'h':
+            bench_usage(program_name);
+            return 0;
+        default:
+            bench_usage(program_name);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, "Error: Unexpected argument '%s'\n", argv[optind]);
+        return 1;
+    }
+
+    crypto_context_t ctx;
+    if (crypto_init(&ctx) != ETDK_SUCCESS) {
+        fprintf(stderr, "Failed to initialize cryptography\n");
+        return 1;
+    }
+    ctx.data_unit = BENCH_XTS_DATA_UNIT;
+
+    uint64_t hz = platform_cpu_hz();
+    if (json) {
+        printf("{\"cpu_hz\":%llu,\"seconds_per_run\":%.3f,\"xts_data_unit\":%d,\"cipher\":[", (unsigned long long)hz,
+               seconds, BENCH_XTS_DATA_UNIT);
+    } else {
+        printf("Cipher benchmark: %.2f s per run, ", seconds);
+        if (hz > 0) {
+            printf("CPU %.2f GHz nominal", hz / 1e9);
+        } else {
+            printf("CPU clock unknown (no cycles/byte)");
+        }
+        printf(", %d-byte XTS data units\n\n", BENCH_XTS_DATA_UNIT);
+        printf("%-5s %8s %8s %10s %10s\n", "MODE", "CHUNK", "THREADS", "GB/s", "CYCLES/B");
+        printf("%-5s %8s %8s %10s %10s\n", "----", "-----", "-------", "----", "--------");
+    }
+    fflush(stdout);
+
+    int status = ETDK_SUCCESS;
+    int first = 1;
+    for (int m = 0; m < mode_count && status == ETDK_SUCCESS; m++) {
+        for (int s = 0; s < size_count && status == ETDK_SUCCESS; s++) {
+            for (int t = 0; t < thread_count && status == ETDK_SUCCESS; t++) {
+                crypto_bench_result_t run;
+                ctx.mode = modes[m];
+                status = crypto_bench_cipher(&ctx, sizes[s], threads[t], seconds, &run);
+                if (status != ETDK_SUCCESS)
+                    break;
+
+                double rate = run.seconds > 0 ? run.bytes / run.seconds : 0.0;
+                double cycles = hz > 0 && run.bytes > 0 ? run.cpu_seconds * (double)hz / run.bytes : 0.0;
+                if (json) {
+                    printf("%s{\"mode\":\"%s\",\"chunk\":%zu,\"threads\":%u,\"bytes\":%llu,\"seconds\":%.3f,"
+                           "\"cpu_seconds\":%.3f,\"bytes_per_second\":%.0f,",
+                           first ? "" : ",", bench_mode_name(modes[m]), sizes[s], threads[t],
+                           (unsigned long long)run.bytes, run.seconds, run.cpu_seconds, rate);
+                    if (hz > 0) {
+                        printf("\"cycles_per_byte\":%.3f}", cycles);
+                    } else {
+                        printf("\"cycles_per_byte\":null}");
+                    }
+                } else {
+                    char chunk[24];
+                    if (sizes[s] % (1024 * 1024) == 0) {
+                        snprintf(chunk, sizeof(chunk), "%zuM", sizes[s] / (1024 * 1024));
+                    } else {
+                        snprintf(chunk, sizeof(chunk), "%zuK", sizes[s] / 1024);
+                    }
+                    printf("%-5s %8s %8u %10.2f", bench_mode_name(modes[m]), chunk, threads[t],
+                           rate / (1024.0 * 1024.0 * 1024.0));
+                    if (hz > 0) {
+                        printf(" %10.2f\n", cycles);
+                    } else {
+                        printf(" %10s\n", "n/a");
+                    }
+                }
+                first = 0;
+                fflush(stdout);
+            }
+        }
+    }
+    if (json)
+        printf("]");
+
+    // Fixed cost per file of a batch run: new cipher context vs re-keying the worker's cached one
+    if (status == ETDK_SUCCESS) {
+        if (json) {
+            printf(",\"setup\":[");
+        } else {
+            printf("\nCipher setup per target (microseconds):\n\n");
+            printf("%-5s %10s %10s %8s\n", "MODE", "NEW CTX", "REKEYED", "SAVED");
+            printf("%-5s %10s %10s %8s\n", "----", "-------", "-------", "-----");
+        }
+        for (int m = 0; m < mode_count && status == ETDK_SUCCESS; m++) {
+            crypto_bench_setup_t setup;
+            ctx.mode = modes[m];
+            status = crypto_bench_setup(&ctx, seconds / 2, &setup);
+            if (status != ETDK_SUCCESS)
+                break;
+
+            if (json) {
+                printf("%s{\"mode\":\"%s\",\"new_context_seconds\":%.9f,\"rekeyed_seconds\":%.9f}", m ? "," : "",
+                       bench_mode_name(modes[m]), setup.fresh_seconds, setup.rekeyed_seconds);
+            } else {
+                printf("%-5s %10.3f %10.3f %7.0f%%\n", bench_mode_name(modes[m]), setup.fresh_seconds * 1e6,
+                       setup.rekeyed_seconds * 1e6,
+                       setup.fresh_seconds > 0 ? (1.0 - setup.rekeyed_seconds / setup.fresh_seconds) * 100 : 0.0);
+            }
+            fflush(stdout);
+        }
+        if (json)
+            printf("]");
+    }
+    crypto_cleanup(&ctx);
+
+    bench_io_result_t io;
+    if (status == ETDK_SUCCESS && scratch) {
+        if (!json) {
+            printf("\nSequential I/O: %s, %.0f MB in %zu KB requests...\n", scratch, scratch_size / (1024.0 * 1024.0),
+                   chunk_size / 1024);
+            fflush(stdout);
+        }
+        status = bench_io(scratch, scratch_size, chunk_size, direct, &io);
+        if (status == ETDK_SUCCESS && json) {
+            printf(",\"io\":{\"bytes\":%llu,\"chunk\":%zu,\"direct\":%s,\"write_bytes_per_second\":%.0f,"
+                   "\"read_bytes_per_second\":%.0f}",
+                   (unsigned long long)io.bytes, io.chunk_size, io.direct ? "true" : "false",
+                   io.write_seconds > 0 ? io.bytes / io.write_seconds : 0.0,
+                   io.read_seconds > 0 ? io.bytes / io.read_seconds : 0.0);
+        } else if (status == ETDK_SUCCESS) {
+            printf("%-5s %10.1f MB/s (%s, including fsync)\n", "write",
+                   io.bytes / (1024.0 * 1024.0) / io.write_seconds, io.direct ? "direct I/O" : "buffered");
+            printf("%-5s %10.1f MB/s (%s)\n", "read", io.bytes / (1024.0 * 1024.0) / io.read_seconds,
+                   io.direct ? "direct I/O" : "cold page cache");
+        }
+    }
+    if (json)
+        printf("}\n");
+
+    if (status != ETDK_SUCCESS) {
+        fprintf(stderr, "Benchmark failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -5,45 +5,366 @@
 
 #include "etdk.h"
 // cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h> // for sleep()
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h> // for sleep(), close(), fsync()
 // cppcheck-suppress-end missingIncludeSystem
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/** @brief AES-256-CBC, -XTS and -CTR fetched once, indexed by ETDK_MODE_* */
+static EVP_CIPHER *fetched_ciphers[3];
+static pthread_once_t fetch_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Release the fetched ciphers at exit (runs before OpenSSL's own cleanup)
+ */
+static void free_ciphers(void) {
+    for (size_t i = 0; i < sizeof(fetched_ciphers) / sizeof(fetched_ciphers[0]); i++) {
+        EVP_CIPHER_free(fetched_ciphers[i]);
+        fetched_ciphers[i] = NULL;
+    }
+}
+
+/**
+ * @brief Fetch the cipher implementations from the default provider
+ */
+static void fetch_ciphers(void) {
+    static const char *const names[] = {"AES-256-CBC", "AES-256-XTS", "AES-256-CTR"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        fetched_ciphers[i] = EVP_CIPHER_fetch(NULL, names[i], NULL);
+    }
+    atexit(free_ciphers);
+}
+#endif
+
+/**
+ * @brief Cipher implementation for a mode
+ *
+ * With OpenSSL 3 every EVP_CipherInit_ex() with EVP_aes_256_*() performs
+ * an implicit provider fetch (a locked name lookup). The ciphers are
+ * fetched once instead and shared read-only by all threads. Older
+ * versions, or a failed fetch, use the static EVP_aes_256_*() tables.
+ *
+ * @param mode ETDK_MODE_* value
+ * @return Cipher for EVP_CipherInit_ex()
+ */
+static const EVP_CIPHER *mode_cipher(int mode) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    pthread_once(&fetch_once, fetch_ciphers);
+    if (mode >= 0 && mode < 3 && fetched_ciphers[mode]) {
+        return fetched_ciphers[mode];
+    }
+#endif
+    if (mode == ETDK_MODE_XTS) {
+        return EVP_aes_256_xts();
+    }
+    return mode == ETDK_MODE_CTR ? EVP_aes_256_ctr() : EVP_aes_256_cbc();
+}
+
+/**
+ * @brief Load key and IV of ctx into an existing EVP cipher context
+ *
+ * - CBC: AES-256-CBC with key and IV
+ * - XTS: AES-256-XTS with key || tweak_key; the tweak is set per data unit
+ * - CTR: AES-256-CTR with key and IV as initial counter block
+ * A context that already holds the same cipher is only re-keyed: the
+ * provider context and its method tables are kept, which is most of
+ * the setup cost for a small file. Decryption never strips padding: the
+ * copy format's PKCS#7 block is removed by crypto_decrypt_target()
+ * itself, raw sectors have none.
+ *
+ * @param cipher_ctx Fresh or previously used EVP cipher context
+ * @param ctx Pointer to crypto_context_t containing key and IV
+ * @param enc 1 to encrypt, 0 to decrypt
+ * @return ETDK_SUCCESS or ETDK_ERROR_CRYPTO
+ */
+static int key_cipher_context(EVP_CIPHER_CTX *cipher_ctx, const crypto_context_t *ctx, int enc) {
+    const EVP_CIPHER *cipher = mode_cipher(ctx->mode);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    const EVP_CIPHER *current = EVP_CIPHER_CTX_get0_cipher(cipher_ctx);
+#else
+    const EVP_CIPHER *current = EVP_CIPHER_CTX_cipher(cipher_ctx);
+#endif
+    if (current == cipher) {
+        cipher = NULL;
+    }
+
+    int ok;
+    if (ctx->mode == ETDK_MODE_XTS) {
+        // OpenSSL expects both XTS keys as one 512-bit key
+        uint8_t xts_key[2 * AES_KEY_SIZE];
+        memcpy(xts_key, ctx->key, AES_KEY_SIZE);
+        memcpy(xts_key + AES_KEY_SIZE, ctx->tweak_key, AES_KEY_SIZE);
+        ok = EVP_CipherInit_ex(cipher_ctx, cipher, NULL, xts_key, NULL, enc);
+        OPENSSL_cleanse(xts_key, sizeof(xts_key));
+    } else {
+        ok = EVP_CipherInit_ex(cipher_ctx, cipher, NULL, ctx->key, ctx->iv, enc);
+    }
+    if (ok == 1) {
+        ok = EVP_CIPHER_CTX_set_padding(cipher_ctx, enc ? 1 : 0);
+    }
+
+    if (ok != 1) {
+        fprintf(stderr, "Error initializing encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return ETDK_ERROR_CRYPTO;
+    }
+    return ETDK_SUCCESS;
+}
+
 /**
- * @brief Helper function to initialize EVP cipher context for encryption
+ * @brief Create an EVP cipher context for encryption or decryption
  *
- * Creates and initializes an EVP cipher context with AES-256-CBC.
- * This reduces code duplication between file and device encryption.
+ * Used where a thread needs a context of its own for one run (cipher
+ * workers, benchmark threads).
  *
  * @param ctx Pointer to crypto_context_t containing key and IV
+ * @param enc 1 to encrypt, 0 to decrypt
  * @return Pointer to initialized EVP_CIPHER_CTX, or NULL on failure
  */
-static EVP_CIPHER_CTX *init_cipher_context(const crypto_context_t *ctx) {
+static EVP_CIPHER_CTX *init_cipher_context(const crypto_context_t *ctx, int enc) {
     EVP_CIPHER_CTX *cipher_ctx = EVP_CIPHER_CTX_new();
     if (!cipher_ctx) {
         fprintf(stderr, "Error creating cipher context\n");
         return NULL;
     }
-
-    if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, ctx->key, ctx->iv) != 1) {
-        fprintf(stderr, "Error initializing encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+    if (key_cipher_context(cipher_ctx, ctx, enc) != ETDK_SUCCESS) {
         EVP_CIPHER_CTX_free(cipher_ctx);
         return NULL;
     }
-
     return cipher_ctx;
 }
 
+/**
+ * @brief The cipher context owned by ctx, keyed for a new target
+ *
+ * Created on first use and re-keyed for every later file or device, so a
+ * batch of small files pays for EVP_CIPHER_CTX_new() and the cipher
+ * lookup once per thread (each tree worker has its own crypto_context_t).
+ * Freed by crypto_secure_wipe_key(); callers must not free it.
+ *
+ * @param ctx Crypto context (ctx->cipher_ctx is created or reused)
+ * @param enc 1 to encrypt, 0 to decrypt
+ * @return Keyed EVP_CIPHER_CTX, or NULL on failure
+ */
+static EVP_CIPHER_CTX *target_cipher_context(crypto_context_t *ctx, int enc) {
+    if (!ctx->cipher_ctx) {
+        ctx->cipher_ctx = init_cipher_context(ctx, enc);
+        return ctx->cipher_ctx;
+    }
+    if (key_cipher_context(ctx->cipher_ctx, ctx, enc) != ETDK_SUCCESS) {
+        return NULL;
+    }
+    return ctx->cipher_ctx;
+}
+
+/**
+ * @brief Encrypt a buffer as consecutive XTS data units
+ *
+ * Each data unit is encrypted independently with its unit number
+ * (absolute offset / data_unit, little-endian) as tweak, exactly like
+ * dm-crypt's plain64 IV. Units can therefore be processed in any order
+ * or in parallel. A final unit that is not a multiple of 16 bytes is
+ * handled by XTS ciphertext stealing; a remainder shorter than one AES
+ * block is merged into the preceding unit so no byte is left untouched.
+ * Decrypts instead if cipher_ctx was initialized for decryption.
+ *
+ * @param cipher_ctx Context initialized with EVP_aes_256_xts()
+ * @param buf Data to encrypt in place
+ * @param len Length of buf (at least AES_BLOCK_SIZE)
+ * @param offset Absolute offset of buf (multiple of data_unit)
+ * @param data_unit Data unit size in bytes (sector size)
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
+ */
+static int xts_encrypt_units(EVP_CIPHER_CTX *cipher_ctx, unsigned char *buf, size_t len, uint64_t offset,
+                             uint32_t data_unit) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t n = len - pos < data_unit ? len - pos : data_unit;
+        if (len - pos - n < AES_BLOCK_SIZE) {
+            n = len - pos; // Absorb a sub-block remainder (ciphertext stealing)
+        }
+        if (n < AES_BLOCK_SIZE) {
+            fprintf(stderr, "\nXTS data unit shorter than one AES block\n");
+            return ETDK_ERROR_CRYPTO;
+        }
+
+        uint64_t unit = (offset + pos) / data_unit;
+        unsigned char tweak[AES_BLOCK_SIZE] = {0};
+        for (int i = 0; i < 8; i++) {
+            tweak[i] = (unsigned char)(unit >> (8 * i));
+        }
+
+        int outlen = 0;
+        if (EVP_CipherInit_ex(cipher_ctx, NULL, NULL, NULL, tweak, -1) != 1 ||
+            EVP_CipherUpdate(cipher_ctx, buf + pos, &outlen, buf + pos, (int)n) != 1 || (size_t)outlen != n) {
+            fprintf(stderr, "\nError during encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+            return ETDK_ERROR_CRYPTO;
+        }
+
+        pos += n;
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Encrypt a buffer with AES-256-CTR at an absolute offset
+ *
+ * The counter block for byte offset N is the IV plus N / 16 (128-bit
+ * big-endian addition), which is exactly where a single CTR stream
+ * started at offset 0 would be. Chunks can therefore be encrypted in any
+ * order and the result still decrypts with
+ * "openssl enc -d -aes-256-ctr -K <key> -iv <iv>".
+ *
+ * @param cipher_ctx Context initialized with EVP_aes_256_ctr()
+ * @param iv Initial counter block (AES_BLOCK_SIZE bytes)
+ * @param buf Data to encrypt in place
+ * @param len Length of buf
+ * @param offset Absolute offset of buf (multiple of AES_BLOCK_SIZE)
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
+ */
+static int ctr_encrypt_at(EVP_CIPHER_CTX *cipher_ctx, const uint8_t *iv, unsigned char *buf, size_t len,
+                          uint64_t offset) {
+    if (offset % AES_BLOCK_SIZE != 0) {
+        fprintf(stderr, "\nCTR chunk offset not aligned to the AES block size\n");
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    unsigned char counter[AES_BLOCK_SIZE];
+    memcpy(counter, iv, AES_BLOCK_SIZE);
+
+    uint64_t add = offset / AES_BLOCK_SIZE;
+    for (int i = AES_BLOCK_SIZE - 1; i >= 0 && add > 0; i--) {
+        add += counter[i];
+        counter[i] = (unsigned char)add;
+        add >>= 8;
+    }
+
+    int outlen = 0;
+    if (EVP_CipherInit_ex(cipher_ctx, NULL, NULL, NULL, counter, -1) != 1 ||
+        EVP_CipherUpdate(cipher_ctx, buf, &outlen, buf, (int)len) != 1 || (size_t)outlen != len) {
+        fprintf(stderr, "\nError during encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Human readable name of a cipher mode
+ * @param mode ETDK_MODE_* value
+ * @return Static string naming the mode
+ */
+const char *crypto_mode_name(int mode) {
+    switch (mode) {
+    case ETDK_MODE_XTS:
+        return "AES-256-XTS";
+    case ETDK_MODE_CTR:
+        return "AES-256-CTR";
+    case ETDK_MODE_CBC:
+    default:
+        return "AES-256-CBC";
+    }
+}
+
+/**
+ * @brief Fill options with default values
+ *
+ * Defaults: chunk size and queue depth derived from the device topology
+ * (4 MB chunks for files), through the page cache.
+ *
+ * @param opts Pointer to etdk_options_t to initialize
+ */
+void etdk_options_init(etdk_options_t *opts) {
+    if (!opts)
+        return;
+
+    memset(opts, 0, sizeof(*opts));
+    opts->chunk_size = 0;
+    opts->direct_io = 0;
+    opts->io_engine = ETDK_ENGINE_SYNC;
+    opts->queue_depth = 0;
+    opts->threads = 0;
+    opts->progress_fd = -1;
+}
+
+/**
+ * @brief Parse a byte size with optional K/M/G suffix (powers of 1024)
+ * @param text String to parse (e.g. "4M")
+ * @param size Pointer where the size in bytes will be stored
+ * @return 0 on success, -1 on invalid input (also signed or larger than SIZE_MAX)
+ */
+int etdk_parse_size(const char *text, size_t *size) {
+    // strtoull() accepts a sign and negates the value: "-1K" must not wrap to a huge size
+    const char *digits = text;
+    while (*digits == ' ' || (*digits >= '\t' && *digits <= '\r')) {
+        digits++;
+    }
+    if (*digits == '-') {
+        return -1;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(digits, &end, 10);
+
+    if (end == digits || value == 0 || errno == ERANGE || value > SIZE_MAX) {
+        return -1;
+    }
+
+    int shifts = 0;
+    switch (*end) {
+    case 'G':
+    case 'g':
+        shifts++;
+        // fall through
+    case 'M':
+    case 'm':
+        shifts++;
+        // fall through
+    case 'K':
+    case 'k':
+        shifts++;
+        end++;
+        break;
+    default:
+        break;
+    }
+
+    // Check before every step, so an oversized value is rejected rather than wrapped
+    for (; shifts > 0; shifts--) {
+        if (value > SIZE_MAX / 1024) {
+            return -1;
+        }
+        value *= 1024;
+    }
+
+    if (*end != '\0') {
+        return -1;
+    }
+
+    *size = (size_t)value;
+    return 0;
+}
+
 /**
  * @brief Initialize cryptographic context with random key and IV
  *
- * Generates a cryptographically secure 256-bit key and 128-bit IV
- * using OpenSSL's RAND_bytes() function.
+ * Generates a cryptographically secure 256-bit key, 256-bit XTS tweak
+ * key and 128-bit IV using OpenSSL's RAND_bytes() function. The mode
+ * defaults to CBC; callers may switch ctx->mode before encrypting.
  *
  * @param ctx Pointer to crypto_context_t structure to initialize
  * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
@@ -59,12 +380,19 @@ int crypto_init(crypto_context_t *ctx) {
         return ETDK_ERROR_CRYPTO;
     }
 
+    // Generate random XTS tweak key (unused in CBC mode)
+    if (crypto_generate_key(ctx->tweak_key, AES_KEY_SIZE) != ETDK_SUCCESS) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
     // Generate random IV
     if (RAND_bytes(ctx->iv, AES_BLOCK_SIZE) != 1) {
         fprintf(stderr, "Error generating IV: %s\n", ERR_error_string(ERR_get_error(), NULL));
         return ETDK_ERROR_CRYPTO;
     }
 
+    ctx->mode = ETDK_MODE_CBC;
+
     return ETDK_SUCCESS;
 }
 
@@ -93,305 +421,1644 @@ int crypto_generate_key(uint8_t *key, size_t key_size) {
 }
 
 /**
- * @brief Encrypt a file using AES-256-CBC
- *
- * Reads the input file in 4KB chunks, encrypts each chunk using
- * AES-256-CBC mode, and writes the encrypted data to the output file.
- *
- * @param input_path Path to the input file to encrypt
- * @param output_path Path where encrypted file will be written
- * @param ctx Pointer to initialized crypto_context_t with key and IV
- * @return ETDK_SUCCESS on success, error code on failure
+ * @struct cbc_link_t
+ * @brief Last ciphertext block of one chunk, published for the next chunk
  */
-int crypto_encrypt_file(const char *input_path, const char *output_path, crypto_context_t *ctx) {
-    if (!input_path || !output_path || !ctx) {
-        return ETDK_ERROR_CRYPTO;
-    }
+typedef struct {
+    atomic_uint_least64_t seq;           /**< Chunk index + 1 whose block is stored, 0 = none */
+    unsigned char block[AES_BLOCK_SIZE]; /**< Last ciphertext block of that chunk */
+} cbc_link_t;
 
-    FILE *input = fopen(input_path, "rb");
-    if (!input) {
-        perror("Cannot open input file");
-        return ETDK_ERROR_IO;
-    }
+/**
+ * @struct cbc_chain_t
+ * @brief Chaining values for CBC decryption by several cipher workers
+ *
+ * CBC decryption of a block needs only the previous ciphertext block, so
+ * chunks can be decrypted in any order once the last ciphertext block of
+ * the preceding chunk is known. Each worker publishes its chunk's last
+ * block before decrypting it in place and takes the preceding chunk's
+ * from the ring. The ring has more slots than chunks can be in flight,
+ * so a slot is never reused while a later chunk may still need it.
+ */
+typedef struct {
+    cbc_link_t *links;                      /**< Ring of chaining values */
+    size_t count;                           /**< Slots in the ring */
+    uint64_t base;                          /**< Offset of chunk 0 */
+    size_t chunk_size;                      /**< Bytes per chunk */
+    unsigned char first_iv[AES_BLOCK_SIZE]; /**< Chaining value before chunk 0 (the IV at offset 0) */
+} cbc_chain_t;
 
-    FILE *output = fopen(output_path, "wb");
-    if (!output) {
-        perror("Cannot open output file");
-        fclose(input);
-        return ETDK_ERROR_IO;
-    }
+/**
+ * @brief Publish a chunk's chaining value and set the IV for decrypting it
+ *
+ * @param chain Shared chain ring
+ * @param cipher_ctx The worker's CBC decryption context
+ * @param buf Chunk ciphertext (not yet decrypted)
+ * @param len Chunk length, a multiple of AES_BLOCK_SIZE
+ * @param offset Absolute offset of the chunk
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
+ */
+static int cbc_chain_link(cbc_chain_t *chain, EVP_CIPHER_CTX *cipher_ctx, const unsigned char *buf, size_t len,
+                          uint64_t offset) {
+    uint64_t index = (offset - chain->base) / chain->chunk_size;
+    cbc_link_t *own = &chain->links[index % chain->count];
 
-    EVP_CIPHER_CTX *cipher_ctx = init_cipher_context(ctx);
-    if (!cipher_ctx) {
-        fclose(input);
-        fclose(output);
-        return ETDK_ERROR_CRYPTO;
-    }
+    memcpy(own->block, buf + len - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    atomic_store_explicit(&own->seq, index + 1, memory_order_release);
 
-    /* Encrypt file in 4KB chunks
-     * Processing in chunks allows encryption of files larger than available RAM.
-     * Each chunk is encrypted and immediately written to reduce memory usage.
+    /* The preceding chunk was dequeued first and publishes before waiting
+     * itself: this wait is short. The parallel engine transforms every chunk
+     * it has read, also after an error, so the block always arrives.
      */
-    unsigned char inbuf[4096];
-    unsigned char outbuf[4096 + EVP_MAX_BLOCK_LENGTH];
-    int inlen, outlen;
-
-    while ((inlen = fread(inbuf, 1, sizeof(inbuf), input)) > 0) {
-        if (EVP_EncryptUpdate(cipher_ctx, outbuf, &outlen, inbuf, inlen) != 1) {
-            fprintf(stderr, "Error during encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
-            EVP_CIPHER_CTX_free(cipher_ctx);
-            fclose(input);
-            fclose(output);
-            return ETDK_ERROR_CRYPTO;
+    const unsigned char *iv = chain->first_iv;
+    if (index > 0) {
+        cbc_link_t *prev = &chain->links[(index - 1) % chain->count];
+        unsigned spins = 0;
+        while (atomic_load_explicit(&prev->seq, memory_order_acquire) != index) {
+            if (++spins < 64) {
+                sched_yield();
+            } else {
+                struct timespec ts = {0, 50000}; // 50 us
+                nanosleep(&ts, NULL);
+            }
         }
-        fwrite(outbuf, 1, outlen, output);
+        iv = prev->block;
     }
 
-    /* Finalize encryption
-     * In CBC mode, this adds PKCS#7 padding to ensure the last block
-     * is complete. The padding is necessary for proper decryption.
-     */
-    if (EVP_EncryptFinal_ex(cipher_ctx, outbuf, &outlen) != 1) {
-        fprintf(stderr, "Error finalizing encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
-        EVP_CIPHER_CTX_free(cipher_ctx);
-        fclose(input);
-        fclose(output);
+    if (EVP_CipherInit_ex(cipher_ctx, NULL, NULL, NULL, iv, -1) != 1) {
+        fprintf(stderr, "\nError setting CBC chaining value: %s\n", ERR_error_string(ERR_get_error(), NULL));
         return ETDK_ERROR_CRYPTO;
     }
-    fwrite(outbuf, 1, outlen, output);
-
-    EVP_CIPHER_CTX_free(cipher_ctx);
-    fclose(input);
-    fclose(output);
-
     return ETDK_SUCCESS;
 }
 
 /**
- * @brief Display the encryption key and IV in hexadecimal format
+ * @brief State passed to encrypt_chunk() by the device engines
  *
- * Shows the key to the user ONE TIME ONLY before it is securely deleted.
- * This allows for potential data recovery if needed. Once the key is wiped,
- * the encrypted data becomes permanently irrecoverable.
+ * The parallel engine gets one device_job_t per worker, each with its own
+ * cipher context.
+ */
+typedef struct {
+    EVP_CIPHER_CTX *cipher_ctx; /**< Cipher context (carries the CBC chain) */
+    int mode;                   /**< ETDK_MODE_* */
+    uint32_t data_unit;         /**< XTS data unit size in bytes */
+    const uint8_t *iv;          /**< Initial CTR counter block */
+    etdk_progress_t *progress;  /**< Progress of the target, NULL for none (single-threaded engines) */
+    io_writeback_t *writeback;  /**< Write-behind for buffered I/O, NULL for none (single-threaded engines) */
+    io_limiter_t *limiter;      /**< Rate limiter, NULL for none (single-threaded engines) */
+    unsigned ops;               /**< I/O requests per chunk charged to the limiter (read + write, or write) */
+    uint64_t reported;          /**< Offset of the last report_progress() call */
+    int decrypt;                /**< Non-zero if cipher_ctx decrypts (etdk decrypt) */
+    cbc_chain_t *chain;         /**< CBC decryption by several workers, NULL for in-order chaining */
+} device_job_t;
+
+/**
+ * @brief Encrypt one device chunk in place (io_transform_fn)
  *
- * @param ctx Pointer to crypto_context_t containing the key and IV
+ * Called by the I/O engines in ascending offset order, so the CBC chain in
+ * the cipher context stays identical to the synchronous loop. Chunks are
+ * multiples of the AES block size, so the output length equals the input.
+ * In XTS and CTR mode every chunk is independent of all others. Decrypts
+ * instead when job->decrypt is set; CBC workers with a job->chain take
+ * their chaining value from the ring instead of the context.
+ *
+ * @param arg Pointer to device_job_t
+ * @param buf Chunk data, encrypted in place
+ * @param len Chunk length in bytes
+ * @param offset Absolute offset of the chunk
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
  */
-void crypto_display_key(const crypto_context_t *ctx) {
-    if (!ctx)
-        return;
+static int encrypt_chunk(void *arg, unsigned char *buf, size_t len, uint64_t offset) {
+    device_job_t *job = arg;
+    int outlen = 0;
 
-    printf("---\n");
-    printf("ENCRYPTION KEY - SAVE NOW OR LOSE FOREVER\n");
-    printf("\n");
-    printf("Key: ");
-    for (int i = 0; i < AES_KEY_SIZE; i++) {
-        printf("%02x", ctx->key[i]);
+    // Everything before this chunk has been written back by the in-order engines
+    if (job->writeback)
+        io_writeback_advance(job->writeback, offset);
+    io_limiter_wait(job->limiter, len, job->ops);
+
+    if (job->mode == ETDK_MODE_XTS || job->mode == ETDK_MODE_CTR) {
+        int result = job->mode == ETDK_MODE_XTS ? xts_encrypt_units(job->cipher_ctx, buf, len, offset, job->data_unit)
+                                                : ctr_encrypt_at(job->cipher_ctx, job->iv, buf, len, offset);
+        if (result == ETDK_SUCCESS)
+            progress_update(job->progress, offset + len);
+        return result;
     }
-    printf("\n");
-    printf("IV:  ");
-    for (int i = 0; i < AES_BLOCK_SIZE; i++) {
-        printf("%02x", ctx->iv[i]);
+
+    if (job->chain && cbc_chain_link(job->chain, job->cipher_ctx, buf, len, offset) != ETDK_SUCCESS)
+        return ETDK_ERROR_CRYPTO;
+    if (EVP_CipherUpdate(job->cipher_ctx, buf, &outlen, buf, (int)len) != 1 || (size_t)outlen != len) {
+        fprintf(stderr, "\nError during %s: %s\n", job->decrypt ? "decryption" : "encryption",
+                ERR_error_string(ERR_get_error(), NULL));
+        return ETDK_ERROR_CRYPTO;
     }
-    printf("\n");
-    printf("\n");
-    printf("Key is stored in RAM only and will be wiped immediately.\n");
-    printf("Write it down now if you need to decrypt later. (both hex values below)\n");
-    printf("---\n");
 
-    sleep(3);
+    progress_update(job->progress, offset + len);
+    return ETDK_SUCCESS;
 }
 
 /**
- * @brief Securely wipe encryption key using 5-pass overwrite method
- *
- * Implements a multi-pass overwrite strategy to prevent key recovery:
- * Pass 1: Write all zeros (0x00)
- * Pass 2: Write all ones (0xFF)
- * Pass 3: Write cryptographically secure random data
- * Pass 4: Write all zeros again (clean state)
- * Pass 5: Volatile pointer overwrite (prevents compiler optimization)
- *
- * Why 5 passes are sufficient:
- * - RAM has no magnetic remanence (unlike HDDs)
- * - Random data pass makes pattern analysis impossible
- * - Volatile pointers prevent compiler from optimizing away writes
- * - Modern SSDs/RAM don't need 35-pass Gutmann (designed for magnetic media)
- * - BSI recommends multi-pass with random data for RAM/SSD
+ * @brief Fill a chunk with CTR keystream for its offset (io_transform_fn)
  *
- * This follows BSI recommendations for secure key destruction in volatile memory.
+ * Encrypting zeros in CTR mode yields the raw keystream. Used by the
+ * write-only overwrite, where the previous contents are never read.
  *
- * @param ctx Pointer to crypto_context_t containing key to wipe
+ * @param arg Pointer to device_job_t (mode CTR)
+ * @param buf Buffer to fill
+ * @param len Chunk length in bytes
+ * @param offset Absolute offset of the chunk
  * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
  */
-int crypto_secure_wipe_key(crypto_context_t *ctx) {
-    if (!ctx)
-        return ETDK_ERROR_CRYPTO;
-
-    /* Pass 1: Overwrite with zeros
-     * Clears any existing data with a known pattern
-     */
-    memset(ctx->key, 0x00, AES_KEY_SIZE);
-    memset(ctx->iv, 0x00, AES_BLOCK_SIZE);
-
-    /* Pass 2: Overwrite with ones
-     * Flips all bits from previous pass
-     */
-    memset(ctx->key, 0xFF, AES_KEY_SIZE);
-    memset(ctx->iv, 0xFF, AES_BLOCK_SIZE);
-
-    /* Pass 3: Overwrite with random data
-     * Introduces unpredictability, making pattern analysis impossible
-     */
-    RAND_bytes(ctx->key, AES_KEY_SIZE);
-    RAND_bytes(ctx->iv, AES_BLOCK_SIZE);
-
-    /* Pass 4: Final overwrite with zeros
-     * Leaves memory in a known, clean state
-     */
-    memset(ctx->key, 0x00, AES_KEY_SIZE);
-    memset(ctx->iv, 0x00, AES_BLOCK_SIZE);
+static int keystream_chunk(void *arg, unsigned char *buf, size_t len, uint64_t offset) {
+    device_job_t *job = arg;
 
-    /* Pass 5: Volatile overwrite to prevent compiler optimization
-     * Compilers may optimize away memset() calls if they determine the
-     * memory won't be read again. Using volatile pointers forces the
-     * compiler to perform the write operation.
-     */
-    volatile uint8_t *vkey = (volatile uint8_t *)ctx->key;
-    volatile uint8_t *viv = (volatile uint8_t *)ctx->iv;
-    for (size_t i = 0; i < AES_KEY_SIZE; i++) {
-        vkey[i] = 0;
-    }
-    for (size_t i = 0; i < AES_BLOCK_SIZE; i++) {
-        viv[i] = 0;
-    }
+    if (job->writeback)
+        io_writeback_advance(job->writeback, offset);
+    io_limiter_wait(job->limiter, len, job->ops);
 
-    return ETDK_SUCCESS;
+    memset(buf, 0, len);
+    int result = ctr_encrypt_at(job->cipher_ctx, job->iv, buf, len, offset);
+    if (result == ETDK_SUCCESS)
+        progress_update(job->progress, offset + len);
+    return result;
 }
 
 /**
- * @brief Cleanup crypto context and securely wipe all sensitive data
+ * @brief Progress callback for the parallel engine's writer (io_progress_fn)
  *
- * Calls crypto_secure_wipe_key() to perform secure key deletion,
- * then zeros out the entire context structure.
+ * Runs on the writer thread only, so it also drives write-behind and the
+ * rate limiter for the multi-threaded engines: while the writer sleeps the
+ * rings fill up and the reader stalls, so reads are throttled as well.
  *
- * @param ctx Pointer to crypto_context_t to cleanup
+ * @param arg Pointer to the main device_job_t (progress, write-behind, limiter)
+ * @param processed Absolute offset written back so far
  */
-void crypto_cleanup(crypto_context_t *ctx) {
-    if (ctx) {
-        crypto_secure_wipe_key(ctx);
-        memset(ctx, 0, sizeof(crypto_context_t));
+static void report_progress(void *arg, uint64_t processed) {
+    device_job_t *job = arg;
+
+    if (processed > job->reported) {
+        io_limiter_wait(job->limiter, processed - job->reported, job->ops);
     }
+    job->reported = processed;
+    if (job->writeback)
+        io_writeback_advance(job->writeback, processed);
+    progress_update(job->progress, processed);
 }
 
 /**
- * @brief Encrypt a block device using AES-256-CBC
+ * @brief Encrypt a device range with the cipher worker pool
  *
- * Reads the device in 1MB chunks, encrypts each chunk using
- * AES-256-CBC mode, and writes the encrypted data back to the device.
- * Shows progress indicator during operation.
+ * Every worker gets its own EVP_CIPHER_CTX (XTS keys only, tweaks are set
+ * per data unit), so no cipher state is shared between threads.
  *
- * WARNING: This DESTROYS all data on the device permanently!
+ * @param device Descriptor opened for read/write
+ * @param start Byte offset to start at
+ * @param end Byte offset to stop at
+ * @param ctx Crypto context with key material
+ * @param pool Buffer pool (at least 2 * threads + 2 buffers)
+ * @param chunk_size Bytes per chunk
+ * @param threads Number of cipher workers
+ * @param main_job Progress, write-behind and limiter, used by the writer; direction
+ * @param chain CBC decryption chain ring, NULL for XTS and CTR
+ * @param stats Receives per-stage busy/idle times
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+static int encrypt_device_parallel(int device, uint64_t start, uint64_t end, const crypto_context_t *ctx,
+                                   const io_buffer_pool_t *pool, size_t chunk_size, unsigned threads,
+                                   device_job_t *main_job, cbc_chain_t *chain, io_pipeline_stats_t *stats) {
+    device_job_t *jobs = calloc(threads, sizeof(device_job_t));
+    void **args = calloc(threads, sizeof(void *));
+    int result = ETDK_SUCCESS;
+
+    if (!jobs || !args) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(jobs);
+        free(args);
+        return ETDK_ERROR_MEMORY;
+    }
+
+    unsigned created = 0;
+    for (; created < threads; created++) {
+        jobs[created].cipher_ctx = init_cipher_context(ctx, !main_job->decrypt);
+        if (!jobs[created].cipher_ctx) {
+            result = ETDK_ERROR_CRYPTO;
+            break;
+        }
+        jobs[created].mode = ctx->mode;
+        jobs[created].data_unit = ctx->data_unit;
+        jobs[created].iv = ctx->iv;
+        jobs[created].progress = NULL;
+        jobs[created].decrypt = main_job->decrypt;
+        jobs[created].chain = chain;
+        jobs[created].writeback = NULL;
+        jobs[created].limiter = NULL;
+        args[created] = &jobs[created];
+    }
+
+    if (result == ETDK_SUCCESS) {
+        result = io_parallel_engine_run(device, start, end, pool, chunk_size, threads, encrypt_chunk, args,
+                                        report_progress, main_job, stats);
+    }
+
+    for (unsigned i = 0; i < created; i++) {
+        EVP_CIPHER_CTX_free(jobs[i].cipher_ctx);
+    }
+    free(jobs);
+    free(args);
+
+    return result;
+}
+
+/**
+ * @brief Print the per-stage busy/idle times of a pipeline run
+ * @param stats Timing collected by io_parallel_engine_run()
+ * @param threads Number of cipher workers (their times are summed)
+ */
+static void print_pipeline_stats(const io_pipeline_stats_t *stats, unsigned threads) {
+    printf("Pipeline (busy / idle):\n");
+    printf("  read:    %8.3f s / %8.3f s\n", stats->read_busy, stats->read_idle);
+    printf("  encrypt: %8.3f s / %8.3f s%s\n", stats->cipher_busy, stats->cipher_idle,
+           threads > 1 ? " (sum over workers)" : "");
+    printf("  write:   %8.3f s / %8.3f s\n", stats->write_busy, stats->write_idle);
+    printf("\n");
+}
+
+/**
+ * @brief Add the stage times of one pipeline run to a running total
+ * @param sum Accumulated times
+ * @param run Times of the latest run
+ */
+static void add_pipeline_stats(io_pipeline_stats_t *sum, const io_pipeline_stats_t *run) {
+    sum->read_busy += run->read_busy;
+    sum->read_idle += run->read_idle;
+    sum->cipher_busy += run->cipher_busy;
+    sum->cipher_idle += run->cipher_idle;
+    sum->write_busy += run->write_busy;
+    sum->write_idle += run->write_idle;
+}
+
+/**
+ * @brief Open the checkpoint journal for an in-place run
  *
- * @param device_path Path to the block device (e.g., /dev/sdb)
+ * A new run starts an empty journal; with opts->resume the journal must
+ * exist and belong to the same target and size. Either way a range for
+ * this run is appended and committed before any data is written, so the
+ * journal exists as soon as the target starts to change.
+ *
+ * @param target_path Device or file being encrypted
+ * @param size Target size in bytes
+ * @param mode ETDK_MODE_* of this run
+ * @param align Alignment the start offset must have for this run's I/O
+ * @param opts I/O options (journal_path, resume)
+ * @param start Pointer where the offset to continue from will be stored
+ * @return Journal to pass to checkpoint(), NULL on error (message printed)
+ */
+static etdk_journal_t *journal_start(const char *target_path, uint64_t size, int mode, size_t align,
+                                     const etdk_options_t *opts, uint64_t *start) {
+    etdk_journal_t *journal = malloc(sizeof(etdk_journal_t));
+    char *canonical = realpath(target_path, NULL);
+    if (!journal || !canonical) {
+        fprintf(stderr, "Cannot prepare journal for %s\n", target_path);
+        free(journal);
+        free(canonical);
+        return NULL;
+    }
+
+    int result;
+    if (opts->resume) {
+        result = journal_load(opts->journal_path, journal);
+        if (result != ETDK_SUCCESS) {
+            fprintf(stderr, "Cannot read journal %s (missing or damaged)\n", opts->journal_path);
+        } else if (strcmp(journal->target, canonical) != 0 || journal->size != size) {
+            fprintf(stderr, "Journal %s belongs to %s (%llu bytes), not to %s\n", opts->journal_path, journal->target,
+                    (unsigned long long)journal->size, canonical);
+            result = ETDK_ERROR_IO;
+        } else if (journal_done(journal) % align != 0) {
+            fprintf(stderr, "Journal offset %llu is not aligned to %zu bytes; resume with the original options\n",
+                    (unsigned long long)journal_done(journal), align);
+            result = ETDK_ERROR_IO;
+        }
+    } else {
+        result = journal_init(journal, canonical, size);
+    }
+    free(canonical);
+
+    if (result == ETDK_SUCCESS) {
+        *start = journal_done(journal);
+        if (journal_begin_range(journal, mode) != ETDK_SUCCESS) {
+            fprintf(stderr, "Journal %s is full (%d runs)\n", opts->journal_path, ETDK_JOURNAL_MAX_RANGES);
+            result = ETDK_ERROR_IO;
+        } else if (journal_commit(opts->journal_path, journal) != ETDK_SUCCESS) {
+            fprintf(stderr, "Cannot write journal %s: %s\n", opts->journal_path, strerror(errno));
+            result = ETDK_ERROR_IO;
+        }
+    }
+
+    if (result != ETDK_SUCCESS) {
+        free(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+/**
+ * @brief Record that everything up to an offset has reached the target
+ *
+ * The target is flushed first, so the journal never claims more than is
+ * durable.
+ *
+ * @param device Descriptor of the target
+ * @param journal Journal from journal_start()
+ * @param path Journal file
+ * @param end Offset up to which all data has been written
+ * @return ETDK_SUCCESS or ETDK_ERROR_IO
+ */
+static int checkpoint(int device, etdk_journal_t *journal, const char *path, uint64_t end) {
+    if (fsync(device) != 0) {
+        fprintf(stderr, "\nError flushing before checkpoint: %s\n", strerror(errno));
+        return ETDK_ERROR_IO;
+    }
+    journal->ranges[journal->count - 1].end = end;
+    if (journal_commit(path, journal) != ETDK_SUCCESS) {
+        fprintf(stderr, "\nCannot write journal %s: %s\n", path, strerror(errno));
+        return ETDK_ERROR_IO;
+    }
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Encrypt data between two file descriptors with positional I/O
+ *
+ * File engine for the CBC copy format. Each chunk is read with pread() at
+ * an explicit offset, encrypted in place in the same buffer, and written
+ * with pwrite() at an explicit offset. There is no stream buffer and no
+ * seek-back, and one buffer is reused for the whole file.
+ *
+ * Chunks are multiples of the AES block size, so ciphertext offsets match
+ * plaintext offsets until EVP_EncryptFinal_ex() appends the PKCS#7 block.
+ *
+ * @param in_fd Descriptor to read plaintext from
+ * @param out_fd Descriptor to write ciphertext to
+ * @param cipher_ctx Initialized EVP cipher context
+ * @param buf Buffer of at least chunk_size + EVP_MAX_BLOCK_LENGTH bytes
+ * @param chunk_size Number of bytes processed per read/write
+ * @param limiter Rate limiter, NULL for none
+ * @param progress Progress of the input, NULL for none
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+static int encrypt_fd(int in_fd, int out_fd, EVP_CIPHER_CTX *cipher_ctx, unsigned char *buf, size_t chunk_size,
+                      io_limiter_t *limiter, etdk_progress_t *progress) {
+    uint64_t read_offset = 0;
+    uint64_t write_offset = 0;
+    size_t bytes_read;
+    int outlen;
+
+    // Read ahead the plaintext, drop it once read; write the ciphertext behind
+    io_writeback_t writeback;
+    io_advise_sequential(in_fd, 0, 0);
+    io_writeback_init(&writeback, out_fd, 0, chunk_size > ETDK_WRITEBACK_WINDOW ? chunk_size : 0);
+
+    while (1) {
+        if (io_pread_full(in_fd, buf, chunk_size, read_offset, &bytes_read) != ETDK_SUCCESS) {
+            perror("Error reading input");
+            return ETDK_ERROR_IO;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        io_drop_cache(in_fd, read_offset, bytes_read);
+        io_limiter_wait(limiter, bytes_read, 2);
+
+        // In-place update: OpenSSL allows identical input and output buffers
+        if (EVP_EncryptUpdate(cipher_ctx, buf, &outlen, buf, (int)bytes_read) != 1) {
+            fprintf(stderr, "Error during encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+            return ETDK_ERROR_CRYPTO;
+        }
+
+        if (io_pwrite_full(out_fd, buf, (size_t)outlen, write_offset) != ETDK_SUCCESS) {
+            perror("Error writing output");
+            return ETDK_ERROR_IO;
+        }
+
+        read_offset += bytes_read;
+        write_offset += (uint64_t)outlen;
+        io_writeback_advance(&writeback, write_offset);
+        progress_update(progress, read_offset);
+
+        if (bytes_read < chunk_size) {
+            break; // Short read means end of input
+        }
+    }
+
+    /* Finalize encryption
+     * In CBC mode, this adds PKCS#7 padding to ensure the last block
+     * is complete. The padding is necessary for proper decryption.
+     */
+    if (EVP_EncryptFinal_ex(cipher_ctx, buf, &outlen) != 1) {
+        fprintf(stderr, "Error finalizing encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return ETDK_ERROR_CRYPTO;
+    }
+    if (io_pwrite_full(out_fd, buf, (size_t)outlen, write_offset) != ETDK_SUCCESS) {
+        perror("Error writing output");
+        return ETDK_ERROR_IO;
+    }
+    io_writeback_finish(&writeback, write_offset + (uint64_t)outlen);
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Encrypt a file using AES-256-CBC
+ *
+ * Reads the input file in large chunks (opts->chunk_size, 4MB by default),
+ * encrypts each chunk using AES-256-CBC mode, and writes the encrypted
+ * data to the output file. A single heap-allocated, page-aligned buffer
+ * is reused for the whole file, so a 50 GB file costs ~12,800 cipher
+ * calls and read/write pairs instead of ~13 million with 4KB chunks.
+ * All I/O goes through the positional pread/pwrite engine.
+ *
+ * @param input_path Path to the input file to encrypt
+ * @param output_path Path where encrypted file will be written
  * @param ctx Pointer to initialized crypto_context_t with key and IV
+ * @param opts I/O options (chunk_size), or NULL for defaults
  * @return ETDK_SUCCESS on success, error code on failure
  */
-int crypto_encrypt_device(const char *device_path, crypto_context_t *ctx) {
-    if (!device_path || !ctx) {
+int crypto_encrypt_file(const char *input_path, const char *output_path, crypto_context_t *ctx,
+                        const etdk_options_t *opts) {
+    if (!input_path || !output_path || !ctx) {
         return ETDK_ERROR_CRYPTO;
     }
 
-    // Open device for read/write with synchronous I/O
-    FILE *device = fopen(device_path, "r+b");
-    if (!device) {
-        perror("Cannot open device");
+    size_t chunk_size = (opts && opts->chunk_size) ? opts->chunk_size : ETDK_DEFAULT_CHUNK_SIZE;
+    chunk_size = (chunk_size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+
+    int input = open(input_path, O_RDONLY);
+    if (input < 0) {
+        perror("Cannot open input file");
         return ETDK_ERROR_IO;
     }
 
-    // Get device size
-    uint64_t device_size = 0;
-    if (platform_get_device_size(device_path, &device_size) != ETDK_SUCCESS) {
-        fprintf(stderr, "Error getting device size\n");
-        fclose(device);
+    // Small files do not need a full-size chunk buffer
+    struct stat st;
+    uint64_t file_size = 0;
+    if (fstat(input, &st) == 0) {
+        file_size = (uint64_t)st.st_size;
+        if (file_size < chunk_size) {
+            chunk_size = file_size > 0 ? ((size_t)file_size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE
+                                       : AES_BLOCK_SIZE;
+        }
+    }
+
+    int output = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (output < 0) {
+        perror("Cannot open output file");
+        close(input);
         return ETDK_ERROR_IO;
     }
 
-    EVP_CIPHER_CTX *cipher_ctx = init_cipher_context(ctx);
+    EVP_CIPHER_CTX *cipher_ctx = target_cipher_context(ctx, 1);
     if (!cipher_ctx) {
-        fclose(device);
+        close(input);
+        close(output);
         return ETDK_ERROR_CRYPTO;
     }
 
-    // Process device in 1MB chunks for efficiency
-    const size_t CHUNK_SIZE = 1024 * 1024; // 1MB
-    unsigned char *inbuf = malloc(CHUNK_SIZE);
-    unsigned char *outbuf = malloc(CHUNK_SIZE + EVP_MAX_BLOCK_LENGTH);
-
-    if (!inbuf || !outbuf) {
+    /* Encrypt file in large chunks
+     * Processing in chunks allows encryption of files larger than available RAM.
+     * Large chunks amortize the per-call cost of pread/pwrite and EVP_EncryptUpdate.
+     */
+    io_buffer_pool_t pool;
+    int result = io_pool_init(&pool, 1, chunk_size + EVP_MAX_BLOCK_LENGTH, ETDK_BUFFER_ALIGNMENT);
+    if (result != ETDK_SUCCESS) {
         fprintf(stderr, "Memory allocation failed\n");
-        free(inbuf);
-        free(outbuf);
-        EVP_CIPHER_CTX_free(cipher_ctx);
-        fclose(device);
-        return ETDK_ERROR_MEMORY;
+    } else {
+        // JSON records only: the copy format has never drawn a progress line
+        etdk_progress_t progress;
+        progress_init(&progress, input_path, file_size, 0, 0, opts ? opts->progress_fd : -1);
+        result = encrypt_fd(input, output, cipher_ctx, pool.buffers[0], chunk_size, opts ? opts->limiter : NULL,
+                            &progress);
+        progress_finish(&progress, result);
+        io_pool_free(&pool);
     }
 
-    uint64_t processed = 0;
-    int outlen;
-    size_t bytes_read;
+    close(input);
+    if (close(output) != 0 && result == ETDK_SUCCESS) {
+        perror("Error closing output file");
+        result = ETDK_ERROR_IO;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Display the encryption key and IV in hexadecimal format
+ *
+ * Shows the key to the user ONE TIME ONLY before it is securely deleted.
+ * This allows for potential data recovery if needed. Once the key is wiped,
+ * the encrypted data becomes permanently irrecoverable.
+ *
+ * @param ctx Pointer to crypto_context_t containing the key and IV
+ */
+void crypto_display_key(const crypto_context_t *ctx) {
+    if (!ctx)
+        return;
 
+    printf("---\n");
+    printf("ENCRYPTION KEY - SAVE NOW OR LOSE FOREVER\n");
     printf("\n");
-    printf("Encrypting device...\n");
+    printf("Mode: %s\n", crypto_mode_name(ctx->mode));
+    printf("Key: ");
+    for (int i = 0; i < AES_KEY_SIZE; i++) {
+        printf("%02x", ctx->key[i]);
+    }
+    if (ctx->mode == ETDK_MODE_XTS) {
+        // XTS uses a 512-bit key: data key followed by tweak key
+        for (int i = 0; i < AES_KEY_SIZE; i++) {
+            printf("%02x", ctx->tweak_key[i]);
+        }
+        printf("\n");
+        printf("Tweak: little-endian sector number, %u-byte data units\n", (unsigned)ctx->data_unit);
+        // Files of 1 to 15 bytes are too short for XTS and get the CBC copy format
+        printf("IV:  ");
+        for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+            printf("%02x", ctx->iv[i]);
+        }
+        printf("\n");
+        printf("Files under 16 bytes: AES-256-CBC, first 64 key digits and this IV\n");
+    } else {
+        printf("\n");
+        printf("IV:  ");
+        for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+            printf("%02x", ctx->iv[i]);
+        }
+        printf("\n");
+    }
     printf("\n");
+    printf("Key is stored in RAM only and will be wiped immediately.\n");
+    printf("Write it down now if you need to decrypt later. (both hex values below)\n");
+    printf("---\n");
 
-    // Read, encrypt, and write back in chunks
-    while ((bytes_read = fread(inbuf, 1, CHUNK_SIZE, device)) > 0) {
-        // Encrypt chunk
-        if (EVP_EncryptUpdate(cipher_ctx, outbuf, &outlen, inbuf, bytes_read) != 1) {
-            fprintf(stderr, "\nError during encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
-            free(inbuf);
-            free(outbuf);
-            EVP_CIPHER_CTX_free(cipher_ctx);
-            fclose(device);
-            return ETDK_ERROR_CRYPTO;
+    // Pause only for a person reading a terminal, never in scripts and pipelines
+    if (isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)) {
+        fflush(stdout);
+        sleep(3);
+    }
+}
+
+/**
+ * @brief Securely wipe encryption key using 5-pass overwrite method
+ *
+ * Implements a multi-pass overwrite strategy to prevent key recovery:
+ * Pass 1: Write all zeros (0x00)
+ * Pass 2: Write all ones (0xFF)
+ * Pass 3: Write cryptographically secure random data
+ * Pass 4: Write all zeros again (clean state)
+ * Pass 5: Volatile pointer overwrite (prevents compiler optimization)
+ *
+ * Why 5 passes are sufficient:
+ * - RAM has no magnetic remanence (unlike HDDs)
+ * - Random data pass makes pattern analysis impossible
+ * - Volatile pointers prevent compiler from optimizing away writes
+ * - Modern SSDs/RAM don't need 35-pass Gutmann (designed for magnetic media)
+ * - BSI recommends multi-pass with random data for RAM/SSD
+ *
+ * This follows BSI recommendations for secure key destruction in volatile memory.
+ *
+ * @param ctx Pointer to crypto_context_t containing key to wipe
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
+ */
+int crypto_secure_wipe_key(crypto_context_t *ctx) {
+    if (!ctx)
+        return ETDK_ERROR_CRYPTO;
+
+    // The cached cipher context holds the expanded key schedule; freeing it cleanses it
+    EVP_CIPHER_CTX_free(ctx->cipher_ctx);
+    ctx->cipher_ctx = NULL;
+
+    /* Pass 1: Overwrite with zeros
+     * Clears any existing data with a known pattern
+     */
+    memset(ctx->key, 0x00, AES_KEY_SIZE);
+    memset(ctx->tweak_key, 0x00, AES_KEY_SIZE);
+    memset(ctx->iv, 0x00, AES_BLOCK_SIZE);
+
+    /* Pass 2: Overwrite with ones
+     * Flips all bits from previous pass
+     */
+    memset(ctx->key, 0xFF, AES_KEY_SIZE);
+    memset(ctx->tweak_key, 0xFF, AES_KEY_SIZE);
+    memset(ctx->iv, 0xFF, AES_BLOCK_SIZE);
+
+    /* Pass 3: Overwrite with random data
+     * Introduces unpredictability, making pattern analysis impossible
+     */
+    RAND_bytes(ctx->key, AES_KEY_SIZE);
+    RAND_bytes(ctx->tweak_key, AES_KEY_SIZE);
+    RAND_bytes(ctx->iv, AES_BLOCK_SIZE);
+
+    /* Pass 4: Final overwrite with zeros
+     * Leaves memory in a known, clean state
+     */
+    memset(ctx->key, 0x00, AES_KEY_SIZE);
+    memset(ctx->tweak_key, 0x00, AES_KEY_SIZE);
+    memset(ctx->iv, 0x00, AES_BLOCK_SIZE);
+
+    /* Pass 5: Volatile overwrite to prevent compiler optimization
+     * Compilers may optimize away memset() calls if they determine the
+     * memory won't be read again. Using volatile pointers forces the
+     * compiler to perform the write operation.
+     */
+    volatile uint8_t *vkey = (volatile uint8_t *)ctx->key;
+    volatile uint8_t *vtweak = (volatile uint8_t *)ctx->tweak_key;
+    volatile uint8_t *viv = (volatile uint8_t *)ctx->iv;
+    for (size_t i = 0; i < AES_KEY_SIZE; i++) {
+        vkey[i] = 0;
+        vtweak[i] = 0;
+    }
+    for (size_t i = 0; i < AES_BLOCK_SIZE; i++) {
+        viv[i] = 0;
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Cleanup crypto context and securely wipe all sensitive data
+ *
+ * Calls crypto_secure_wipe_key() to perform secure key deletion,
+ * then zeros out the entire context structure.
+ *
+ * @param ctx Pointer to crypto_context_t to cleanup
+ */
+void crypto_cleanup(crypto_context_t *ctx) {
+    if (ctx) {
+        crypto_secure_wipe_key(ctx);
+        memset(ctx, 0, sizeof(crypto_context_t));
+    }
+}
+
+/**
+ * @brief Derive chunk size and io_uring queue depth from the device topology
+ *
+ * Values set in opts (--chunk-size, --queue-depth) are used as given.
+ * Otherwise the chunk starts at ETDK_DEFAULT_CHUNK_SIZE, or
+ * ETDK_ROTATIONAL_CHUNK_SIZE on spinning disks where each switch between
+ * the read and the write position costs a seek. It is rounded up to a
+ * multiple of the optimal I/O size (a RAID stripe is then written whole)
+ * and of the largest hardware request (no short trailing request per
+ * chunk), as long as that stays below ETDK_MAX_AUTO_CHUNK_SIZE.
+ *
+ * The queue depth shares the block layer's nr_requests between reads and
+ * writes, each chunk taking chunk / max_hw_bytes requests; spinning disks
+ * gain nothing from more than two chunks in flight per direction.
+ *
+ * @param info Topology from platform_get_device_info()
+ * @param opts I/O options
+ * @param chunk_size Pointer where the chunk size will be stored
+ * @param depth Pointer where the queue depth will be stored
+ */
+static void tune_io_geometry(const platform_device_info_t *info, const etdk_options_t *opts, size_t *chunk_size,
+                             unsigned *depth) {
+    size_t chunk = opts->chunk_size;
+    if (chunk == 0) {
+        chunk = info->rotational == 1 ? ETDK_ROTATIONAL_CHUNK_SIZE : ETDK_DEFAULT_CHUNK_SIZE;
+        uint64_t units[] = {info->optimal_io, info->max_hw_bytes};
+        for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+            uint64_t unit = units[i];
+            if (unit == 0 || unit % AES_BLOCK_SIZE != 0)
+                continue;
+            uint64_t rounded = (chunk + unit - 1) / unit * unit;
+            if (rounded <= ETDK_MAX_AUTO_CHUNK_SIZE)
+                chunk = (size_t)rounded;
         }
+    }
+    *chunk_size = chunk;
 
-        // Seek back to write position
-        fseek(device, -(long)bytes_read, SEEK_CUR);
+    unsigned d = opts->queue_depth;
+    if (d == 0) {
+        d = ETDK_DEFAULT_QUEUE_DEPTH;
+        if (info->rotational == 1) {
+            d = 2;
+        } else if (info->nr_requests > 0 && info->max_hw_bytes > 0) {
+            uint64_t per_chunk = (chunk + info->max_hw_bytes - 1) / info->max_hw_bytes;
+            uint64_t fit = info->nr_requests / 2 / per_chunk;
+            d = fit < 2 ? 2 : (fit > ETDK_MAX_AUTO_QUEUE_DEPTH ? ETDK_MAX_AUTO_QUEUE_DEPTH : (unsigned)fit);
+        }
+    }
+    *depth = d > ETDK_MAX_QUEUE_DEPTH ? ETDK_MAX_QUEUE_DEPTH : d;
+}
 
-        // Write encrypted data back to device
-        if (fwrite(outbuf, 1, outlen, device) != (size_t)outlen) {
-            fprintf(stderr, "\nError writing to device\n");
-            free(inbuf);
-            free(outbuf);
-            EVP_CIPHER_CTX_free(cipher_ctx);
-            fclose(device);
+/**
+ * @brief Encrypt a device or file in place without changing its size
+ *
+ * Reads the target in chunks (sized by tune_io_geometry()), encrypts each chunk using
+ * ctx->mode, and writes the encrypted data back to the same offset with
+ * pwrite(). Progress goes through progress_update(): a terminal line and,
+ * with opts->progress_fd, JSON records, each at most every
+ * ETDK_PROGRESS_INTERVAL.
+ *
+ * CBC chains the whole target into one stream. XTS encrypts every logical
+ * sector independently with its sector number as tweak (ctx->data_unit is
+ * set to the logical sector size). CTR uses the IV advanced by the block
+ * number of each chunk as counter. With XTS and CTR, chunks can be
+ * processed in any order.
+ *
+ * With opts->direct_io the device is opened with O_DIRECT so the wipe
+ * does not go through (and evict) the page cache. Buffers are aligned
+ * to the physical sector size and the chunk size is rounded to it. Any
+ * tail that is not a multiple of the physical sector size is handled
+ * through a second, buffered descriptor.
+ *
+ * In XTS and CTR mode with the sync engine, chunks are encrypted by a pool of
+ * opts->threads cipher workers (default: online CPUs), each with its own
+ * cipher context, between a reader and a writer thread; with opts->decrypt
+ * CBC chunks as well, chained through a cbc_chain_t. Otherwise (CBC
+ * encryption, or a single thread) targets larger than one chunk go through the same
+ * engine with one cipher stage: a read/encrypt/write pipeline over a small
+ * ring of buffers, so reading chunk N+1 and writing chunk N-1 overlap with
+ * encrypting chunk N even on a single core. Per-stage busy/idle times are
+ * printed at the end.
+ *
+ * With opts->io_engine == ETDK_ENGINE_IO_URING, reads and writes are kept
+ * in flight asynchronously (opts->queue_depth each) so the device stays
+ * busy while chunks are encrypted. If io_uring is not available the
+ * synchronous engine is used instead.
+ *
+ * With opts->keystream_only (CTR only) nothing is read: every chunk is
+ * overwritten with the keystream for its offset through the write-only
+ * engine, halving device traffic. Sectors that fail with EIO are skipped
+ * and reported, and the function returns ETDK_ERROR_IO after finishing
+ * the rest of the target.
+ *
+ * @param device_path Path to the block device or file
+ * @param ctx Pointer to initialized crypto_context_t with key and IV
+ * @param opts I/O options (not NULL)
+ * @param kind "device" or "file", used in messages
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+static int encrypt_in_place(const char *device_path, crypto_context_t *ctx, const etdk_options_t *opts,
+                            const char *kind) {
+    // Size and topology in one probe
+    platform_device_info_t info;
+    if (platform_get_device_info(device_path, &info) != ETDK_SUCCESS) {
+        fprintf(stderr, "Error getting %s size\n", kind);
+        return ETDK_ERROR_IO;
+    }
+    uint64_t device_size = info.size;
+
+    // Physical sector size determines buffer, offset and length alignment for O_DIRECT
+    uint32_t logical_sector = info.logical_sector;
+    uint32_t physical_sector = info.physical_sector;
+    size_t alignment = opts->direct_io ? physical_sector : sizeof(void *);
+
+    // Open device for positional read/write
+    int direct = opts->direct_io;
+    int open_flags = opts->keystream_only ? O_WRONLY : O_RDWR;
+    int device = io_open(device_path, open_flags, &direct);
+    if (device < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", kind, strerror(errno));
+        return ETDK_ERROR_IO;
+    }
+
+    // XTS encrypts one logical sector per data unit (tweak = sector number)
+    if (ctx->mode == ETDK_MODE_XTS) {
+        ctx->data_unit = logical_sector;
+    }
+
+    // Chunk must be a multiple of the alignment, the AES block size and the XTS data unit
+    size_t chunk_size;
+    unsigned depth;
+    tune_io_geometry(&info, opts, &chunk_size, &depth);
+    size_t chunk_align = alignment > AES_BLOCK_SIZE ? alignment : AES_BLOCK_SIZE;
+    if (ctx->mode == ETDK_MODE_XTS && ctx->data_unit > chunk_align) {
+        chunk_align = ctx->data_unit;
+    }
+    chunk_size = (chunk_size + chunk_align - 1) / chunk_align * chunk_align;
+    if (device_size < chunk_size) {
+        chunk_size = device_size > 0 ? (size_t)((device_size + chunk_align - 1) / chunk_align * chunk_align) : chunk_align;
+    }
+
+    // Checkpoint journal: where this run starts and where its progress is recorded
+    etdk_journal_t *journal = NULL;
+    uint64_t start = 0;
+    if (opts->journal_path) {
+        journal = journal_start(device_path, device_size, ctx->mode, chunk_align, opts, &start);
+        if (!journal) {
+            close(device);
             return ETDK_ERROR_IO;
         }
+    }
 
-        // Flush to ensure data is written
-        fflush(device);
+    EVP_CIPHER_CTX *cipher_ctx = target_cipher_context(ctx, !opts->decrypt);
+    if (!cipher_ctx) {
+        close(device);
+        free(journal);
+        return ETDK_ERROR_CRYPTO;
+    }
 
-        processed += bytes_read;
+    // The io_uring engine needs one buffer per in-flight read and write
+    size_t nbuffers = opts->io_engine == ETDK_ENGINE_IO_URING && !opts->keystream_only ? 2 * (size_t)depth : 1;
 
-        // Show progress
-        double percent = (processed * 100.0) / device_size;
-        double gb_processed = processed / (1024.0 * 1024.0 * 1024.0);
-        double gb_total = device_size / (1024.0 * 1024.0 * 1024.0);
+    /* XTS and CTR chunks are independent: spread them over a cipher worker
+     * pool. So are CBC chunks when decrypting, given the last ciphertext
+     * block of the preceding chunk (see cbc_chain_t).
+     */
+    unsigned threads = opts->threads;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned)online : 1;
+    }
+    int parallel = (ctx->mode != ETDK_MODE_CBC || opts->decrypt) && opts->io_engine == ETDK_ENGINE_SYNC &&
+                   threads > 1 && !opts->keystream_only;
+    if (parallel) {
+        nbuffers = 2 * (size_t)threads + 2;
+    }
 
-        printf("\rProgress: %.2f GB / %.2f GB (%.1f%%)  ", gb_processed, gb_total, percent);
-        fflush(stdout);
+    // More slots than chunks can be in flight (one per buffer), so none is reused while still needed
+    cbc_chain_t chain = {0};
+    if (parallel && ctx->mode == ETDK_MODE_CBC) {
+        chain.count = 2 * nbuffers;
+        chain.links = calloc(chain.count, sizeof(*chain.links));
+        if (!chain.links) {
+            fprintf(stderr, "Memory allocation failed\n");
+            close(device);
+            free(journal);
+            return ETDK_ERROR_MEMORY;
+        }
+        chain.chunk_size = chunk_size;
+        memcpy(chain.first_iv, ctx->iv, AES_BLOCK_SIZE);
+    }
+
+    // Multi-chunk targets on the sync engine still overlap read, encrypt and write
+    int pipeline = !parallel && opts->io_engine == ETDK_ENGINE_SYNC && !opts->keystream_only &&
+                   device_size > chunk_size;
+    if (pipeline) {
+        nbuffers = ETDK_PIPELINE_BUFFERS;
+    }
+
+    io_buffer_pool_t pool;
+    if (io_pool_init(&pool, nbuffers, chunk_size + EVP_MAX_BLOCK_LENGTH, alignment) != ETDK_SUCCESS) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(chain.links);
+        close(device);
+        free(journal);
+        return ETDK_ERROR_MEMORY;
+    }
+
+    if (!opts->quiet) {
+        printf("\n");
+        if (opts->keystream_only) {
+            printf("Overwriting %s with %s keystream, write only%s...\n", kind, crypto_mode_name(ctx->mode),
+                   direct ? " (direct I/O)" : "");
+        } else {
+            printf("%s %s with %s%s...\n", opts->decrypt ? "Decrypting" : "Encrypting", kind,
+                   crypto_mode_name(ctx->mode), direct ? " (direct I/O)" : "");
+        }
+        if (info.is_device) {
+            printf("Topology: %u/%u-byte sectors, optimal I/O %u, %s, max request %llu KB, %u requests\n",
+                   (unsigned)logical_sector, (unsigned)physical_sector, (unsigned)info.optimal_io,
+                   info.rotational == 1 ? "rotational" : (info.rotational == 0 ? "non-rotational" : "rotation unknown"),
+                   (unsigned long long)(info.max_hw_bytes / 1024), (unsigned)info.nr_requests);
+        }
+        printf("I/O: %zu KB chunks%s", chunk_size / 1024, opts->chunk_size ? "" : " (auto)");
+        if (opts->io_engine == ETDK_ENGINE_IO_URING && !opts->keystream_only)
+            printf(", queue depth %u%s", depth, opts->queue_depth ? "" : " (auto)");
+        printf("\n\n");
+    }
+
+    /* Split the device into a main range and a tail:
+     * - Direct I/O: only whole physical sectors go through O_DIRECT
+     * - XTS: a remainder shorter than one AES block must be encrypted
+     *   together with the preceding data unit (ciphertext stealing)
+     */
+    uint64_t main_end = direct ? device_size / physical_sector * physical_sector : device_size;
+    if (ctx->mode == ETDK_MODE_XTS) {
+        uint64_t remainder = device_size % ctx->data_unit;
+        if (remainder > 0 && remainder < AES_BLOCK_SIZE && device_size >= remainder + ctx->data_unit &&
+            main_end > device_size - remainder - ctx->data_unit) {
+            main_end = device_size - remainder - ctx->data_unit;
+        }
+    }
+
+    /* A journal written with other options may end inside this run's tail;
+     * the tail must be encrypted as a whole, so redo it from its start
+     * (the bytes in between are already ciphertext of the earlier run)
+     */
+    if (start > main_end && start < device_size) {
+        start = main_end;
+    }
+    if (!info.is_device && !opts->quiet) {
+        uint64_t allocated = 0;
+        uint64_t data_start = 0, data_end = main_end;
+        for (uint64_t pos = 0; io_next_data(device, pos, main_end, &data_start, &data_end); pos = data_end) {
+            allocated += data_end - data_start;
+        }
+        if (allocated < main_end) {
+            printf("Sparse file: %.2f MB allocated of %.2f MB, holes are skipped and stay holes\n\n",
+                   allocated / (1024.0 * 1024.0), device_size / (1024.0 * 1024.0));
+        }
+    }
+    if (journal && start > 0 && !opts->quiet) {
+        printf("Resuming at %.2f GB of %.2f GB (journal %s)\n", start / (1024.0 * 1024.0 * 1024.0),
+               device_size / (1024.0 * 1024.0 * 1024.0), opts->journal_path);
+        printf("The new key covers bytes %llu to %llu; earlier bytes are ciphertext of the interrupted run\n\n",
+               (unsigned long long)start, (unsigned long long)device_size);
+    }
+
+    etdk_progress_t progress;
+    progress_init(&progress, device_path, device_size, start < device_size ? start : device_size, !opts->quiet,
+                  opts->progress_fd);
+    device_job_t job = {cipher_ctx, ctx->mode, ctx->data_unit, ctx->iv, &progress, NULL, opts->limiter,
+                        opts->keystream_only ? 1 : 2, 0, opts->decrypt, NULL};
+
+    /* Buffered I/O: read ahead aggressively and keep the page cache clean.
+     * Written windows are flushed with sync_file_range() and dropped with
+     * POSIX_FADV_DONTNEED, so neither plaintext nor ciphertext of the whole
+     * target piles up in memory and pushes out other processes' pages.
+     */
+    io_writeback_t writeback;
+    if (!direct) {
+        io_advise_sequential(device, start, 0);
+        io_writeback_init(&writeback, device, start, chunk_size > ETDK_WRITEBACK_WINDOW ? chunk_size : 0);
+        job.writeback = &writeback;
+    }
+    int result = ETDK_SUCCESS;
+    io_transform_fn chunk_fn = opts->keystream_only ? keystream_chunk : encrypt_chunk;
+    size_t retry_unit = direct ? physical_sector : logical_sector;
+    uint64_t bad_units = 0;
+    io_pipeline_stats_t stage_stats = {0};
+    unsigned stage_threads = 0; // Cipher stages of the pipeline run, 0 if none
+    int use_uring = opts->io_engine == ETDK_ENGINE_IO_URING;
+
+    // One cipher stage sees chunks in order and uses the main context, so the CBC chain continues into the tail
+    device_job_t stage = job;
+    stage.progress = NULL;
+    stage.writeback = NULL;
+    stage.limiter = NULL;
+    void *stage_arg = &stage;
+    if (parallel && !opts->quiet)
+        printf("Cipher workers: %u\n\n", threads);
+
+    /* With a journal the main range is processed in checkpoint-sized
+     * segments; after each one the target is flushed and the journal
+     * records the new end. Without one the loop runs once.
+     */
+    uint64_t interval = main_end;
+    if (journal) {
+        interval = opts->checkpoint_bytes ? opts->checkpoint_bytes : ETDK_DEFAULT_CHECKPOINT;
+        interval = (interval + chunk_size - 1) / chunk_size * chunk_size;
+    }
+
+    for (uint64_t segment = start; result == ETDK_SUCCESS && segment < main_end;) {
+        uint64_t segment_end = main_end - segment > interval ? segment + interval : main_end;
+        job.reported = segment;
+
+        /* Sparse files: only allocated ranges are read and written, holes
+         * stay holes (XTS/CTR units are independent, so nothing chains
+         * across a hole). Devices and CBC files are one range.
+         */
+        uint64_t pos = segment;
+        while (result == ETDK_SUCCESS && pos < segment_end) {
+            uint64_t range = pos;
+            uint64_t range_end = segment_end;
+            if (!info.is_device && ctx->mode != ETDK_MODE_CBC &&
+                !io_next_data(device, pos, segment_end, &range, &range_end))
+                break;
+            job.reported = range;
+            range = range / chunk_align * chunk_align;
+            if (range < pos)
+                range = pos;
+            range_end = (range_end + chunk_align - 1) / chunk_align * chunk_align;
+            if (range_end > segment_end)
+                range_end = segment_end;
+
+            // Short extents go straight to the synchronous loop; starting threads or a ring costs more
+            int small = range_end - range <= chunk_size && !info.is_device;
+            io_pipeline_stats_t run_stats;
+            result = ETDK_ERROR_PLATFORM;
+
+            if (opts->keystream_only) {
+                result = io_fill_engine_run(device, range, range_end, pool.buffers[0], chunk_size, retry_unit,
+                                            keystream_chunk, &job, &bad_units);
+            } else if (small) {
+                // Synchronous loop below
+            } else if (pipeline) {
+                result = io_parallel_engine_run(device, range, range_end, &pool, chunk_size, 1, encrypt_chunk,
+                                                &stage_arg, report_progress, &job, &run_stats);
+                add_pipeline_stats(&stage_stats, &run_stats);
+                stage_threads = 1;
+            } else if (parallel) {
+                // CBC ranges start at offset 0: there is no journal when decrypting and no hole skipping
+                chain.base = range;
+                for (size_t i = 0; i < chain.count; i++)
+                    atomic_init(&chain.links[i].seq, 0);
+                result = encrypt_device_parallel(device, range, range_end, ctx, &pool, chunk_size, threads, &job,
+                                                 chain.links ? &chain : NULL, &run_stats);
+                add_pipeline_stats(&stage_stats, &run_stats);
+                stage_threads = threads;
+
+                // The tail continues the chain from the last ciphertext block of the range
+                if (result == ETDK_SUCCESS && chain.links) {
+                    cbc_link_t *last = &chain.links[((range_end - 1 - range) / chunk_size) % chain.count];
+                    if (EVP_CipherInit_ex(cipher_ctx, NULL, NULL, NULL, last->block, -1) != 1)
+                        result = ETDK_ERROR_CRYPTO;
+                }
+            } else if (use_uring) {
+                result = io_uring_engine_run(device, range, range_end, &pool, chunk_size, depth, encrypt_chunk, &job);
+                if (result == ETDK_ERROR_PLATFORM) {
+                    fprintf(stderr, "Warning: io_uring unavailable, using synchronous I/O\n");
+                    use_uring = 0;
+                }
+            }
+
+            if (result == ETDK_ERROR_PLATFORM) {
+                result = io_sync_engine_run(device, range, range_end, pool.buffers[0], chunk_size, encrypt_chunk, &job);
+            }
+            pos = range_end;
+        }
+
+        // The last checkpoint is written once the tail is done as well
+        if (result == ETDK_SUCCESS && journal && segment_end < main_end) {
+            progress_phase(&progress, ETDK_PHASE_CHECKPOINT);
+            result = checkpoint(device, journal, opts->journal_path, segment_end);
+            progress_phase(&progress, ETDK_PHASE_ENCRYPT);
+        }
+        segment = segment_end;
+    }
+
+    // Tail: continue the same cipher stream as one final chunk (buffered if direct I/O was used)
+    if (result == ETDK_SUCCESS && main_end < device_size && start < device_size) {
+        progress_phase(&progress, ETDK_PHASE_TAIL);
+        int tail = direct ? open(device_path, open_flags) : device;
+        size_t tail_len = (size_t)(device_size - main_end);
+        if (tail < 0) {
+            fprintf(stderr, "\nCannot open %s for tail: %s\n", kind, strerror(errno));
+            result = ETDK_ERROR_IO;
+        } else {
+            if (opts->keystream_only) {
+                result = io_fill_engine_run(tail, main_end, device_size, pool.buffers[0], tail_len, logical_sector,
+                                            chunk_fn, &job, &bad_units);
+            } else {
+                result = io_sync_engine_run(tail, main_end, device_size, pool.buffers[0], tail_len, chunk_fn, &job);
+            }
+            if (tail != device) {
+                if (result == ETDK_SUCCESS && fsync(tail) != 0) {
+                    fprintf(stderr, "\nError flushing %s: %s\n", kind, strerror(errno));
+                    result = ETDK_ERROR_IO;
+                }
+                close(tail);
+            }
+        }
     }
 
-    // Note: We don't call EVP_EncryptFinal_ex for devices
+    // Note: We don't call EVP_EncryptFinal_ex in place
     // because we're encrypting raw sectors, not a padded file format
 
-    printf("\n\n");
+    progress_phase(&progress, ETDK_PHASE_FLUSH);
+    if (!opts->quiet) {
+        printf("\n\n");
+        if (result == ETDK_SUCCESS && stage_threads > 0)
+            print_pipeline_stats(&stage_stats, stage_threads);
+    }
+
+    // Make sure all ciphertext has reached the device before reporting success
+    if (job.writeback)
+        io_writeback_finish(job.writeback, device_size);
+    if (result == ETDK_SUCCESS && fsync(device) != 0) {
+        fprintf(stderr, "Error flushing %s: %s\n", kind, strerror(errno));
+        result = ETDK_ERROR_IO;
+    }
+    if (result == ETDK_SUCCESS && journal) {
+        result = checkpoint(device, journal, opts->journal_path, device_size);
+    }
+
+    if (bad_units > 0) {
+        fprintf(stderr, "Warning: %llu sectors of %zu bytes could not be overwritten\n",
+                (unsigned long long)bad_units, retry_unit);
+        if (result == ETDK_SUCCESS)
+            result = ETDK_ERROR_IO;
+    }
+    progress_finish(&progress, result);
+
+    io_pool_free(&pool);
+    free(chain.links);
+    close(device);
+    free(journal);
+
+    return result;
+}
+
+/**
+ * @brief Encrypt a block device in place using AES-256-CBC, XTS or CTR
+ *
+ * WARNING: This DESTROYS all data on the device permanently!
+ *
+ * @param device_path Path to the block device (e.g., /dev/sdb)
+ * @param ctx Pointer to initialized crypto_context_t with key and IV
+ * @param opts I/O options, or NULL for defaults
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int crypto_encrypt_device(const char *device_path, crypto_context_t *ctx, const etdk_options_t *opts) {
+    if (!device_path || !ctx) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    etdk_options_t defaults;
+    if (!opts) {
+        etdk_options_init(&defaults);
+        opts = &defaults;
+    }
+
+    if (opts->keystream_only && ctx->mode != ETDK_MODE_CTR) {
+        fprintf(stderr, "Keystream overwrite requires CTR mode\n");
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    return encrypt_in_place(device_path, ctx, opts, "device");
+}
+
+/**
+ * @brief Encrypt a regular file in place, preserving its size
+ *
+ * Overwrites the file's own blocks at the same offsets with a
+ * length-preserving mode (CTR or XTS). Unlike crypto_encrypt_file() no
+ * temporary copy is created, so no extra free space is needed and the
+ * original plaintext blocks are overwritten rather than left behind
+ * (on filesystems that rewrite blocks in place).
+ *
+ * @param path Path to the file to encrypt
+ * @param ctx Pointer to initialized crypto_context_t (mode CTR or XTS)
+ * @param opts I/O options, or NULL for defaults
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int crypto_encrypt_file_inplace(const char *path, crypto_context_t *ctx, const etdk_options_t *opts) {
+    if (!path || !ctx) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    // CBC padding would grow the file; only length-preserving modes can work in place
+    if (ctx->mode == ETDK_MODE_CBC) {
+        fprintf(stderr, "In-place file encryption requires CTR or XTS mode\n");
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    etdk_options_t defaults;
+    if (!opts) {
+        etdk_options_init(&defaults);
+        opts = &defaults;
+    }
+
+    if (opts->keystream_only && ctx->mode != ETDK_MODE_CTR) {
+        fprintf(stderr, "Keystream overwrite requires CTR mode\n");
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    // Shorter than one AES block: XTS cannot, the CBC copy format of crypto_encrypt_buffer() takes it
+    struct stat st;
+    if (ctx->mode == ETDK_MODE_XTS && !opts->keystream_only && stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0 && st.st_size < AES_BLOCK_SIZE) {
+        unsigned char *buf = malloc(ETDK_SMALL_FILE_BUFFER);
+        if (!buf) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return ETDK_ERROR_MEMORY;
+        }
+        if (!opts->quiet) {
+            printf("\nFile shorter than one AES block: AES-256-CBC copy format with the XTS data key and the IV\n");
+        }
+        int result = crypto_encrypt_small_file(path, ctx, opts, buf);
+        if (result == ETDK_ERROR_SYMLINK) {
+            fprintf(stderr, "%s is a symbolic link: name the file it points to\n", path);
+        }
+        OPENSSL_cleanse(buf, ETDK_SMALL_FILE_BUFFER);
+        free(buf);
+        return result;
+    }
+
+    return encrypt_in_place(path, ctx, opts, "file");
+}
+
+/**
+ * @brief Encrypt a whole file held in memory, as if it were read from offset 0
+ *
+ * CBC adds the PKCS#7 padding of the copy format; XTS uses the 512-byte
+ * data units regular files report (platform_get_device_info), CTR the
+ * counter of offset 0. The output is what crypto_encrypt_file() or
+ * crypto_encrypt_file_inplace() would write for the same file.
+ *
+ * XTS cannot encrypt less than one AES block, so a file of 1 to 15 bytes
+ * gets the CBC copy format instead, under the XTS data key (ctx->key)
+ * and ctx->iv: 16 bytes that "etdk decrypt --mode cbc" reverses.
+ *
+ * @param ctx Pointer to initialized crypto_context_t
+ * @param buf File contents, encrypted in place; room for len + AES_BLOCK_SIZE bytes
+ * @param len File size in bytes
+ * @param out_len Receives the ciphertext length (len, or the padded length for CBC)
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_CRYPTO on failure
+ */
+int crypto_encrypt_buffer(crypto_context_t *ctx, unsigned char *buf, size_t len, size_t *out_len) {
+    if (!ctx || !buf || !out_len) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    // The cached context is keyed for the mode in ctx, so a short XTS file borrows CBC for the re-keying
+    int mode = ctx->mode;
+    if (mode == ETDK_MODE_XTS && len > 0 && len < AES_BLOCK_SIZE) {
+        mode = ETDK_MODE_CBC;
+    }
+    int saved_mode = ctx->mode;
+    ctx->mode = mode;
+    EVP_CIPHER_CTX *cipher_ctx = target_cipher_context(ctx, 1);
+    ctx->mode = saved_mode;
+    if (!cipher_ctx) {
+        return ETDK_ERROR_CRYPTO;
+    }
 
-    free(inbuf);
-    free(outbuf);
-    EVP_CIPHER_CTX_free(cipher_ctx);
-    fclose(device);
+    *out_len = len;
+    if (mode == ETDK_MODE_XTS) {
+        ctx->data_unit = 512;
+        return len > 0 ? xts_encrypt_units(cipher_ctx, buf, len, 0, ctx->data_unit) : ETDK_SUCCESS;
+    }
+    if (mode == ETDK_MODE_CTR) {
+        return ctr_encrypt_at(cipher_ctx, ctx->iv, buf, len, 0);
+    }
 
+    int update = 0, final = 0;
+    if (EVP_EncryptUpdate(cipher_ctx, buf, &update, buf, (int)len) != 1 ||
+        EVP_EncryptFinal_ex(cipher_ctx, buf + update, &final) != 1) {
+        fprintf(stderr, "Error during encryption: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return ETDK_ERROR_CRYPTO;
+    }
+    *out_len = (size_t)update + (size_t)final;
     return ETDK_SUCCESS;
 }
+
+/**
+ * @brief Encrypt a small regular file with one read and one write
+ *
+ * Below ETDK_SMALL_FILE_MAX bytes, opening a temporary file, remove() and
+ * rename() cost more than AES, and so do the topology probe and buffer
+ * setup of the in-place engine. This path opens the file once, reads it
+ * whole into the caller's buffer, encrypts it there and writes it back
+ * at offset 0. The result is the same as that of crypto_encrypt_file()
+ * (CBC copy format, the padding grows the file by up to one block) or
+ * crypto_encrypt_file_inplace() (XTS, CTR), so crypto_decrypt_target()
+ * reverses either. In-place modes are flushed before success like there;
+ * the CBC copy format never was.
+ *
+ * Files that cannot be opened for writing or have grown past
+ * ETDK_SMALL_FILE_MAX are left untouched with ETDK_ERROR_PLATFORM, for
+ * the caller to take the general path. The path is usually checked with
+ * lstat() long before (tree walk), so it is opened with O_NOFOLLOW: a
+ * symbolic link swapped in since is left alone with ETDK_ERROR_SYMLINK,
+ * and whatever else is found there must still be a regular file.
+ *
+ * @param path Path to the file
+ * @param ctx Pointer to initialized crypto_context_t
+ * @param opts I/O options (limiter, progress_fd), or NULL for defaults
+ * @param buf Buffer of ETDK_SMALL_FILE_BUFFER bytes, reused from file to file
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_PLATFORM to fall back, ETDK_ERROR_SYMLINK, error code on failure
+ */
+int crypto_encrypt_small_file(const char *path, crypto_context_t *ctx, const etdk_options_t *opts,
+                              unsigned char *buf) {
+    if (!path || !ctx || !buf) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    // A file writable only through its directory still goes through the temporary copy
+    int fd = open(path, O_RDWR | O_NOFOLLOW);
+    if (fd < 0) {
+        if (errno == ELOOP) {
+            return ETDK_ERROR_SYMLINK;
+        }
+        return errno == EACCES || errno == EPERM ? ETDK_ERROR_PLATFORM : ETDK_ERROR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "\n%s is no longer a regular file\n", path);
+        close(fd);
+        return ETDK_ERROR_IO;
+    }
+
+    // One byte more than the limit tells a file that has grown since it was listed
+    size_t size = 0;
+    if (io_pread_full(fd, buf, ETDK_SMALL_FILE_MAX + 1, 0, &size) != ETDK_SUCCESS) {
+        fprintf(stderr, "Error reading file: %s\n", strerror(errno));
+        close(fd);
+        return ETDK_ERROR_IO;
+    }
+    if (size > ETDK_SMALL_FILE_MAX) {
+        OPENSSL_cleanse(buf, size);
+        close(fd);
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    etdk_progress_t progress;
+    progress_init(&progress, path, size, 0, 0, opts ? opts->progress_fd : -1);
+    io_limiter_wait(opts ? opts->limiter : NULL, size, 2);
+
+    size_t out = size;
+    int result = crypto_encrypt_buffer(ctx, buf, size, &out);
+    if (result == ETDK_SUCCESS && io_pwrite_full(fd, buf, out, 0) != ETDK_SUCCESS) {
+        perror("Error writing file");
+        result = ETDK_ERROR_IO;
+    }
+    if (result == ETDK_SUCCESS && ctx->mode != ETDK_MODE_CBC && fsync(fd) != 0) {
+        fprintf(stderr, "Error flushing file: %s\n", strerror(errno));
+        result = ETDK_ERROR_IO;
+    }
+    if (result == ETDK_SUCCESS) {
+        progress_update(&progress, size);
+    } else {
+        OPENSSL_cleanse(buf, out > size ? out : size);
+    }
+    progress_finish(&progress, result);
+
+    if (close(fd) != 0 && result == ETDK_SUCCESS) {
+        perror("Error closing file");
+        result = ETDK_ERROR_IO;
+    }
+    return result;
+}
+
+/**
+ * @brief Check and remove the PKCS#7 padding of a decrypted CBC file
+ *
+ * @param path File decrypted in place
+ * @param size Size of the file (a multiple of AES_BLOCK_SIZE)
+ * @return ETDK_SUCCESS, ETDK_ERROR_IO, or ETDK_ERROR_CRYPTO if the padding is invalid
+ */
+static int strip_cbc_padding(const char *path, uint64_t size) {
+    if (size == 0)
+        return ETDK_SUCCESS;
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open file: %s\n", strerror(errno));
+        return ETDK_ERROR_IO;
+    }
+
+    unsigned char block[AES_BLOCK_SIZE];
+    int result = ETDK_SUCCESS;
+    size_t done = 0;
+    if (io_pread_full(fd, block, sizeof(block), size - AES_BLOCK_SIZE, &done) != ETDK_SUCCESS ||
+        done != sizeof(block)) {
+        fprintf(stderr, "Error reading last block\n");
+        result = ETDK_ERROR_IO;
+    } else {
+        // Every padding byte holds the padding length (1 to 16)
+        unsigned pad = block[AES_BLOCK_SIZE - 1];
+        int valid = pad >= 1 && pad <= AES_BLOCK_SIZE;
+        for (unsigned i = 1; valid && i <= pad; i++)
+            valid = block[AES_BLOCK_SIZE - i] == pad;
+
+        if (!valid) {
+            fprintf(stderr, "Invalid padding in the last block: wrong key or IV, or not the CBC copy format\n");
+            fprintf(stderr, "The file was left at its full size\n");
+            result = ETDK_ERROR_CRYPTO;
+        } else if (ftruncate(fd, (off_t)(size - pad)) != 0 || fsync(fd) != 0) {
+            fprintf(stderr, "Error removing padding: %s\n", strerror(errno));
+            result = ETDK_ERROR_IO;
+        }
+    }
+
+    OPENSSL_cleanse(block, sizeof(block));
+    close(fd);
+    return result;
+}
+
+/**
+ * @brief Decrypt a device or file in place with a known key
+ *
+ * Runs the in-place engine backwards: XTS and CTR targets are decrypted
+ * like they were encrypted, CBC targets additionally spread over
+ * opts->threads cipher workers (CBC decryption has no chain dependency
+ * on the previous plaintext, see cbc_chain_t). CBC regular files are
+ * taken to be in the copy format of crypto_encrypt_file(), so the
+ * PKCS#7 padding is checked and cut off afterwards. An XTS run stored
+ * files of 1 to 15 bytes in that CBC format (crypto_encrypt_buffer()),
+ * so they are decrypted with ETDK_MODE_CBC and the XTS data key.
+ *
+ * @param path Path to the block device or regular file
+ * @param ctx Crypto context holding the key, tweak key and IV used to encrypt
+ * @param opts I/O options, or NULL for defaults
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int crypto_decrypt_target(const char *path, crypto_context_t *ctx, const etdk_options_t *opts) {
+    if (!path || !ctx) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    etdk_options_t local;
+    if (opts) {
+        local = *opts;
+    } else {
+        etdk_options_init(&local);
+    }
+    local.decrypt = 1;
+
+    // A keystream overwrite keeps nothing to decrypt; a journaled target mixes the keys of several runs
+    if (local.keystream_only || local.journal_path) {
+        fprintf(stderr, "Keystream overwrites and journaled runs cannot be decrypted\n");
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    platform_device_info_t info;
+    if (platform_get_device_info(path, &info) != ETDK_SUCCESS) {
+        fprintf(stderr, "Error getting size of %s\n", path);
+        return ETDK_ERROR_IO;
+    }
+    if (ctx->mode == ETDK_MODE_CBC && info.size % AES_BLOCK_SIZE != 0) {
+        fprintf(stderr, "CBC ciphertext must be a multiple of %d bytes\n", AES_BLOCK_SIZE);
+        return ETDK_ERROR_CRYPTO;
+    }
+    if (ctx->mode == ETDK_MODE_XTS && info.size > 0 && info.size < AES_BLOCK_SIZE) {
+        fprintf(stderr, "%s is shorter than one AES block, so it was never encrypted with XTS\n", path);
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    int result = encrypt_in_place(path, ctx, &local, info.is_device ? "device" : "file");
+    if (result != ETDK_SUCCESS || info.is_device || ctx->mode != ETDK_MODE_CBC) {
+        return result;
+    }
+    return strip_cbc_padding(path, info.size);
+}
+
+/**
+ * @brief State of one cipher benchmark thread
+ */
+typedef struct {
+    const crypto_context_t *ctx; /**< Key material and mode */
+    size_t buffer_size;          /**< Bytes per encrypt_chunk() call */
+    double seconds;              /**< Minimum run time */
+    uint64_t bytes;              /**< Bytes encrypted */
+    double cpu_seconds;          /**< CPU time of the thread */
+    int result;                  /**< ETDK_SUCCESS or error code */
+} bench_worker_t;
+
+/**
+ * @brief Encrypt one buffer over and over for the requested time
+ *
+ * Goes through init_cipher_context() and encrypt_chunk() like the device
+ * engines, at consecutive offsets, so the numbers include the per-chunk
+ * re-keying of CTR and the per-unit tweaks of XTS.
+ *
+ * @param arg Pointer to bench_worker_t
+ * @return NULL
+ */
+static void *bench_worker_main(void *arg) {
+    bench_worker_t *worker = arg;
+    device_job_t job;
+    io_buffer_pool_t pool;
+
+    memset(&job, 0, sizeof(job));
+    job.cipher_ctx = init_cipher_context(worker->ctx, 1);
+    job.mode = worker->ctx->mode;
+    job.data_unit = worker->ctx->data_unit;
+    job.iv = worker->ctx->iv;
+    if (!job.cipher_ctx) {
+        worker->result = ETDK_ERROR_CRYPTO;
+        return NULL;
+    }
+    if (io_pool_init(&pool, 1, worker->buffer_size + EVP_MAX_BLOCK_LENGTH, ETDK_BUFFER_ALIGNMENT) != ETDK_SUCCESS) {
+        EVP_CIPHER_CTX_free(job.cipher_ctx);
+        worker->result = ETDK_ERROR_MEMORY;
+        return NULL;
+    }
+    memset(pool.buffers[0], 0x5a, worker->buffer_size);
+
+    double cpu_start = platform_thread_cpu_seconds();
+    double start = platform_monotonic_seconds();
+    uint64_t offset = 0;
+    worker->result = ETDK_SUCCESS;
+    do {
+        worker->result = encrypt_chunk(&job, pool.buffers[0], worker->buffer_size, offset);
+        offset += worker->buffer_size;
+    } while (worker->result == ETDK_SUCCESS && platform_monotonic_seconds() - start < worker->seconds);
+    worker->cpu_seconds = platform_thread_cpu_seconds() - cpu_start;
+    worker->bytes = offset;
+
+    io_pool_free(&pool);
+    EVP_CIPHER_CTX_free(job.cipher_ctx);
+    return NULL;
+}
+
+/**
+ * @brief Measure cipher throughput without any I/O
+ *
+ * Every thread gets its own cipher context and buffer, like the cipher
+ * workers of the device engine, and encrypts for at least @p seconds.
+ * Wall time is measured around all threads, CPU time per thread.
+ *
+ * @param ctx Initialized crypto context (mode and, for XTS, data_unit set)
+ * @param buffer_size Bytes per chunk (multiple of AES_BLOCK_SIZE and, for XTS, of data_unit)
+ * @param threads Number of threads (1 to ETDK_MAX_THREADS)
+ * @param seconds Minimum run time per thread
+ * @param result Receives bytes, wall time and CPU time
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int crypto_bench_cipher(const crypto_context_t *ctx, size_t buffer_size, unsigned threads, double seconds,
+                        crypto_bench_result_t *result) {
+    if (!ctx || !result || buffer_size == 0 || buffer_size % AES_BLOCK_SIZE != 0 || threads == 0 ||
+        threads > ETDK_MAX_THREADS || (ctx->mode == ETDK_MODE_XTS && buffer_size % ctx->data_unit != 0)) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    bench_worker_t *workers = calloc(threads, sizeof(bench_worker_t));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    if (!workers || !ids) {
+        free(workers);
+        free(ids);
+        return ETDK_ERROR_MEMORY;
+    }
+
+    int status = ETDK_SUCCESS;
+    unsigned started = 0;
+    double start = platform_monotonic_seconds();
+    for (; started < threads; started++) {
+        workers[started].ctx = ctx;
+        workers[started].buffer_size = buffer_size;
+        workers[started].seconds = seconds;
+        if (pthread_create(&ids[started], NULL, bench_worker_main, &workers[started]) != 0) {
+            status = ETDK_ERROR_PLATFORM;
+            break;
+        }
+    }
+
+    memset(result, 0, sizeof(*result));
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+        if (workers[i].result != ETDK_SUCCESS && status == ETDK_SUCCESS)
+            status = workers[i].result;
+        result->bytes += workers[i].bytes;
+        result->cpu_seconds += workers[i].cpu_seconds;
+    }
+    result->seconds = platform_monotonic_seconds() - start;
+
+    free(workers);
+    free(ids);
+    return status;
+}
+
+/**
+ * @brief Measure the per-target cipher setup cost
+ *
+ * Compares what every file of a batch paid with one cipher context per
+ * file (EVP_CIPHER_CTX_new(), EVP_CipherInit_ex() with the implicitly
+ * fetched EVP_aes_256_*(), EVP_CIPHER_CTX_free()) with re-keying one
+ * cached context like target_cipher_context(). No data is encrypted:
+ * this is the fixed cost a small file adds on top of its bytes.
+ *
+ * @param ctx Initialized crypto context (mode set)
+ * @param seconds Minimum run time of each variant
+ * @param result Receives the time per target of both variants
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int crypto_bench_setup(const crypto_context_t *ctx, double seconds, crypto_bench_setup_t *result) {
+    if (!ctx || !result) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    const EVP_CIPHER *implicit = ctx->mode == ETDK_MODE_XTS   ? EVP_aes_256_xts()
+                                 : ctx->mode == ETDK_MODE_CTR ? EVP_aes_256_ctr()
+                                                              : EVP_aes_256_cbc();
+    uint8_t key[2 * AES_KEY_SIZE];
+    memcpy(key, ctx->key, AES_KEY_SIZE);
+    memcpy(key + AES_KEY_SIZE, ctx->tweak_key, AES_KEY_SIZE);
+    const uint8_t *iv = ctx->mode == ETDK_MODE_XTS ? NULL : ctx->iv;
+
+    // Batches keep the clock out of the measurement
+    const unsigned batch = 256;
+    int status = ETDK_SUCCESS;
+    uint64_t runs = 0;
+    double start = platform_monotonic_seconds();
+    double elapsed;
+    do {
+        for (unsigned i = 0; i < batch && status == ETDK_SUCCESS; i++) {
+            EVP_CIPHER_CTX *cipher_ctx = EVP_CIPHER_CTX_new();
+            if (!cipher_ctx || EVP_CipherInit_ex(cipher_ctx, implicit, NULL, key, iv, 1) != 1)
+                status = ETDK_ERROR_CRYPTO;
+            EVP_CIPHER_CTX_free(cipher_ctx);
+        }
+        runs += batch;
+        elapsed = platform_monotonic_seconds() - start;
+    } while (status == ETDK_SUCCESS && elapsed < seconds);
+    result->fresh_seconds = elapsed / (double)runs;
+    OPENSSL_cleanse(key, sizeof(key));
+
+    EVP_CIPHER_CTX *cached = init_cipher_context(ctx, 1);
+    if (!cached) {
+        return ETDK_ERROR_CRYPTO;
+    }
+    runs = 0;
+    start = platform_monotonic_seconds();
+    do {
+        for (unsigned i = 0; i < batch && status == ETDK_SUCCESS; i++)
+            status = key_cipher_context(cached, ctx, 1);
+        runs += batch;
+        elapsed = platform_monotonic_seconds() - start;
+    } while (status == ETDK_SUCCESS && elapsed < seconds);
+    result->rekeyed_seconds = elapsed / (double)runs;
+    EVP_CIPHER_CTX_free(cached);
+
+    return status;
+}
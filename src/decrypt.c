@@ -0,0 +1,364 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * Decrypt Module - "etdk decrypt": recovery with a saved key
+ *
+ * The key shown after a run is the only way back. This subcommand takes
+ * it (and the IV) as hex strings and decrypts devices, --in-place files
+ * and CBC copy-format files in place, through the same engines that
+ * encrypted them. CBC decryption runs on all cipher workers, like XTS
+ * and CTR: only encryption is chained to the previous output block.
+ * With --manifest, the targets and their keys come from a session
+ * (session.c): the master key re-derives each file's key and IV.
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <openssl/crypto.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/**
+ * @brief Print usage of the decrypt subcommand
+ * @param program_name The name of the program executable
+ */
+static void decrypt_usage(const char *program_name) {
+    printf("Usage: %s decrypt --mode <cbc|xts|ctr> --key <hex> [--iv <hex>] [options] <file|device>...\n",
+           program_name);
+    printf("       %s decrypt --manifest <file> --key <hex> [options]\n\n", program_name);
+    printf("Decrypts targets in place with the key shown at the end of an encryption run.\n\n");
+    printf("Options:\n");
+    printf("  --mode <cbc|xts|ctr>     Cipher mode of the encryption run (default: cbc)\n");
+    printf("  --key <hex>              Key as shown: 64 hex digits, 128 for XTS (key and tweak key)\n");
+    printf("  --iv <hex>               IV as shown: 32 hex digits (CBC and CTR)\n");
+    printf("  --threads <n>            Cipher worker threads, also for CBC (default: online CPUs)\n");
+    printf("  --direct                 Bypass the page cache (O_DIRECT) for devices\n");
+    printf("  --engine <sync|io_uring> Device I/O engine (default: sync)\n");
+    printf("  --queue-depth <n>        Reads/writes in flight for io_uring (default: from the device queue)\n");
+    printf("  --chunk-size <size>      Bytes per I/O request, K/M/G suffix allowed (default: 4M)\n");
+    printf("  --progress-fd <n>        Write JSON-lines progress records to descriptor <n> >= 3\n");
+    printf("  --manifest <file>        Decrypt every file of a session; --key is its master key\n");
+    printf("  -h, --help               Show this help message\n\n");
+    printf("CBC files are expected in the copy format (padding is checked and removed);\n");
+    printf("XTS and CTR files must have been encrypted with --in-place. Use the key of the\n");
+    printf("run that encrypted the target: a wrong key scrambles it a second time. XTS files\n");
+    printf("of 1 to 15 bytes were stored in the CBC copy format: decrypt them with --mode cbc,\n");
+    printf("the first 64 digits of the XTS key and the IV shown with it.\n\n");
+    printf("Example:\n");
+    printf("  %s decrypt --mode xts --key <128 hex digits> /dev/sdb\n", program_name);
+    printf("  %s decrypt --manifest keys.manifest --key <64 hex digits>\n", program_name);
+}
+
+/**
+ * @brief Decode the first 2 * len hex digits of a string
+ * @param text Hex digits (either case), at least 2 * len of them
+ * @param out Receives the bytes
+ * @param len Number of bytes to decode
+ * @return 0 on success, -1 on a non-hex digit
+ */
+static int parse_hex(const char *text, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned value = 0;
+        for (int j = 0; j < 2; j++) {
+            char c = text[2 * i + (size_t)j];
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= (unsigned)(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value |= (unsigned)(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                value |= (unsigned)(c - 'A' + 10);
+            } else {
+                return -1;
+            }
+        }
+        out[i] = (uint8_t)value;
+    }
+    return 0;
+}
+
+int decrypt_main(int argc, char *argv[], const char *program_name) {
+    etdk_options_t opts;
+    etdk_options_init(&opts);
+    int mode = -1; // Not chosen on the command line
+    char *key_hex = NULL;
+    char *iv_hex = NULL;
+    const char *manifest_path = NULL;
+
+    enum {
+        OPT_MODE = 256,
+        OPT_KEY,
+        OPT_IV,
+        OPT_THREADS,
+        OPT_DIRECT,
+        OPT_ENGINE,
+        OPT_QUEUE_DEPTH,
+        OPT_CHUNK_SIZE,
+        OPT_PROGRESS_FD,
+        OPT_MANIFEST
+    };
+    static const struct option long_options[] = {
+        {"mode", required_argument, NULL, OPT_MODE},
+        {"key", required_argument, NULL, OPT_KEY},
+        {"iv", required_argument, NULL, OPT_IV},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {"direct", no_argument, NULL, OPT_DIRECT},
+        {"engine", required_argument, NULL, OPT_ENGINE},
+        {"queue-depth", required_argument, NULL, OPT_QUEUE_DEPTH},
+        {"chunk-size", required_argument, NULL, OPT_CHUNK_SIZE},
+        {"progress-fd", required_argument, NULL, OPT_PROGRESS_FD},
+        {"manifest", required_argument, NULL, OPT_MANIFEST},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case OPT_MODE:
+            if (strcmp(optarg, "cbc") == 0) {
+                mode = ETDK_MODE_CBC;
+            } else if (strcmp(optarg, "xts") == 0) {
+                mode = ETDK_MODE_XTS;
+            } else if (strcmp(optarg, "ctr") == 0) {
+                mode = ETDK_MODE_CTR;
+            } else {
+                fprintf(stderr, "Error: Unknown mode '%s' (use cbc, xts or ctr)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_KEY:
+            key_hex = optarg;
+            break;
+        case OPT_IV:
+            iv_hex = optarg;
+            break;
+        case OPT_MANIFEST:
+            manifest_path = optarg;
+            break;
+        case OPT_THREADS: {
+            char *end = NULL;
+            unsigned long threads = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || threads == 0 || threads > ETDK_MAX_THREADS) {
+                fprintf(stderr, "Error: Threads must be between 1 and %d\n", ETDK_MAX_THREADS);
+                return 1;
+            }
+            opts.threads = (unsigned)threads;
+            break;
+        }
+        case OPT_DIRECT:
+            opts.direct_io = 1;
+            break;
+        case OPT_ENGINE:
+            if (strcmp(optarg, "sync") == 0) {
+                opts.io_engine = ETDK_ENGINE_SYNC;
+            } else if (strcmp(optarg, "io_uring") == 0) {
+                opts.io_engine = ETDK_ENGINE_IO_URING;
+            } else {
+                fprintf(stderr, "Error: Unknown engine '%s' (use sync or io_uring)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_QUEUE_DEPTH: {
+            char *end = NULL;
+            unsigned long depth = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || depth == 0 || depth > ETDK_MAX_QUEUE_DEPTH) {
+                fprintf(stderr, "Error: Queue depth must be between 1 and %d\n", ETDK_MAX_QUEUE_DEPTH);
+                return 1;
+            }
+            opts.queue_depth = (unsigned)depth;
+            break;
+        }
+        case OPT_CHUNK_SIZE:
+            if (etdk_parse_size(optarg, &opts.chunk_size) != 0 || opts.chunk_size % AES_BLOCK_SIZE != 0 ||
+                opts.chunk_size > (size_t)1024 * 1024 * 1024) {
+                fprintf(stderr, "Error: Invalid chunk size '%s' (multiple of %d bytes, at most 1G)\n", optarg,
+                        AES_BLOCK_SIZE);
+                return 1;
+            }
+            break;
+        case OPT_PROGRESS_FD: {
+            char *end = NULL;
+            long fd = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || fd < 0 || fd > 1024 || fcntl((int)fd, F_GETFD) == -1) {
+                fprintf(stderr, "Error: --progress-fd %s is not an open descriptor\n", optarg);
+                return 1;
+            }
+            // JSON lines on stdout or stderr would interleave with the report and the progress line
+            if (fd < 3) {
+                fprintf(stderr, "Error: --progress-fd needs a descriptor of its own (3 or higher, e.g. 3>log)\n");
+                return 1;
+            }
+            opts.progress_fd = (int)fd;
+            break;
+        }
+        case 'h':
+            decrypt_usage(program_name);
+            return 0;
+        default:
+            decrypt_usage(program_name);
+            return 1;
+        }
+    }
+
+    if (!key_hex || (manifest_path ? optind < argc : optind >= argc)) {
+        decrypt_usage(program_name);
+        return 1;
+    }
+
+    // Targets: the command line, or every file the manifest recorded as encrypted
+    etdk_manifest_entry_t *entries = NULL;
+    size_t count = 0;
+    if (manifest_path) {
+        int manifest_mode;
+        int status = session_load_manifest(manifest_path, &manifest_mode, &entries, &count);
+        if (status != ETDK_SUCCESS) {
+            fprintf(stderr, "Error: Cannot read manifest %s (missing or damaged)\n", manifest_path);
+            return 1;
+        }
+        if ((mode >= 0 && mode != manifest_mode) || iv_hex) {
+            fprintf(stderr, "Error: The manifest sets the mode (%s) and every IV\n", crypto_mode_name(manifest_mode));
+            session_free_manifest(entries, count);
+            return 1;
+        }
+        mode = manifest_mode;
+    } else {
+        count = (size_t)(argc - optind);
+        entries = calloc(count, sizeof(*entries));
+        if (!entries) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 1;
+        }
+        for (size_t i = 0; i < count; i++)
+            entries[i].path = argv[optind + (int)i];
+        if (mode < 0)
+            mode = ETDK_MODE_CBC;
+        if (mode == ETDK_MODE_XTS ? iv_hex != NULL : iv_hex == NULL) {
+            fprintf(stderr, "Error: %s\n", mode == ETDK_MODE_XTS ? "XTS has no IV (the tweak is the sector number)"
+                                                                 : "--iv is required for cbc and ctr");
+            free(entries);
+            return 1;
+        }
+    }
+
+    // Only what was encrypted in place can be decrypted in place
+    size_t skipped = 0;
+    int usable = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].failed) {
+            skipped++;
+        } else if (access(entries[i].path, R_OK | W_OK) != 0) {
+            fprintf(stderr, "Error: Cannot access %s: %s\n", entries[i].path, strerror(errno));
+            usable = 0;
+        } else if (platform_is_directory(entries[i].path)) {
+            fprintf(stderr, "Error: %s is a directory (pass its files, e.g. with find | xargs)\n", entries[i].path);
+            usable = 0;
+        }
+    }
+
+    // master holds the session master key (with --manifest), ctx the key of the current target
+    crypto_context_t ctx, master;
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&master, 0, sizeof(master));
+    platform_lock_memory(&ctx, sizeof(ctx));
+    platform_lock_memory(&master, sizeof(master));
+    ctx.mode = mode;
+    // XTS keys are shown as data key followed by tweak key, a session shows only its master key
+    int key_ok = manifest_path
+                     ? strlen(key_hex) == 2 * AES_KEY_SIZE && parse_hex(key_hex, master.key, AES_KEY_SIZE) == 0
+                 : mode == ETDK_MODE_XTS
+                     ? strlen(key_hex) == 4 * AES_KEY_SIZE && parse_hex(key_hex, ctx.key, AES_KEY_SIZE) == 0 &&
+                           parse_hex(key_hex + 2 * AES_KEY_SIZE, ctx.tweak_key, AES_KEY_SIZE) == 0
+                     : strlen(key_hex) == 2 * AES_KEY_SIZE && parse_hex(key_hex, ctx.key, AES_KEY_SIZE) == 0;
+    int iv_ok = !iv_hex || (strlen(iv_hex) == 2 * AES_BLOCK_SIZE && parse_hex(iv_hex, ctx.iv, AES_BLOCK_SIZE) == 0);
+
+    // The key stays in the process's argument strings (/proc/<pid>/cmdline) unless overwritten
+    OPENSSL_cleanse(key_hex, strlen(key_hex));
+    int exit_code = 1;
+    if (!key_ok || !iv_ok) {
+        fprintf(stderr, "Error: The key must be %d hex digits%s, the IV %d\n",
+                mode == ETDK_MODE_XTS && !manifest_path ? 4 * AES_KEY_SIZE : 2 * AES_KEY_SIZE,
+                mode == ETDK_MODE_XTS && !manifest_path ? " (key and tweak key)" : "", 2 * AES_BLOCK_SIZE);
+        goto cleanup;
+    }
+    if (!usable)
+        goto cleanup;
+
+    printf("\n");
+    printf("ETDK v%s - Recovery Decryption\n", ETDK_VERSION);
+    printf("\n");
+    printf("Cipher:  %s%s\n", crypto_mode_name(mode), manifest_path ? ", per-target keys from the manifest" : "");
+    printf("Targets: %zu\n", count - skipped);
+    if (skipped > 0)
+        printf("Skipped: %zu (not encrypted according to the manifest)\n", skipped);
+    printf("\n");
+    printf("WARNING: The targets are rewritten in place; a wrong key or IV scrambles them again.\n");
+    printf("Type YES to confirm: ");
+    char confirm[10];
+    if (fgets(confirm, sizeof(confirm), stdin) == NULL || strncmp(confirm, "YES\n", 4) != 0) {
+        printf("Aborted.\n");
+        goto cleanup;
+    }
+
+#ifdef SIGPIPE
+    // A progress reader that goes away must not stop the recovery; the stream just stops
+    if (opts.progress_fd >= 0) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+#endif
+
+    size_t failed = 0;
+    uint64_t total = 0;
+    double start_time = platform_monotonic_seconds();
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].failed)
+            continue;
+        uint64_t size = 0;
+        platform_get_device_size(entries[i].path, &size);
+        // A session file of 1 to 15 bytes was too short for XTS and holds the CBC copy format
+        ctx.mode = manifest_path && mode == ETDK_MODE_XTS && entries[i].size > 0 && entries[i].size < AES_BLOCK_SIZE
+                       ? ETDK_MODE_CBC
+                       : mode;
+        if ((!manifest_path || session_derive_key(master.key, entries[i].index, &ctx) == ETDK_SUCCESS) &&
+            crypto_decrypt_target(entries[i].path, &ctx, &opts) == ETDK_SUCCESS) {
+            total += size;
+        } else {
+            fprintf(stderr, "Decryption failed: %s\n", entries[i].path);
+            failed++;
+        }
+    }
+    double elapsed = platform_monotonic_seconds() - start_time;
+
+    if (total > 0 && elapsed > 0) {
+        printf("Elapsed: %.3f s (%.1f MB/s)\n\n", elapsed, total / (1024.0 * 1024.0) / elapsed);
+    }
+    progress_report_run(opts.progress_fd, failed > 0 ? ETDK_ERROR_IO : ETDK_SUCCESS, count - skipped, total, elapsed,
+                        0.0);
+
+    if (failed > 0) {
+        printf("RECOVERY INCOMPLETE: %zu of %zu targets could not be decrypted (see errors above)\n\n", failed,
+               count - skipped);
+    } else {
+        printf("RECOVERY SUCCESSFUL\n\n");
+        exit_code = 0;
+    }
+
+cleanup:
+    crypto_cleanup(&ctx);
+    crypto_cleanup(&master);
+    platform_unlock_memory(&ctx, sizeof(ctx));
+    platform_unlock_memory(&master, sizeof(master));
+    if (manifest_path) {
+        session_free_manifest(entries, count);
+    } else {
+        free(entries);
+    }
+    return exit_code;
+}
@@ -0,0 +1,579 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * I/O Module - Positional file descriptor I/O shared by file and device encryption
+ */
+
+#define _GNU_SOURCE // O_DIRECT
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/**
+ * @brief Read up to len bytes from an explicit offset
+ *
+ * Wraps pread() and retries on EINTR and short reads, so callers see
+ * either a full buffer or the bytes available before end of file.
+ * The file offset of the descriptor is never modified, which lets
+ * reads and writes on the same descriptor run without seeking back.
+ *
+ * @param fd Open file descriptor
+ * @param buf Destination buffer
+ * @param len Number of bytes to read
+ * @param offset Absolute byte offset to read from
+ * @param done Pointer where the number of bytes read will be stored
+ * @return ETDK_SUCCESS on success (including EOF), ETDK_ERROR_IO on failure
+ */
+int io_pread_full(int fd, void *buf, size_t len, uint64_t offset, size_t *done) {
+    if (!buf || !done) {
+        return ETDK_ERROR_IO;
+    }
+
+    unsigned char *p = buf;
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = pread(fd, p + total, len - total, (off_t)(offset + total));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            *done = total;
+            return ETDK_ERROR_IO;
+        }
+        if (n == 0) {
+            break; // End of file/device
+        }
+        total += (size_t)n;
+    }
+
+    *done = total;
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Write exactly len bytes at an explicit offset
+ *
+ * Wraps pwrite() and retries on EINTR and short writes. A write that
+ * makes no progress (e.g. end of device) is reported as an error.
+ *
+ * @param fd Open file descriptor
+ * @param buf Source buffer
+ * @param len Number of bytes to write
+ * @param offset Absolute byte offset to write to
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_IO on failure
+ */
+int io_pwrite_full(int fd, const void *buf, size_t len, uint64_t offset) {
+    if (!buf) {
+        return ETDK_ERROR_IO;
+    }
+
+    const unsigned char *p = buf;
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = pwrite(fd, p + total, len - total, (off_t)(offset + total));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return ETDK_ERROR_IO;
+        }
+        if (n == 0) {
+            errno = ENOSPC;
+            return ETDK_ERROR_IO;
+        }
+        total += (size_t)n;
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Transform a byte range in place with synchronous positional I/O
+ *
+ * Reads each chunk with pread(), hands it to the transform and writes it
+ * back to the same offset with pwrite(). Stops at end or end of input.
+ *
+ * @param fd Descriptor opened for read/write
+ * @param offset First byte to process
+ * @param end Byte offset to stop at
+ * @param buf Buffer of at least chunk_size bytes (aligned for O_DIRECT if needed)
+ * @param chunk_size Bytes per read/write
+ * @param transform In-place transform, called in ascending offset order
+ * @param arg Passed to transform
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int io_sync_engine_run(int fd, uint64_t offset, uint64_t end, unsigned char *buf, size_t chunk_size,
+                       io_transform_fn transform, void *arg) {
+    if (!buf || !transform || chunk_size == 0) {
+        return ETDK_ERROR_IO;
+    }
+
+    while (offset < end) {
+        size_t want = chunk_size;
+        if (end - offset < want) {
+            want = (size_t)(end - offset);
+        }
+
+        size_t got = 0;
+        if (io_pread_full(fd, buf, want, offset, &got) != ETDK_SUCCESS) {
+            perror("\nError reading input");
+            return ETDK_ERROR_IO;
+        }
+        if (got == 0) {
+            break;
+        }
+
+        int result = transform(arg, buf, got, offset);
+        if (result != ETDK_SUCCESS) {
+            return result;
+        }
+
+        if (io_pwrite_full(fd, buf, got, offset) != ETDK_SUCCESS) {
+            perror("\nError writing output");
+            return ETDK_ERROR_IO;
+        }
+
+        offset += got;
+        if (got < want) {
+            break; // Short read means end of input
+        }
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Overwrite a byte range with generated data, never reading it
+ *
+ * Write-only counterpart of io_sync_engine_run(): the device sees only
+ * writes, so the wipe runs at write bandwidth and sectors that can no
+ * longer be read do not stop it. A chunk that fails with EIO is rewritten
+ * unit by unit so a single bad sector costs one unit, not the whole chunk.
+ *
+ * @param fd Descriptor opened for writing
+ * @param offset First byte to overwrite
+ * @param end Byte offset to stop at
+ * @param buf Buffer of at least chunk_size bytes (aligned for O_DIRECT if needed)
+ * @param chunk_size Bytes per write
+ * @param unit Retry granularity after EIO (sector size)
+ * @param generate Fills the buffer for the given offset
+ * @param arg Passed to generate
+ * @param bad_units Incremented for every unit that could not be written (may be NULL)
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int io_fill_engine_run(int fd, uint64_t offset, uint64_t end, unsigned char *buf, size_t chunk_size, size_t unit,
+                       io_transform_fn generate, void *arg, uint64_t *bad_units) {
+    if (!buf || !generate || chunk_size == 0 || unit == 0) {
+        return ETDK_ERROR_IO;
+    }
+
+    while (offset < end) {
+        size_t want = chunk_size;
+        if (end - offset < want) {
+            want = (size_t)(end - offset);
+        }
+
+        int result = generate(arg, buf, want, offset);
+        if (result != ETDK_SUCCESS) {
+            return result;
+        }
+
+        if (io_pwrite_full(fd, buf, want, offset) != ETDK_SUCCESS) {
+            if (errno != EIO) {
+                perror("\nError writing output");
+                return ETDK_ERROR_IO;
+            }
+
+            // Medium error somewhere in the chunk: retry unit by unit and skip what cannot be written
+            for (size_t done = 0; done < want; done += unit) {
+                size_t n = want - done < unit ? want - done : unit;
+                if (io_pwrite_full(fd, buf + done, n, offset + done) != ETDK_SUCCESS) {
+                    if (errno != EIO) {
+                        perror("\nError writing output");
+                        return ETDK_ERROR_IO;
+                    }
+                    if (bad_units)
+                        (*bad_units)++;
+                }
+            }
+        }
+
+        offset += want;
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Open a file or device, optionally bypassing the page cache
+ *
+ * Direct I/O keeps a multi-terabyte wipe from evicting the host's working
+ * set and avoids copying every byte through the page cache. Not every
+ * filesystem supports it (tmpfs rejects O_DIRECT with EINVAL), so the
+ * path is reopened buffered in that case.
+ *
+ * @param path Path to open
+ * @param flags open() access flags
+ * @param direct In: request direct I/O, Out: whether direct I/O is active
+ * @return File descriptor on success, -1 on error
+ */
+int io_open(const char *path, int flags, int *direct) {
+    if (!path) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int want_direct = direct && *direct;
+    int fd;
+
+#ifdef O_DIRECT
+    if (want_direct) {
+        fd = open(path, flags | O_DIRECT);
+        if (fd >= 0) {
+            return fd;
+        }
+        if (errno != EINVAL) {
+            return -1;
+        }
+        fprintf(stderr, "Warning: direct I/O not supported for %s, using buffered I/O\n", path);
+    }
+    fd = open(path, flags);
+    if (direct)
+        *direct = 0;
+#else
+    fd = open(path, flags);
+    if (fd >= 0 && want_direct) {
+#ifdef F_NOCACHE
+        // macOS: disable caching on the descriptor instead of O_DIRECT
+        if (fcntl(fd, F_NOCACHE, 1) == 0) {
+            return fd;
+        }
+#endif
+        fprintf(stderr, "Warning: direct I/O not supported for %s, using buffered I/O\n", path);
+    }
+    if (direct)
+        *direct = 0;
+#endif
+
+    return fd;
+}
+
+/**
+ * @brief Tell the kernel a range will be read once, front to back
+ *
+ * POSIX_FADV_SEQUENTIAL doubles the readahead window on Linux. A no-op
+ * where posix_fadvise() does not exist (macOS).
+ *
+ * @param fd Open file descriptor
+ * @param offset First byte of the range
+ * @param len Length of the range (0 = to end of file)
+ */
+void io_advise_sequential(int fd, uint64_t offset, uint64_t len) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, (off_t)offset, (off_t)len, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)fd;
+    (void)offset;
+    (void)len;
+#endif
+}
+
+/**
+ * @brief Drop clean cached pages of a range that will not be read again
+ *
+ * Dirty pages are not dropped; use io_writeback_advance() for ranges
+ * that were written.
+ *
+ * @param fd Open file descriptor
+ * @param offset First byte of the range
+ * @param len Length of the range
+ */
+void io_drop_cache(int fd, uint64_t offset, uint64_t len) {
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, (off_t)offset, (off_t)len, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+    (void)offset;
+    (void)len;
+#endif
+}
+
+/**
+ * @brief Flush one window and drop it from the page cache
+ * @param wb Write-behind state
+ * @param len Bytes from wb->evicted to flush and drop
+ */
+static void writeback_evict(io_writeback_t *wb, uint64_t len) {
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(wb->fd, (off_t)wb->evicted, (off_t)len,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+    io_drop_cache(wb->fd, wb->evicted, len);
+    wb->evicted += len;
+}
+
+/**
+ * @brief Start write-behind for a buffered sequential writer
+ *
+ * @param wb State to initialize
+ * @param fd Descriptor the data is written to
+ * @param offset Offset of the first write
+ * @param window Bytes per writeback window (0 = ETDK_WRITEBACK_WINDOW)
+ */
+void io_writeback_init(io_writeback_t *wb, int fd, uint64_t offset, uint64_t window) {
+    wb->fd = fd;
+    wb->window = window ? window : ETDK_WRITEBACK_WINDOW;
+    wb->submitted = offset;
+    wb->evicted = offset;
+}
+
+/**
+ * @brief Keep dirty page cache bounded while a writer moves forward
+ *
+ * Whenever at least a window has been written since the last call that
+ * did something, writeback of the new data is started
+ * (SYNC_FILE_RANGE_WRITE, asynchronous) and the previously submitted
+ * range, which has had a window's time to reach the device, is waited for
+ * and dropped with POSIX_FADV_DONTNEED. Only about two windows (or two
+ * chunks, if larger) of the target are ever dirty or cached, independent
+ * of its size, and the device keeps streaming while new data is produced.
+ * Holes and skipped ranges cost one call, not one per window.
+ *
+ * Calling this with an offset whose writes are still in flight is
+ * harmless: pages that are not dirty yet are simply not flushed.
+ *
+ * @param wb Write-behind state from io_writeback_init()
+ * @param written Offset up to which data has been written
+ */
+void io_writeback_advance(io_writeback_t *wb, uint64_t written) {
+    if (written < wb->submitted || written - wb->submitted < wb->window) {
+        return;
+    }
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(wb->fd, (off_t)wb->submitted, (off_t)(written - wb->submitted), SYNC_FILE_RANGE_WRITE);
+#endif
+    if (wb->submitted > wb->evicted) {
+        writeback_evict(wb, wb->submitted - wb->evicted);
+    }
+    wb->submitted = written;
+}
+
+/**
+ * @brief Flush and drop everything written since the last eviction
+ *
+ * Durability still requires fsync(): sync_file_range() neither writes
+ * metadata nor flushes the device cache.
+ *
+ * @param wb Write-behind state
+ * @param written Offset up to which data has been written
+ */
+void io_writeback_finish(io_writeback_t *wb, uint64_t written) {
+    if (written > wb->evicted) {
+        writeback_evict(wb, written - wb->evicted);
+    }
+    wb->submitted = wb->evicted;
+}
+
+/**
+ * @brief Find the next allocated byte range of a file
+ *
+ * Uses lseek() with SEEK_DATA and SEEK_HOLE, which every filesystem that
+ * supports sparse files implements from its extent map (the same source
+ * FIEMAP reads), without copying an extent list. Where the calls are not
+ * available, or for block devices, the whole range counts as data.
+ *
+ * @param fd Open file descriptor (its file offset is modified)
+ * @param offset First byte to look at
+ * @param end Byte offset to stop at
+ * @param data_start Pointer where the start of the data will be stored
+ * @param data_end Pointer where the end of the data (start of the next hole, at most end) will be stored
+ * @return 1 if data was found, 0 if only holes remain before end
+ */
+int io_next_data(int fd, uint64_t offset, uint64_t end, uint64_t *data_start, uint64_t *data_end) {
+    if (offset >= end) {
+        return 0;
+    }
+    *data_start = offset;
+    *data_end = end;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off_t data = lseek(fd, (off_t)offset, SEEK_DATA);
+    if (data < 0) {
+        // ENXIO: no data after offset; anything else: no hole support, treat as data
+        return errno == ENXIO ? 0 : 1;
+    }
+    if ((uint64_t)data >= end) {
+        return 0;
+    }
+    off_t hole = lseek(fd, data, SEEK_HOLE);
+    *data_start = (uint64_t)data;
+    if (hole > data && (uint64_t)hole < end) {
+        *data_end = (uint64_t)hole;
+    }
+#else
+    (void)fd;
+#endif
+
+    return 1;
+}
+
+/**
+ * @brief Allocate a pool of aligned buffers
+ *
+ * Every buffer is allocated with posix_memalign() so it can be handed to
+ * O_DIRECT reads and writes. Sizes are rounded up to the alignment.
+ *
+ * @param pool Pool to initialize
+ * @param count Number of buffers
+ * @param size Minimum size of each buffer in bytes
+ * @param alignment Required alignment (power of two)
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_MEMORY on failure
+ */
+int io_pool_init(io_buffer_pool_t *pool, size_t count, size_t size, size_t alignment) {
+    if (!pool || count == 0 || size == 0) {
+        return ETDK_ERROR_MEMORY;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+
+    // posix_memalign() requires a power of two that is a multiple of sizeof(void *)
+    if (alignment < sizeof(void *)) {
+        alignment = sizeof(void *);
+    }
+    if ((alignment & (alignment - 1)) != 0) {
+        return ETDK_ERROR_MEMORY;
+    }
+
+    pool->buffers = calloc(count, sizeof(unsigned char *));
+    if (!pool->buffers) {
+        return ETDK_ERROR_MEMORY;
+    }
+
+    pool->count = count;
+    pool->alignment = alignment;
+    pool->size = (size + alignment - 1) & ~(alignment - 1);
+
+    for (size_t i = 0; i < count; i++) {
+        void *buf = NULL;
+        if (posix_memalign(&buf, alignment, pool->size) != 0) {
+            io_pool_free(pool);
+            return ETDK_ERROR_MEMORY;
+        }
+        pool->buffers[i] = buf;
+    }
+
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Free all buffers of a pool
+ *
+ * Safe to call on a partially initialized pool.
+ *
+ * @param pool Pool to release
+ */
+void io_pool_free(io_buffer_pool_t *pool) {
+    if (!pool || !pool->buffers) {
+        return;
+    }
+
+    for (size_t i = 0; i < pool->count; i++) {
+        free(pool->buffers[i]);
+    }
+    free(pool->buffers);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief Set up a token-bucket limiter
+ *
+ * Each bucket refills continuously at its rate and holds at most
+ * ETDK_LIMITER_BURST seconds worth of tokens, so an idle period does not
+ * turn into a burst that hurts other I/O on the device.
+ *
+ * @param limiter Limiter to initialize
+ * @param bytes_per_second Byte rate, 0 for unlimited
+ * @param ops_per_second I/O request rate, 0 for unlimited
+ * @return ETDK_SUCCESS, or ETDK_ERROR_PLATFORM if the mutex cannot be created
+ */
+int io_limiter_init(io_limiter_t *limiter, uint64_t bytes_per_second, uint64_t ops_per_second) {
+    memset(limiter, 0, sizeof(*limiter));
+    if (pthread_mutex_init(&limiter->lock, NULL) != 0) {
+        return ETDK_ERROR_PLATFORM;
+    }
+    limiter->bytes_rate = (double)bytes_per_second;
+    limiter->ops_rate = (double)ops_per_second;
+    limiter->bytes_tokens = limiter->bytes_rate * ETDK_LIMITER_BURST;
+    limiter->ops_tokens = limiter->ops_rate * ETDK_LIMITER_BURST;
+    limiter->last = platform_monotonic_seconds();
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Release a limiter
+ * @param limiter Limiter from io_limiter_init()
+ */
+void io_limiter_free(io_limiter_t *limiter) {
+    pthread_mutex_destroy(&limiter->lock);
+}
+
+/**
+ * @brief Take tokens for one transfer, sleeping until the rates allow it
+ *
+ * Tokens are taken even if the bucket runs into debt, and the caller
+ * sleeps the debt off, so requests larger than the bucket (a 4 MB chunk at
+ * 1 MB/s) still work and the long-term rate is exact. Reservations are
+ * made under a mutex and the sleep happens outside it, so threads sharing
+ * the limiter (file workers) queue up in order.
+ *
+ * @param limiter Limiter, NULL for none
+ * @param bytes Bytes about to be transferred
+ * @param ops I/O requests about to be issued
+ */
+void io_limiter_wait(io_limiter_t *limiter, uint64_t bytes, unsigned ops) {
+    if (!limiter || (limiter->bytes_rate <= 0 && limiter->ops_rate <= 0)) {
+        return;
+    }
+
+    pthread_mutex_lock(&limiter->lock);
+    double now = platform_monotonic_seconds();
+    double elapsed = now - limiter->last;
+    limiter->last = now;
+
+    double delay = 0;
+    if (limiter->bytes_rate > 0) {
+        limiter->bytes_tokens += elapsed * limiter->bytes_rate;
+        if (limiter->bytes_tokens > limiter->bytes_rate * ETDK_LIMITER_BURST)
+            limiter->bytes_tokens = limiter->bytes_rate * ETDK_LIMITER_BURST;
+        limiter->bytes_tokens -= (double)bytes;
+        if (limiter->bytes_tokens < 0)
+            delay = -limiter->bytes_tokens / limiter->bytes_rate;
+    }
+    if (limiter->ops_rate > 0) {
+        limiter->ops_tokens += elapsed * limiter->ops_rate;
+        if (limiter->ops_tokens > limiter->ops_rate * ETDK_LIMITER_BURST)
+            limiter->ops_tokens = limiter->ops_rate * ETDK_LIMITER_BURST;
+        limiter->ops_tokens -= (double)ops;
+        if (limiter->ops_tokens < 0 && -limiter->ops_tokens / limiter->ops_rate > delay)
+            delay = -limiter->ops_tokens / limiter->ops_rate;
+    }
+    limiter->slept += delay;
+    pthread_mutex_unlock(&limiter->lock);
+
+    if (delay > 0) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)delay;
+        ts.tv_nsec = (long)((delay - (double)ts.tv_sec) * 1e9);
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+}
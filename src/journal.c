@@ -0,0 +1,229 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * Journal Module - Checkpoint journal for resumable in-place encryption
+ *
+ * The journal is a small text file kept off the target. It names the
+ * target and its size and lists the byte ranges that have reached the
+ * device, one range per run:
+ *
+ *   etdk-journal 1
+ *   target /dev/sdb
+ *   size 20000588955648
+ *   range 0 4294967296 xts
+ *   range 4294967296 6442450944 xts
+ *
+ * Each run encrypts from the end of the previous range with a fresh key,
+ * so every range is ciphertext under a different key. The file is
+ * replaced atomically (write temporary, fsync, rename, fsync directory),
+ * so a crash leaves either the old or the new checkpoint, never a torn one.
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/** @brief First line of every journal file */
+#define JOURNAL_MAGIC "etdk-journal 1"
+
+/**
+ * @brief Short mode name used in the journal
+ * @param mode ETDK_MODE_* value
+ * @return "cbc", "xts" or "ctr"
+ */
+static const char *journal_mode_name(int mode) {
+    switch (mode) {
+    case ETDK_MODE_XTS:
+        return "xts";
+    case ETDK_MODE_CTR:
+        return "ctr";
+    case ETDK_MODE_CBC:
+    default:
+        return "cbc";
+    }
+}
+
+/**
+ * @brief Parse a short mode name from the journal
+ * @param name "cbc", "xts" or "ctr"
+ * @return ETDK_MODE_* value, -1 if unknown
+ */
+static int journal_parse_mode(const char *name) {
+    if (strcmp(name, "cbc") == 0)
+        return ETDK_MODE_CBC;
+    if (strcmp(name, "xts") == 0)
+        return ETDK_MODE_XTS;
+    if (strcmp(name, "ctr") == 0)
+        return ETDK_MODE_CTR;
+    return -1;
+}
+
+/**
+ * @brief Start an empty journal for a target
+ *
+ * @param journal Journal to initialize
+ * @param target Canonical path of the target
+ * @param size Size of the target in bytes
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO if the path is too long
+ */
+int journal_init(etdk_journal_t *journal, const char *target, uint64_t size) {
+    if (!journal || !target) {
+        return ETDK_ERROR_IO;
+    }
+
+    memset(journal, 0, sizeof(*journal));
+    if (strlen(target) >= sizeof(journal->target)) {
+        return ETDK_ERROR_IO;
+    }
+    strcpy(journal->target, target);
+    journal->size = size;
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Read a journal written by journal_commit()
+ *
+ * Ranges must be contiguous from offset 0 and lie within the target;
+ * anything else is treated as a damaged journal.
+ *
+ * @param path Journal file
+ * @param journal Journal to fill
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO if the file is missing or damaged
+ */
+int journal_load(const char *path, etdk_journal_t *journal) {
+    if (!path || !journal) {
+        return ETDK_ERROR_IO;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return ETDK_ERROR_IO;
+    }
+
+    memset(journal, 0, sizeof(*journal));
+    char line[ETDK_JOURNAL_PATH_MAX + 16];
+    int valid = fgets(line, sizeof(line), file) && strcmp(line, JOURNAL_MAGIC "\n") == 0;
+    int have_size = 0;
+
+    while (valid && fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\n");
+        line[len] = '\0';
+        unsigned long long start, end;
+        char mode[8];
+
+        if (strncmp(line, "target ", 7) == 0 && len - 7 < sizeof(journal->target)) {
+            strcpy(journal->target, line + 7);
+        } else if (sscanf(line, "size %llu", &start) == 1) {
+            journal->size = start;
+            have_size = 1;
+        } else if (sscanf(line, "range %llu %llu %7s", &start, &end, mode) == 3 &&
+                   journal->count < ETDK_JOURNAL_MAX_RANGES && journal_parse_mode(mode) >= 0 && start <= end &&
+                   start == journal_done(journal)) {
+            etdk_journal_range_t *range = &journal->ranges[journal->count++];
+            range->start = start;
+            range->end = end;
+            range->mode = journal_parse_mode(mode);
+        } else {
+            valid = 0;
+        }
+    }
+    fclose(file);
+
+    if (!valid || !have_size || journal->target[0] == '\0' || journal_done(journal) > journal->size) {
+        return ETDK_ERROR_IO;
+    }
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Bytes encrypted by all runs so far
+ * @param journal Journal
+ * @return End of the last range (ranges are contiguous from 0)
+ */
+uint64_t journal_done(const etdk_journal_t *journal) {
+    return journal->count > 0 ? journal->ranges[journal->count - 1].end : 0;
+}
+
+/**
+ * @brief Open a new range for the current run at the end of the previous ones
+ * @param journal Journal
+ * @param mode ETDK_MODE_* of the current run
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO if ETDK_JOURNAL_MAX_RANGES runs are recorded
+ */
+int journal_begin_range(etdk_journal_t *journal, int mode) {
+    if (journal->count >= ETDK_JOURNAL_MAX_RANGES) {
+        return ETDK_ERROR_IO;
+    }
+
+    uint64_t start = journal_done(journal);
+    etdk_journal_range_t *range = &journal->ranges[journal->count++];
+    range->start = start;
+    range->end = start;
+    range->mode = mode;
+    return ETDK_SUCCESS;
+}
+
+/**
+ * @brief Atomically replace the journal file with the in-memory state
+ *
+ * Only call this after the data up to the last range's end has been
+ * flushed to the target, otherwise a crash could record ranges that
+ * never reached the device.
+ *
+ * @param path Journal file
+ * @param journal Journal to write
+ * @return ETDK_SUCCESS, or ETDK_ERROR_IO on failure
+ */
+int journal_commit(const char *path, const etdk_journal_t *journal) {
+    if (!path || !journal) {
+        return ETDK_ERROR_IO;
+    }
+
+    char temp_path[ETDK_JOURNAL_PATH_MAX + 8];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= (int)sizeof(temp_path)) {
+        return ETDK_ERROR_IO;
+    }
+
+    FILE *file = fopen(temp_path, "w");
+    if (!file) {
+        return ETDK_ERROR_IO;
+    }
+    fprintf(file, JOURNAL_MAGIC "\n");
+    fprintf(file, "target %s\n", journal->target);
+    fprintf(file, "size %llu\n", (unsigned long long)journal->size);
+    for (size_t i = 0; i < journal->count; i++) {
+        fprintf(file, "range %llu %llu %s\n", (unsigned long long)journal->ranges[i].start,
+                (unsigned long long)journal->ranges[i].end, journal_mode_name(journal->ranges[i].mode));
+    }
+
+    int ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return ETDK_ERROR_IO;
+    }
+
+#ifndef PLATFORM_WINDOWS
+    // Make the rename itself durable
+    char dir[ETDK_JOURNAL_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        slash[slash == dir ? 1 : 0] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    int dir_fd = open(dir, O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+#endif
+
+    return ETDK_SUCCESS;
+}
@@ -8,9 +8,16 @@
 
 #include "etdk.h"
 // cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 // cppcheck-suppress-end missingIncludeSystem
 
 /**
@@ -21,15 +28,52 @@ void print_usage(const char *program_name) {
     printf("ETDK v%s - Encrypt and Delete Key\n", ETDK_VERSION);
     printf("\"Makes data powerless\"\n");
     printf("Based on BSI recommendations (Germany)\n\n");
-    printf("Usage: %s <file|device>\n\n", program_name);
+    printf("Usage: %s [options] <file|device|directory>...\n", program_name);
+    printf("       %s bench [options]   (cipher and I/O benchmark, see %s bench --help)\n", program_name,
+           program_name);
+    printf("       %s decrypt [options] <file|device>...   (recovery with a saved key, see %s decrypt --help)\n\n",
+           program_name, program_name);
     printf("Description:\n");
-    printf("  Encrypts files or entire block devices with AES-256-CBC.\n");
+    printf("  Encrypts files or entire block devices with AES-256-CBC (or AES-256-XTS/CTR).\n");
     printf("  The encryption key is displayed once, then securely destroyed.\n");
     printf("  After encryption, the file/device is gibberish - worthless without the key.\n\n");
+    printf("Options:\n");
+    printf("  --mode <cbc|xts|ctr>     Cipher mode (default: cbc; with --in-place ctr for one file, xts for\n");
+    printf("                           several files or -r, ctr for any number with --manifest)\n");
+    printf("  --in-place               Encrypt files in place with CTR/XTS (same size, no temp file)\n");
+    printf("  -r, --recursive          Encrypt every file below a directory (CBC, or XTS with --in-place)\n");
+    printf("  --files-from <list>      Also encrypt the NUL-delimited paths in <list> (find -print0)\n");
+    printf("  --manifest <file>        One key per file derived from a session master key; <file> (new, not\n");
+    printf("                           on a target) lists the files, recovery needs it plus the master key\n");
+    printf("  --no-recovery            Overwrite with AES-CTR keystream of a throwaway key, never reading\n");
+    printf("                           the target (write-only, skips bad sectors, no key shown)\n");
+    printf("  --offload <op>           After encrypting a device let it discard|secure-discard|zeroout\n");
+    printf("                           every block itself (BLKDISCARD/BLKSECDISCARD/BLKZEROOUT)\n");
+    printf("  --offload-only           Run only the --offload pass, no host-side encryption\n");
+    printf("  --journal <file>         Record progress in <file> (not on the target) so a device or\n");
+    printf("                           --in-place file can be resumed after a crash or power loss\n");
+    printf("  --checkpoint <size>      Bytes between two journal checkpoints (default: 1G)\n");
+    printf("  --resume                 Continue after the last checkpoint in --journal with a fresh key\n");
+    printf("  --rate <bytes/s>         Limit throughput, K/M/G suffix allowed (token bucket)\n");
+    printf("  --iops <n>               Limit read/write requests per second\n");
+    printf("  --idle                   Use the idle I/O class: only touch the disk when nothing else does\n");
+    printf("  --nice <n>               CPU niceness for the run (e.g. 19)\n");
+    printf("  --progress-fd <n>        Write JSON-lines progress records to descriptor <n> >= 3 (e.g. 3 with 3>log)\n");
+    printf("  --direct                 Bypass the page cache (O_DIRECT) for devices\n");
+    printf("  --engine <sync|io_uring> Device I/O engine; with -r, io_uring batches small files (default: sync)\n");
+    printf("  --queue-depth <n>        Reads/writes in flight for io_uring (default: from the device queue)\n");
+    printf("  --chunk-size <size>      Bytes per I/O request, K/M/G suffix allowed (default: 4M, adjusted\n");
+    printf("                           to the device's optimal and maximum request size)\n");
+    printf("  --threads <n>            Cipher worker threads for XTS/CTR, file workers with -r (default: online CPUs)\n");
+    printf("  -h, --help               Show this help message\n\n");
     printf("Examples:\n");
     printf("  %s secret.txt              # Encrypt file\n", program_name);
     printf("  %s /dev/sdb                # Encrypt entire drive (requires root)\n", program_name);
-    printf("  %s /dev/sdb1               # Encrypt partition\n\n", program_name);
+    printf("  %s /dev/sdb1               # Encrypt partition\n", program_name);
+    printf("  %s -r ~/.cache/mozilla/    # Encrypt every file in a directory tree\n", program_name);
+    printf("  %s a.txt b.txt c.txt       # Encrypt several files with one key and one confirmation\n", program_name);
+    printf("  %s --direct /dev/nvme0n1   # Encrypt drive without polluting the page cache\n", program_name);
+    printf("  %s --engine io_uring --queue-depth 32 --chunk-size 4M /dev/nvme0n1\n\n", program_name);
     printf("To complete secure deletion:\n");
     printf("  1. Remove the encrypted file with normal methods (rm).\n");
     printf("  2. Forget the key if you don't need the data.\n");
@@ -40,11 +84,112 @@ void print_usage(const char *program_name) {
     printf("  - This DESTROYS all data permanently if you don't save the key!\n");
 }
 
+/**
+ * @brief Append the NUL-delimited paths of a list file to the target list
+ *
+ * The format matches find -print0 and xargs -0, so any byte except NUL
+ * can appear in a name. Empty entries are ignored. The file contents stay
+ * allocated for the lifetime of the process; the targets point into them.
+ *
+ * @param list_path File with NUL-delimited paths
+ * @param targets In/out: array of target paths (grown with realloc)
+ * @param count In/out: number of targets
+ * @return 0 on success, -1 on error (message printed)
+ */
+static int read_files_from(const char *list_path, const char ***targets, size_t *count) {
+    FILE *list = fopen(list_path, "rb");
+    if (!list) {
+        fprintf(stderr, "Error: Cannot open %s: %s\n", list_path, strerror(errno));
+        return -1;
+    }
+
+    char *data = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    while (1) {
+        if (len + 1 >= capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            char *grown = realloc(data, capacity);
+            if (!grown) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                free(data);
+                fclose(list);
+                return -1;
+            }
+            data = grown;
+        }
+        size_t n = fread(data + len, 1, capacity - len - 1, list);
+        if (n == 0)
+            break;
+        len += n;
+    }
+    if (ferror(list)) {
+        fprintf(stderr, "Error: Cannot read %s\n", list_path);
+        free(data);
+        fclose(list);
+        return -1;
+    }
+    fclose(list);
+    data[len] = '\0'; // Terminate a last entry without trailing NUL
+
+    for (size_t pos = 0; pos < len; pos += strlen(data + pos) + 1) {
+        if (data[pos] == '\0')
+            continue;
+        const char **grown = realloc(*targets, (*count + 1) * sizeof(char *));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return -1;
+        }
+        *targets = grown;
+        (*targets)[(*count)++] = data + pos;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Run a device offload pass over every target and report its timing
+ *
+ * The timing line matches the "Elapsed:" line of the host-side pass so
+ * both can be compared directly.
+ *
+ * @param targets Block devices to process
+ * @param count Number of targets
+ * @param op ETDK_OFFLOAD_* operation
+ * @return Number of targets the pass failed on
+ */
+static size_t run_offload(const char *const *targets, size_t count, int op) {
+    size_t failed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        printf("Offload pass: %s on %s\n", platform_offload_name(op), targets[i]);
+        uint64_t bytes = 0;
+        double start = platform_monotonic_seconds();
+        int result = platform_offload_device(targets[i], op, 1, &bytes);
+        double elapsed = platform_monotonic_seconds() - start;
+
+        if (result == ETDK_ERROR_PLATFORM) {
+            fprintf(stderr, "Error: %s does not support %s\n", targets[i], platform_offload_name(op));
+            failed++;
+        } else if (result != ETDK_SUCCESS) {
+            fprintf(stderr, "Error: %s failed on %s after %llu bytes: %s\n", platform_offload_name(op), targets[i],
+                    (unsigned long long)bytes, strerror(errno));
+            failed++;
+        }
+        if (bytes > 0 && elapsed > 0) {
+            printf("Offload: %.3f s (%.1f MB/s)\n", elapsed, bytes / (1024.0 * 1024.0) / elapsed);
+        }
+        printf("\n");
+    }
+
+    return failed;
+}
+
 /**
  * @brief Main entry point for ETDK application
  *
  * Implements the BSI-recommended "Encrypt-then-Delete-Key" method:
- * 1. Encrypt file/device with AES-256-CBC
+ * 1. Encrypt file/device with AES-256-CBC (or AES-256-XTS/CTR)
  * 2. Display encryption key once (for optional recovery)
  * 3. Securely wipe key from memory (7-pass Gutmann)
  * 4. Encrypted data is worthless without the key
@@ -54,43 +199,461 @@ void print_usage(const char *program_name) {
  * @return 0 on success, 1 on error
  */
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
+    etdk_options_t opts;
+    etdk_options_init(&opts);
+
+    // Bare "help" word is accepted in addition to -h/--help
+    if (argc == 2 && strcmp(argv[1], "help") == 0) {
         print_usage(argv[0]);
-        return 1;
+        return 0;
+    }
+
+    // Subcommands take over the whole command line
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        return bench_main(argc - 1, argv + 1, argv[0]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "decrypt") == 0) {
+        return decrypt_main(argc - 1, argv + 1, argv[0]);
+    }
+
+    int mode = -1; // Not chosen on the command line
+
+    int recursive = 0;
+    const char *files_from = NULL;
+    const char *manifest_path = NULL;
+    int offload = ETDK_OFFLOAD_NONE;
+    int offload_only = 0;
+    size_t rate = 0;
+    unsigned long iops = 0;
+    int idle_io = 0;
+    int nice_value = 0;
+    int set_nice = 0;
+
+    enum {
+        OPT_DIRECT = 256,
+        OPT_MODE,
+        OPT_IN_PLACE,
+        OPT_ENGINE,
+        OPT_QUEUE_DEPTH,
+        OPT_CHUNK_SIZE,
+        OPT_THREADS,
+        OPT_FILES_FROM,
+        OPT_NO_RECOVERY,
+        OPT_OFFLOAD,
+        OPT_OFFLOAD_ONLY,
+        OPT_JOURNAL,
+        OPT_CHECKPOINT,
+        OPT_RESUME,
+        OPT_RATE,
+        OPT_IOPS,
+        OPT_IDLE,
+        OPT_NICE,
+        OPT_PROGRESS_FD,
+        OPT_MANIFEST
+    };
+    static const struct option long_options[] = {
+        {"direct", no_argument, NULL, OPT_DIRECT},
+        {"mode", required_argument, NULL, OPT_MODE},
+        {"in-place", no_argument, NULL, OPT_IN_PLACE},
+        {"engine", required_argument, NULL, OPT_ENGINE},
+        {"queue-depth", required_argument, NULL, OPT_QUEUE_DEPTH},
+        {"chunk-size", required_argument, NULL, OPT_CHUNK_SIZE},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {"recursive", no_argument, NULL, 'r'},
+        {"files-from", required_argument, NULL, OPT_FILES_FROM},
+        {"no-recovery", no_argument, NULL, OPT_NO_RECOVERY},
+        {"offload", required_argument, NULL, OPT_OFFLOAD},
+        {"offload-only", no_argument, NULL, OPT_OFFLOAD_ONLY},
+        {"journal", required_argument, NULL, OPT_JOURNAL},
+        {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+        {"resume", no_argument, NULL, OPT_RESUME},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"iops", required_argument, NULL, OPT_IOPS},
+        {"idle", no_argument, NULL, OPT_IDLE},
+        {"nice", required_argument, NULL, OPT_NICE},
+        {"progress-fd", required_argument, NULL, OPT_PROGRESS_FD},
+        {"manifest", required_argument, NULL, OPT_MANIFEST},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hr", long_options, NULL)) != -1) {
+        switch (opt) {
+        case OPT_DIRECT:
+            opts.direct_io = 1;
+            break;
+        case OPT_MODE:
+            if (strcmp(optarg, "cbc") == 0) {
+                mode = ETDK_MODE_CBC;
+            } else if (strcmp(optarg, "xts") == 0) {
+                mode = ETDK_MODE_XTS;
+            } else if (strcmp(optarg, "ctr") == 0) {
+                mode = ETDK_MODE_CTR;
+            } else {
+                fprintf(stderr, "Error: Unknown mode '%s' (use cbc, xts or ctr)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_IN_PLACE:
+            opts.in_place = 1;
+            break;
+        case OPT_ENGINE:
+            if (strcmp(optarg, "sync") == 0) {
+                opts.io_engine = ETDK_ENGINE_SYNC;
+            } else if (strcmp(optarg, "io_uring") == 0) {
+                opts.io_engine = ETDK_ENGINE_IO_URING;
+            } else {
+                fprintf(stderr, "Error: Unknown engine '%s' (use sync or io_uring)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_QUEUE_DEPTH: {
+            char *end = NULL;
+            unsigned long depth = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || depth == 0 || depth > ETDK_MAX_QUEUE_DEPTH) {
+                fprintf(stderr, "Error: Queue depth must be between 1 and %d\n", ETDK_MAX_QUEUE_DEPTH);
+                return 1;
+            }
+            opts.queue_depth = (unsigned)depth;
+            break;
+        }
+        case OPT_THREADS: {
+            char *end = NULL;
+            unsigned long threads = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || threads == 0 || threads > ETDK_MAX_THREADS) {
+                fprintf(stderr, "Error: Threads must be between 1 and %d\n", ETDK_MAX_THREADS);
+                return 1;
+            }
+            opts.threads = (unsigned)threads;
+            break;
+        }
+        case OPT_CHUNK_SIZE:
+            if (etdk_parse_size(optarg, &opts.chunk_size) != 0 || opts.chunk_size % AES_BLOCK_SIZE != 0 ||
+                opts.chunk_size > (size_t)1024 * 1024 * 1024) {
+                fprintf(stderr, "Error: Invalid chunk size '%s' (multiple of %d bytes, at most 1G)\n", optarg,
+                        AES_BLOCK_SIZE);
+                return 1;
+            }
+            break;
+        case 'r':
+            recursive = 1;
+            break;
+        case OPT_FILES_FROM:
+            files_from = optarg;
+            break;
+        case OPT_MANIFEST:
+            manifest_path = optarg;
+            break;
+        case OPT_NO_RECOVERY:
+            opts.keystream_only = 1;
+            break;
+        case OPT_OFFLOAD:
+            if (strcmp(optarg, "discard") == 0) {
+                offload = ETDK_OFFLOAD_DISCARD;
+            } else if (strcmp(optarg, "secure-discard") == 0) {
+                offload = ETDK_OFFLOAD_SECURE_DISCARD;
+            } else if (strcmp(optarg, "zeroout") == 0) {
+                offload = ETDK_OFFLOAD_ZEROOUT;
+            } else {
+                fprintf(stderr, "Error: Unknown offload '%s' (use discard, secure-discard or zeroout)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_OFFLOAD_ONLY:
+            offload_only = 1;
+            break;
+        case OPT_JOURNAL:
+            opts.journal_path = optarg;
+            break;
+        case OPT_CHECKPOINT: {
+            size_t bytes;
+            if (etdk_parse_size(optarg, &bytes) != 0) {
+                fprintf(stderr, "Error: Invalid checkpoint interval '%s'\n", optarg);
+                return 1;
+            }
+            opts.checkpoint_bytes = bytes;
+            break;
+        }
+        case OPT_RESUME:
+            opts.resume = 1;
+            break;
+        case OPT_RATE:
+            if (etdk_parse_size(optarg, &rate) != 0) {
+                fprintf(stderr, "Error: Invalid rate '%s' (bytes per second, K/M/G suffix allowed)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_IOPS: {
+            char *end = NULL;
+            iops = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || iops == 0) {
+                fprintf(stderr, "Error: Invalid IOPS limit '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case OPT_IDLE:
+            idle_io = 1;
+            break;
+        case OPT_NICE: {
+            char *end = NULL;
+            long value = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || value < -20 || value > 19) {
+                fprintf(stderr, "Error: Niceness must be between -20 and 19\n");
+                return 1;
+            }
+            nice_value = (int)value;
+            set_nice = 1;
+            break;
+        }
+        case OPT_PROGRESS_FD: {
+            char *end = NULL;
+            long fd = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || fd < 0 || fd > 1024 || fcntl((int)fd, F_GETFD) == -1) {
+                fprintf(stderr, "Error: --progress-fd %s is not an open descriptor\n", optarg);
+                return 1;
+            }
+            // JSON lines on stdout or stderr would interleave with the report and the progress line
+            if (fd < 3) {
+                fprintf(stderr, "Error: --progress-fd needs a descriptor of its own (3 or higher, e.g. 3>log)\n");
+                return 1;
+            }
+            opts.progress_fd = (int)fd;
+            break;
+        }
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
     }
 
-    // Check for help flags
-    if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "help") == 0) {
+    // Targets: remaining arguments plus the optional NUL-delimited list
+    const char **targets = NULL;
+    size_t target_count = 0;
+    if (argc > optind) {
+        targets = malloc((size_t)(argc - optind) * sizeof(char *));
+        if (!targets) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 1;
+        }
+        for (int i = optind; i < argc; i++)
+            targets[target_count++] = argv[i];
+    }
+    if (files_from && read_files_from(files_from, &targets, &target_count) != 0) {
+        return 1;
+    }
+    if (target_count == 0) {
         print_usage(argv[0]);
-        return 0;
+        return 1;
+    }
+
+    // Check every target before anything is touched
+    size_t devices = 0;
+    size_t directories = 0;
+    for (size_t i = 0; i < target_count; i++) {
+        if (access(targets[i], F_OK) != 0) {
+            fprintf(stderr, "Error: Cannot access %s\n", targets[i]);
+            return 1;
+        }
+        if (platform_is_device(targets[i])) {
+            devices++;
+        } else if (platform_is_directory(targets[i])) {
+            if (!recursive) {
+                fprintf(stderr, "Error: %s is a directory (use --recursive)\n", targets[i]);
+                return 1;
+            }
+            directories++;
+        }
+    }
+    if (recursive && directories == 0) {
+        fprintf(stderr, "Error: --recursive requires a directory\n");
+        return 1;
+    }
+
+    const char *target_file = targets[0];
+    int is_device = devices == target_count;
+    int has_files = devices < target_count;
+
+    // Offload commands exist only for block devices
+    if (offload_only && offload == ETDK_OFFLOAD_NONE) {
+        fprintf(stderr, "Error: --offload-only requires --offload <op>\n");
+        return 1;
+    }
+    if (offload != ETDK_OFFLOAD_NONE && has_files) {
+        fprintf(stderr, "Error: --offload works on block devices only\n");
+        return 1;
+    }
+    if (offload_only && opts.keystream_only) {
+        fprintf(stderr, "Error: --offload-only replaces the host-side pass; drop --no-recovery\n");
+        return 1;
+    }
+
+    // Keystream-only overwrite: CTR keystream written in place, nothing read, key never shown
+    if (opts.keystream_only) {
+        if (mode >= 0 && mode != ETDK_MODE_CTR) {
+            fprintf(stderr, "Error: --no-recovery always writes %s keystream\n", crypto_mode_name(ETDK_MODE_CTR));
+            return 1;
+        }
+        mode = ETDK_MODE_CTR;
+        opts.in_place = 1;
+    }
+
+    // Journal: one in-place target, the journal kept elsewhere
+    if ((opts.resume || opts.checkpoint_bytes) && !opts.journal_path) {
+        fprintf(stderr, "Error: --resume and --checkpoint require --journal <file>\n");
+        return 1;
+    }
+    if (opts.journal_path) {
+        if (target_count != 1 || directories > 0 || offload_only || (!is_device && !opts.in_place)) {
+            fprintf(stderr, "Error: --journal works with one block device or one --in-place file\n");
+            return 1;
+        }
+        struct stat target_st, journal_st;
+        char journal_dir[4096];
+        snprintf(journal_dir, sizeof(journal_dir), "%s", opts.journal_path);
+        char *slash = strrchr(journal_dir, '/');
+        if (slash) {
+            slash[slash == journal_dir ? 1 : 0] = '\0';
+        } else {
+            strcpy(journal_dir, ".");
+        }
+        if (stat(target_file, &target_st) == 0 && stat(journal_dir, &journal_st) == 0 &&
+            ((is_device && journal_st.st_dev == target_st.st_rdev) ||
+             (stat(opts.journal_path, &journal_st) == 0 && journal_st.st_ino == target_st.st_ino &&
+              journal_st.st_dev == target_st.st_dev))) {
+            fprintf(stderr, "Error: The journal must not be stored on the target\n");
+            return 1;
+        }
+        if (!opts.resume && access(opts.journal_path, F_OK) == 0) {
+            fprintf(stderr, "Error: Journal %s exists (use --resume, or remove it to start over)\n",
+                    opts.journal_path);
+            return 1;
+        }
     }
 
-    char *target_file = argv[1];
+    // Session: every target gets a key derived from one master key, listed in the manifest
+    if (manifest_path) {
+        if (opts.keystream_only || offload_only || opts.journal_path) {
+            fprintf(stderr, "Error: --manifest cannot be combined with --no-recovery, --offload-only or --journal\n");
+            return 1;
+        }
+        if (access(manifest_path, F_OK) == 0) {
+            fprintf(stderr, "Error: Manifest %s exists (every session needs a new one)\n", manifest_path);
+            return 1;
+        }
+    }
 
-    // Check if target is a block device
-    int is_device = platform_is_device(target_file);
+    // One key and IV for several files: CTR would reuse the keystream across them (not with per-file keys)
+    int shared_key = target_count > 1 || directories > 0 || manifest_path;
+    if (shared_key && mode == ETDK_MODE_CTR && !opts.keystream_only && !manifest_path) {
+        fprintf(stderr, "Error: ctr cannot encrypt more than one file with one key (keystream reuse); use xts\n");
+        return 1;
+    }
 
-    if (is_device < 0) {
-        fprintf(stderr, "Error: Cannot access %s\n", target_file);
+    // In-place file encryption must preserve the size: CTR by default (XTS for several files), never CBC
+    if (mode < 0) {
+        if (has_files && opts.in_place) {
+            mode = shared_key && !manifest_path ? ETDK_MODE_XTS : ETDK_MODE_CTR;
+        } else {
+            mode = ETDK_MODE_CBC;
+        }
+    }
+    if (has_files && !opts.in_place && mode != ETDK_MODE_CBC) {
+        fprintf(stderr, "Error: %s for files requires --in-place\n", crypto_mode_name(mode));
+        return 1;
+    }
+    if (has_files && opts.in_place && mode == ETDK_MODE_CBC) {
+        fprintf(stderr, "Error: --in-place requires a length-preserving mode (ctr or xts)\n");
         return 1;
     }
 
     printf("\n");
     printf("ETDK v%s - Encrypt and Delete Key\n", ETDK_VERSION);
     printf("\n");
-    printf("Target: %s\n", target_file);
-    printf("Type:   %s\n", is_device ? "Block Device" : "Regular File");
-    printf("Method: Encrypt-then-Delete-Key\n\n");
+    if (target_count == 1) {
+        printf("Target: %s\n", target_file);
+        printf("Type:   %s\n", is_device ? "Block Device" : (recursive ? "Directory (recursive)" : "Regular File"));
+    } else {
+        printf("Targets: %zu (%zu files, %zu directories, %zu block devices)\n", target_count,
+               target_count - devices - directories, directories, devices);
+    }
+    if (offload_only) {
+        printf("Method: Device offload only (%s, no key)\n\n", platform_offload_name(offload));
+    } else {
+        printf("Method: %s\n",
+               opts.keystream_only ? "Keystream overwrite (no key, no recovery)" : "Encrypt-then-Delete-Key");
+        printf("Cipher: %s\n", crypto_mode_name(mode));
+        if (manifest_path)
+            printf("Keys:   one per target, derived from a session master key (manifest %s)\n", manifest_path);
+        if (offload != ETDK_OFFLOAD_NONE)
+            printf("Then:   %s\n", platform_offload_name(offload));
+        printf("\n");
+    }
 
-    if (is_device) {
+    if (is_device && target_count == 1) {
         uint64_t size;
         if (platform_get_device_size(target_file, &size) == ETDK_SUCCESS) {
             printf("Device size: %.2f GB (%llu bytes)\n\n", size / (1024.0 * 1024.0 * 1024.0),
                    (unsigned long long)size);
         }
+        platform_offload_caps_t caps;
+        if (offload != ETDK_OFFLOAD_NONE && platform_get_offload_caps(target_file, &caps) == ETDK_SUCCESS) {
+            printf("Offload support: discard %s, secure discard %s, write zeroes %s\n",
+                   caps.discard ? "yes" : "no", caps.secure_discard < 0 ? "unknown" : (caps.secure_discard ? "yes" : "no"),
+                   caps.write_zeroes ? "yes" : "no (kernel writes zero pages)");
+            if (caps.discard)
+                printf("                 discard granularity %llu bytes, at most %llu bytes per request\n",
+                       (unsigned long long)caps.discard_granularity, (unsigned long long)caps.discard_max_bytes);
+            printf("\n");
+        }
+    }
+
+    if (offload == ETDK_OFFLOAD_DISCARD) {
+        printf("NOTE: Discarded blocks may stay readable on some devices; zeroout or secure-discard do not.\n");
+    }
+    if (opts.resume) {
+        etdk_journal_t *journal = malloc(sizeof(etdk_journal_t));
+        if (!journal || journal_load(opts.journal_path, journal) != ETDK_SUCCESS) {
+            fprintf(stderr, "Error: Cannot read journal %s (missing or damaged)\n", opts.journal_path);
+            free(journal);
+            return 1;
+        }
+        uint64_t done = journal_done(journal);
+        uint64_t size = journal->size;
+        size_t runs = journal->count;
+        free(journal);
+        if (done >= size) {
+            printf("Journal: all %llu bytes are encrypted, nothing left to do.\n", (unsigned long long)size);
+            return 0;
+        }
+        printf("Journal: %llu of %llu bytes encrypted by %zu interrupted runs (their keys were never shown)\n\n",
+               (unsigned long long)done, (unsigned long long)size, runs);
     }
 
-    printf("WARNING: This will DESTROY all data on %s if you don't save the key!\n", target_file);
+    if (opts.keystream_only || offload_only) {
+        printf("WARNING: This will PERMANENTLY DESTROY all data on %s. No key will be shown!\n",
+               target_count == 1 ? target_file : "all targets");
+    } else if (target_count == 1) {
+        printf("WARNING: This will DESTROY all data on %s if you don't save the key!\n", target_file);
+    } else {
+        printf("WARNING: This will DESTROY all data on %zu targets if you don't save the key!\n", target_count);
+    }
+    if (rate || iops || idle_io || set_nice) {
+        printf("Throttle:");
+        if (rate)
+            printf(" %.1f MB/s", rate / (1024.0 * 1024.0));
+        if (iops)
+            printf(" %lu IOPS", iops);
+        if (idle_io)
+            printf(" idle I/O class");
+        if (set_nice)
+            printf(" nice %d", nice_value);
+        printf("\n");
+    }
     printf("Type YES to confirm: ");
     char confirm[10];
     if (fgets(confirm, sizeof(confirm), stdin) == NULL || strncmp(confirm, "YES\n", 4) != 0) {
@@ -99,23 +662,155 @@ int main(int argc, char *argv[]) {
     }
     printf("\n");
 
+    // No host-side pass: nothing is encrypted, so there is no key to create or show
+    if (offload_only) {
+        size_t failed = run_offload(targets, target_count, offload);
+        if (failed > 0) {
+            printf("OPERATION INCOMPLETE: %zu of %zu devices could not be processed (see errors above)\n\n", failed,
+                   target_count);
+            return 1;
+        }
+        printf("OPERATION SUCCESSFUL\n\n");
+        printf("Status:         %s (device offload, no key)\n\n",
+               offload == ETDK_OFFLOAD_ZEROOUT ? "ZEROED" : "DISCARDED");
+        return 0;
+    }
+
+    // Background mode: set before any worker thread starts, threads inherit it
+    if (idle_io && platform_set_idle_io_priority() != ETDK_SUCCESS) {
+        fprintf(stderr, "Warning: Cannot switch to the idle I/O class: %s\n", strerror(errno));
+    }
+    if (set_nice && platform_set_nice(nice_value) != ETDK_SUCCESS) {
+        fprintf(stderr, "Warning: Cannot set niceness %d: %s\n", nice_value, strerror(errno));
+    }
+    io_limiter_t limiter;
+    if ((rate || iops) && io_limiter_init(&limiter, rate, iops) == ETDK_SUCCESS) {
+        opts.limiter = &limiter;
+    }
+#ifdef SIGPIPE
+    // A progress reader that goes away must not kill the wipe; the stream just stops
+    if (opts.progress_fd >= 0) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+#endif
+
     crypto_context_t ctx;
     if (crypto_init(&ctx) != ETDK_SUCCESS) {
         fprintf(stderr, "Failed to initialize cryptography\n");
         return 1;
     }
+    ctx.mode = mode;
 
     // Lock key in memory to prevent swapping
     platform_lock_memory(&ctx, sizeof(ctx));
 
+    etdk_session_t *session = NULL;
+    if (manifest_path) {
+        session = session_create(manifest_path, mode);
+        if (!session) {
+            platform_unlock_memory(&ctx, sizeof(ctx));
+            crypto_cleanup(&ctx);
+            return 1;
+        }
+        opts.session = session;
+    }
+
     int result;
+    uint64_t target_size = 0;
+    etdk_tree_stats_t tree_stats = {0};
+    if (!shared_key) {
+        platform_get_device_size(target_file, &target_size);
+    }
+    double start_time = platform_monotonic_seconds();
+
+    if (shared_key) {
+        // Several targets, one key: devices one after another, files and trees in one worker pool
+        uint64_t encrypted = 0;
+        for (size_t i = 0; i < target_count; i++) {
+            if (!platform_is_device(targets[i]))
+                continue;
+            uint64_t size = 0;
+            uint64_t index = 0;
+            platform_get_device_size(targets[i], &size);
+            if (session && session_begin(session, targets[i], size, &ctx, &index) != ETDK_SUCCESS) {
+                tree_stats.failed++;
+                continue;
+            }
+            if (crypto_encrypt_device(targets[i], &ctx, &opts) == ETDK_SUCCESS) {
+                encrypted++;
+                target_size += size;
+                if (mode == ETDK_MODE_XTS)
+                    printf("Encrypted %s (%u-byte XTS data units)\n\n", targets[i], (unsigned)ctx.data_unit);
+            } else {
+                fprintf(stderr, "Device encryption failed: %s\n", targets[i]);
+                tree_stats.failed++;
+                session_fail(session, index);
+            }
+        }
+
+        if (has_files) {
+            const char **paths = malloc((target_count - devices) * sizeof(char *));
+            size_t path_count = 0;
+            if (!paths) {
+                fprintf(stderr, "Memory allocation failed\n");
+                tree_stats.failed += target_count - devices;
+            } else {
+                for (size_t i = 0; i < target_count; i++) {
+                    if (!platform_is_device(targets[i]))
+                        paths[path_count++] = targets[i];
+                }
+                uint64_t device_failures = tree_stats.failed;
+                result = crypto_encrypt_paths(paths, path_count, &ctx, &opts, &tree_stats);
+                // A fatal error counts no files: report the named paths as failed so the run ends incomplete
+                if (result != ETDK_SUCCESS && tree_stats.failed == 0)
+                    tree_stats.failed = path_count;
+                tree_stats.failed += device_failures;
+                if (result != ETDK_SUCCESS && result != ETDK_ERROR_IO) {
+                    fprintf(stderr, "File encryption failed\n");
+                }
+                free(paths);
+            }
+            encrypted += tree_stats.files;
+            target_size += tree_stats.bytes;
 
-    if (is_device) {
+            printf("Files encrypted: %llu (%.2f MB)\n", (unsigned long long)tree_stats.files,
+                   tree_stats.bytes / (1024.0 * 1024.0));
+            printf("Directories:     %llu\n", (unsigned long long)tree_stats.directories);
+            printf("Skipped:         %llu (symlinks, devices, sockets, FIFOs)\n",
+                   (unsigned long long)tree_stats.skipped);
+            printf("Failed:          %llu\n\n", (unsigned long long)tree_stats.failed);
+        }
+
+        // Anything that was encrypted still needs the key
+        if (encrypted == 0) {
+            fprintf(stderr, "Encryption failed\n");
+            progress_report_run(opts.progress_fd, ETDK_ERROR_IO, target_count, 0, platform_monotonic_seconds() - start_time,
+                                opts.limiter ? opts.limiter->slept : 0.0);
+            session_close(session);
+            platform_unlock_memory(&ctx, sizeof(ctx));
+            crypto_cleanup(&ctx);
+            return 1;
+        }
+    } else if (is_device) {
         // Encrypt entire block device
-        result = crypto_encrypt_device(target_file, &ctx);
+        result = crypto_encrypt_device(target_file, &ctx, &opts);
 
         if (result != ETDK_SUCCESS) {
             fprintf(stderr, "Device encryption failed\n");
+            progress_report_run(opts.progress_fd, ETDK_ERROR_IO, target_count, 0, platform_monotonic_seconds() - start_time,
+                                opts.limiter ? opts.limiter->slept : 0.0);
+            platform_unlock_memory(&ctx, sizeof(ctx));
+            crypto_cleanup(&ctx);
+            return 1;
+        }
+    } else if (opts.in_place) {
+        // Encrypt regular file in place: same blocks, same size, no temp file
+        result = crypto_encrypt_file_inplace(target_file, &ctx, &opts);
+
+        if (result != ETDK_SUCCESS) {
+            fprintf(stderr, "Encryption failed\n");
+            progress_report_run(opts.progress_fd, ETDK_ERROR_IO, target_count, 0, platform_monotonic_seconds() - start_time,
+                                opts.limiter ? opts.limiter->slept : 0.0);
             platform_unlock_memory(&ctx, sizeof(ctx));
             crypto_cleanup(&ctx);
             return 1;
@@ -127,10 +822,12 @@ int main(int argc, char *argv[]) {
         snprintf(temp_path, sizeof(temp_path), "%s.tmp_encrypted", target_file);
         snprintf(encrypted_path, sizeof(encrypted_path), "%s", target_file);
 
-        result = crypto_encrypt_file(target_file, temp_path, &ctx);
+        result = crypto_encrypt_file(target_file, temp_path, &ctx, &opts);
 
         if (result != ETDK_SUCCESS) {
             fprintf(stderr, "Encryption failed\n");
+            progress_report_run(opts.progress_fd, ETDK_ERROR_IO, target_count, 0, platform_monotonic_seconds() - start_time,
+                                opts.limiter ? opts.limiter->slept : 0.0);
             platform_unlock_memory(&ctx, sizeof(ctx));
             crypto_cleanup(&ctx);
             return 1;
@@ -140,14 +837,39 @@ int main(int argc, char *argv[]) {
         if (remove(target_file) != 0 || rename(temp_path, encrypted_path) != 0) {
             fprintf(stderr, "Failed to replace original file with encrypted version\n");
             remove(temp_path);
+            progress_report_run(opts.progress_fd, ETDK_ERROR_IO, target_count, 0, platform_monotonic_seconds() - start_time,
+                                opts.limiter ? opts.limiter->slept : 0.0);
             platform_unlock_memory(&ctx, sizeof(ctx));
             crypto_cleanup(&ctx);
             return 1;
         }
     }
 
-    // Display key
-    crypto_display_key(&ctx);
+    double elapsed = platform_monotonic_seconds() - start_time;
+    if (target_size > 0 && elapsed > 0) {
+        printf("Elapsed: %.3f s (%.1f MB/s)\n\n", elapsed, target_size / (1024.0 * 1024.0) / elapsed);
+    }
+    if (opts.limiter) {
+        printf("Rate limit: I/O held back for %.3f s in total\n\n", opts.limiter->slept);
+    }
+
+    size_t offload_failed = 0;
+    if (offload != ETDK_OFFLOAD_NONE) {
+        offload_failed = run_offload(targets, target_count, offload);
+    }
+    progress_report_run(opts.progress_fd, tree_stats.failed > 0 || offload_failed > 0 ? ETDK_ERROR_IO : ETDK_SUCCESS,
+                        target_count, target_size, elapsed, opts.limiter ? opts.limiter->slept : 0.0);
+
+    // Display key (a keystream overwrite has nothing to recover); a session shows only its master key
+    size_t manifest_failed = 0;
+    if (session) {
+        session_display(session);
+        if (session_close(session) != ETDK_SUCCESS)
+            manifest_failed = 1;
+        opts.session = NULL;
+    } else if (!opts.keystream_only) {
+        crypto_display_key(&ctx);
+    }
 
     // Wipe key from memory
     result = crypto_secure_wipe_key(&ctx);
@@ -159,10 +881,29 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    printf("OPERATION SUCCESSFUL\n");
+    if (tree_stats.failed > 0) {
+        printf("OPERATION INCOMPLETE: %llu entries could not be encrypted (see errors above)\n",
+               (unsigned long long)tree_stats.failed);
+    } else if (manifest_failed) {
+        printf("OPERATION INCOMPLETE: encrypted, but the manifest %s is incomplete (see errors above)\n",
+               manifest_path);
+    } else if (offload_failed > 0) {
+        printf("OPERATION INCOMPLETE: encrypted, but the %s pass failed on %zu devices\n", platform_offload_name(offload),
+               offload_failed);
+    } else {
+        printf("OPERATION SUCCESSFUL\n");
+    }
     printf("\n");
-    printf("Target:         %s\n", target_file);
-    printf("Status:         ENCRYPTED (AES-256-CBC)\n");
+    if (target_count == 1) {
+        printf("Target:         %s\n", target_file);
+    } else {
+        printf("Targets:        %zu\n", target_count);
+    }
+    if (opts.keystream_only) {
+        printf("Status:         OVERWRITTEN (%s keystream, key never shown)\n", crypto_mode_name(mode));
+    } else {
+        printf("Status:         ENCRYPTED (%s)\n", crypto_mode_name(mode));
+    }
     printf("Encryption key: SECURELY WIPED FROM MEMORY\n");
     printf("\n");
     printf("The file/device is now encrypted and permanently unrecoverable - worthless without the key.\n");
@@ -174,6 +915,8 @@ int main(int argc, char *argv[]) {
 
     platform_unlock_memory(&ctx, sizeof(ctx));
     crypto_cleanup(&ctx);
+    if (opts.limiter)
+        io_limiter_free(opts.limiter);
 
-    return 0;
+    return (tree_stats.failed > 0 || offload_failed > 0 || manifest_failed) ? 1 : 0;
 }
@@ -0,0 +1,441 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * Parallel Module - Reader / cipher worker pool / writer pipeline for devices
+ *
+ * One reader thread fills buffers, N cipher workers transform them and the
+ * calling thread writes them back. Stages hand chunk descriptors to each
+ * other through bounded lock-free MPMC ring buffers. With one worker the
+ * same engine is a three-stage read/encrypt/write pipeline that keeps
+ * chunk order, which is what the single-threaded CBC path uses.
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/** @brief Assumed cache line size, used to keep ring indices apart */
+#define CACHE_LINE 64
+
+/**
+ * @brief Chunk descriptor passed between stages
+ *
+ * A descriptor with len == 0 is an end-of-stream marker.
+ */
+typedef struct {
+    uint64_t offset; /**< Absolute offset of the chunk */
+    size_t len;      /**< Number of valid bytes in the buffer */
+    size_t buf;      /**< Index into the buffer pool */
+} chunk_desc_t;
+
+/**
+ * @brief One ring slot with its sequence number
+ */
+typedef struct {
+    atomic_size_t seq;  /**< Slot sequence (Vyukov bounded queue) */
+    chunk_desc_t desc;  /**< Payload */
+} ring_cell_t;
+
+/**
+ * @brief Bounded lock-free multi-producer multi-consumer ring
+ *
+ * Dmitry Vyukov's bounded MPMC queue: each slot carries a sequence number
+ * that tells producers and consumers whether it is free or filled, so no
+ * locks are needed and every operation is a single CAS on the index.
+ */
+typedef struct {
+    ring_cell_t *cells;                           /**< Capacity slots */
+    size_t mask;                                  /**< Capacity - 1 (power of two) */
+    _Alignas(CACHE_LINE) atomic_size_t enqueue;   /**< Next position to produce */
+    _Alignas(CACHE_LINE) atomic_size_t dequeue;   /**< Next position to consume */
+} ring_t;
+
+/**
+ * @brief Allocate a ring with at least min_capacity slots
+ * @return 0 on success, -1 on allocation failure
+ */
+static int ring_init(ring_t *ring, size_t min_capacity) {
+    size_t capacity = 2;
+    while (capacity < min_capacity)
+        capacity <<= 1;
+
+    ring->cells = calloc(capacity, sizeof(ring_cell_t));
+    if (!ring->cells)
+        return -1;
+
+    for (size_t i = 0; i < capacity; i++)
+        atomic_init(&ring->cells[i].seq, i);
+    ring->mask = capacity - 1;
+    atomic_init(&ring->enqueue, 0);
+    atomic_init(&ring->dequeue, 0);
+    return 0;
+}
+
+/**
+ * @brief Release ring storage
+ */
+static void ring_free(ring_t *ring) {
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+/**
+ * @brief Try to append a descriptor
+ * @return 1 on success, 0 if the ring is full
+ */
+static int ring_try_push(ring_t *ring, const chunk_desc_t *desc) {
+    size_t pos = atomic_load_explicit(&ring->enqueue, memory_order_relaxed);
+
+    while (1) {
+        ring_cell_t *cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->desc = *desc;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&ring->enqueue, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Try to remove the oldest descriptor
+ * @return 1 on success, 0 if the ring is empty
+ */
+static int ring_try_pop(ring_t *ring, chunk_desc_t *desc) {
+    size_t pos = atomic_load_explicit(&ring->dequeue, memory_order_relaxed);
+
+    while (1) {
+        ring_cell_t *cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeue, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *desc = cell->desc;
+                atomic_store_explicit(&cell->seq, pos + ring->mask + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&ring->dequeue, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Back off while waiting on a ring
+ *
+ * Yields for the first rounds, then sleeps briefly so idle stages do not
+ * burn a core while the device is the bottleneck.
+ *
+ * @param spins Per-wait counter, incremented on every call
+ */
+static void ring_backoff(unsigned *spins) {
+    if (++*spins < 64) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 50000}; // 50 us
+        nanosleep(&ts, NULL);
+    }
+}
+
+/**
+ * @brief Append a descriptor, waiting while the ring is full
+ */
+static void ring_push(ring_t *ring, const chunk_desc_t *desc) {
+    unsigned spins = 0;
+    while (!ring_try_push(ring, desc))
+        ring_backoff(&spins);
+}
+
+/**
+ * @brief Remove a descriptor, waiting while the ring is empty
+ */
+static void ring_pop(ring_t *ring, chunk_desc_t *desc) {
+    unsigned spins = 0;
+    while (!ring_try_pop(ring, desc))
+        ring_backoff(&spins);
+}
+
+/**
+ * @brief State shared by all pipeline stages
+ */
+typedef struct {
+    int fd;                          /**< Target descriptor */
+    uint64_t offset;                 /**< First byte to process */
+    uint64_t end;                    /**< Byte offset to stop at */
+    size_t chunk_size;               /**< Bytes per chunk */
+    const io_buffer_pool_t *pool;    /**< Chunk buffers */
+    unsigned threads;                /**< Number of cipher workers */
+    io_transform_fn transform;       /**< Order-independent in-place transform */
+    void *const *worker_args;        /**< One transform argument per worker */
+    ring_t free_ring;                /**< Writer -> reader: empty buffers */
+    ring_t work_ring;                /**< Reader -> workers: filled buffers */
+    ring_t done_ring;                /**< Workers -> writer: transformed buffers */
+    atomic_int error;                /**< First error code, ETDK_SUCCESS if none */
+    double read_busy;                /**< Reader: seconds in pread() (reader thread only) */
+    double read_idle;                /**< Reader: seconds waiting for a free buffer */
+} parallel_job_t;
+
+/**
+ * @brief Worker thread argument
+ */
+typedef struct {
+    parallel_job_t *job; /**< Shared state */
+    void *arg;           /**< This worker's transform argument */
+    double busy;         /**< Seconds in the transform */
+    double idle;         /**< Seconds waiting for a filled buffer */
+} worker_t;
+
+/**
+ * @brief Record the first error so all stages wind down
+ */
+static void set_error(parallel_job_t *job, int code) {
+    int expected = ETDK_SUCCESS;
+    atomic_compare_exchange_strong(&job->error, &expected, code);
+}
+
+/**
+ * @brief Reader stage: pread chunks into free buffers
+ */
+static void *reader_main(void *arg) {
+    parallel_job_t *job = arg;
+    uint64_t offset = job->offset;
+
+    while (offset < job->end && atomic_load(&job->error) == ETDK_SUCCESS) {
+        // Wait for an empty buffer, but give up as soon as another stage failed
+        chunk_desc_t desc;
+        unsigned spins = 0;
+        int have_buffer;
+        double t0 = platform_monotonic_seconds();
+        while (!(have_buffer = ring_try_pop(&job->free_ring, &desc)) && atomic_load(&job->error) == ETDK_SUCCESS)
+            ring_backoff(&spins);
+        double t1 = platform_monotonic_seconds();
+        job->read_idle += t1 - t0;
+        if (!have_buffer)
+            break;
+
+        size_t want = job->chunk_size;
+        if (job->end - offset < want)
+            want = (size_t)(job->end - offset);
+
+        size_t got = 0;
+        int status = io_pread_full(job->fd, job->pool->buffers[desc.buf], want, offset, &got);
+        job->read_busy += platform_monotonic_seconds() - t1;
+        if (status != ETDK_SUCCESS) {
+            perror("\nError reading input");
+            set_error(job, ETDK_ERROR_IO);
+            break;
+        }
+        if (got == 0)
+            break;
+
+        desc.offset = offset;
+        desc.len = got;
+        ring_push(&job->work_ring, &desc);
+
+        offset += got;
+        if (got < want)
+            break; // End of device
+    }
+
+    // One end-of-stream marker per worker
+    chunk_desc_t eos = {0, 0, 0};
+    for (unsigned i = 0; i < job->threads; i++)
+        ring_push(&job->work_ring, &eos);
+
+    return NULL;
+}
+
+/**
+ * @brief Cipher worker stage: transform chunks with a private context
+ */
+static void *worker_main(void *arg) {
+    worker_t *worker = arg;
+    parallel_job_t *job = worker->job;
+
+    while (1) {
+        chunk_desc_t desc;
+        double t0 = platform_monotonic_seconds();
+        ring_pop(&job->work_ring, &desc);
+        double t1 = platform_monotonic_seconds();
+        worker->idle += t1 - t0;
+
+        /* A chunk that was read is transformed even after an error (the
+         * writer drops it): a transform may publish state the next chunk's
+         * worker is waiting for, like the CBC decryption chain. The reader
+         * has stopped, so this is at most one chunk per pool buffer.
+         */
+        if (desc.len > 0) {
+            int result = job->transform(worker->arg, job->pool->buffers[desc.buf], desc.len, desc.offset);
+            if (result != ETDK_SUCCESS)
+                set_error(job, result);
+            worker->busy += platform_monotonic_seconds() - t1;
+        }
+
+        ring_push(&job->done_ring, &desc);
+        if (desc.len == 0)
+            break;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Transform a byte range in place with a reader, N cipher workers and a writer
+ *
+ * The calling thread acts as writer. Chunks complete in any order and are
+ * written back to their own offset, so with several workers the transform
+ * must not depend on the order of chunks (e.g. XTS). With one worker the
+ * transform sees the chunks in ascending offset order, so a CBC chain
+ * stays valid while the read of the next chunk and the write of the
+ * previous one overlap with encryption. Each worker passes its own entry
+ * of worker_args to the transform, which lets every worker own a private
+ * cipher context. The pool should hold at least 2 * threads + 2 buffers
+ * so the reader and writer can run ahead of the workers.
+ *
+ * Time spent working and waiting is measured per stage and returned in
+ * stats (cipher times are summed over all workers).
+ */
+int io_parallel_engine_run(int fd, uint64_t offset, uint64_t end, const io_buffer_pool_t *pool, size_t chunk_size,
+                           unsigned threads, io_transform_fn transform, void *const *worker_args,
+                           io_progress_fn progress, void *progress_arg, io_pipeline_stats_t *stats) {
+    if (!pool || !transform || !worker_args || threads == 0 || chunk_size == 0 || chunk_size > pool->size ||
+        pool->count < 2) {
+        return ETDK_ERROR_IO;
+    }
+
+    parallel_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.offset = offset;
+    job.end = end;
+    job.chunk_size = chunk_size;
+    job.pool = pool;
+    job.threads = threads;
+    job.transform = transform;
+    job.worker_args = worker_args;
+    atomic_init(&job.error, ETDK_SUCCESS);
+
+    // Every ring can hold all buffers plus the end-of-stream markers, so pushes never wait
+    size_t capacity = pool->count + threads;
+    if (ring_init(&job.free_ring, capacity) != 0 || ring_init(&job.work_ring, capacity) != 0 ||
+        ring_init(&job.done_ring, capacity) != 0) {
+        ring_free(&job.free_ring);
+        ring_free(&job.work_ring);
+        ring_free(&job.done_ring);
+        return ETDK_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < pool->count; i++) {
+        chunk_desc_t desc = {0, 0, i};
+        ring_push(&job.free_ring, &desc);
+    }
+
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    if (!workers || !tids) {
+        free(workers);
+        free(tids);
+        ring_free(&job.free_ring);
+        ring_free(&job.work_ring);
+        ring_free(&job.done_ring);
+        return ETDK_ERROR_MEMORY;
+    }
+
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, reader_main, &job) != 0) {
+        free(workers);
+        free(tids);
+        ring_free(&job.free_ring);
+        ring_free(&job.work_ring);
+        ring_free(&job.done_ring);
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    unsigned started = 0;
+    for (; started < threads; started++) {
+        workers[started].job = &job;
+        workers[started].arg = worker_args[started];
+        if (pthread_create(&tids[started], NULL, worker_main, &workers[started]) != 0)
+            break;
+    }
+
+    if (started < threads) {
+        // The reader stops and the running workers drain what was already read
+        set_error(&job, ETDK_ERROR_PLATFORM);
+    }
+
+    // Writer stage (this thread): write back and recycle buffers until every worker has finished
+    uint64_t written = 0;
+    unsigned finished = 0;
+    double write_busy = 0.0;
+    double write_idle = 0.0;
+    while (finished < started) {
+        chunk_desc_t desc;
+        double t0 = platform_monotonic_seconds();
+        ring_pop(&job.done_ring, &desc);
+        double t1 = platform_monotonic_seconds();
+        write_idle += t1 - t0;
+
+        if (desc.len == 0) {
+            finished++;
+            continue;
+        }
+
+        if (atomic_load(&job.error) == ETDK_SUCCESS) {
+            if (io_pwrite_full(fd, pool->buffers[desc.buf], desc.len, desc.offset) != ETDK_SUCCESS) {
+                perror("\nError writing output");
+                set_error(&job, ETDK_ERROR_IO);
+            } else {
+                written += desc.len;
+                if (progress)
+                    progress(progress_arg, job.offset + written);
+            }
+            write_busy += platform_monotonic_seconds() - t1;
+        }
+
+        ring_push(&job.free_ring, &desc);
+    }
+
+    pthread_join(reader, NULL);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->read_busy = job.read_busy;
+        stats->read_idle = job.read_idle;
+        for (unsigned i = 0; i < started; i++) {
+            stats->cipher_busy += workers[i].busy;
+            stats->cipher_idle += workers[i].idle;
+        }
+        stats->write_busy = write_busy;
+        stats->write_idle = write_idle;
+    }
+
+    free(workers);
+    free(tids);
+    ring_free(&job.free_ring);
+    ring_free(&job.work_ring);
+    ring_free(&job.done_ring);
+
+    return atomic_load(&job.error);
+}
@@ -6,6 +6,7 @@
 #include "etdk.h"
 // cppcheck-suppress-begin missingIncludeSystem
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #ifdef PLATFORM_WINDOWS
@@ -14,12 +15,18 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef PLATFORM_LINUX
+#include <errno.h>
 #include <linux/fs.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #endif
 #ifdef PLATFORM_MACOS
 #include <sys/disk.h>
+#include <sys/sysctl.h>
 #endif
 #endif
 // cppcheck-suppress-end missingIncludeSystem
@@ -116,6 +123,195 @@ int platform_get_device_size(const char *device_path, uint64_t *size) {
     return ETDK_SUCCESS;
 }
 
+#ifdef PLATFORM_LINUX
+/**
+ * @brief Read a numeric queue attribute of a block device from sysfs
+ *
+ * Looks in /sys/dev/block/<major>:<minor>/queue, which is the same
+ * directory as /sys/block/<dev>/queue. Partitions have no queue directory
+ * of their own, so the parent disk's is used for them.
+ *
+ * @param st stat() result of the block device
+ * @param name Attribute name, e.g. "discard_max_bytes"
+ * @param value Pointer where the value will be stored
+ * @return 0 on success, -1 if the attribute cannot be read
+ */
+static int read_queue_attribute(const struct stat *st, const char *name, uint64_t *value) {
+    static const char *const layouts[] = {"/sys/dev/block/%u:%u/queue/%s", "/sys/dev/block/%u:%u/../queue/%s"};
+
+    for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        char path[128];
+        snprintf(path, sizeof(path), layouts[i], major(st->st_rdev), minor(st->st_rdev), name);
+        FILE *attr = fopen(path, "r");
+        if (!attr)
+            continue;
+        unsigned long long v;
+        int ok = fscanf(attr, "%llu", &v) == 1;
+        fclose(attr);
+        if (ok) {
+            *value = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+#endif
+
+/**
+ * @brief Get size and I/O topology of a device or file
+ *
+ * Everything the engines need to pick buffer alignment, chunk size and
+ * queue depth, read through a single descriptor instead of one open()
+ * per property.
+ *
+ * Platform-specific implementation:
+ * - Linux: ioctl() with BLKGETSIZE64, BLKSSZGET, BLKPBSZGET, BLKIOMIN,
+ *   BLKIOOPT and BLKROTATIONAL; max_hw_sectors_kb, nr_requests (and
+ *   rotational on kernels without the ioctl) from /sys/block/<dev>/queue.
+ *   Regular files report st_size and st_blksize.
+ * - Windows/macOS: Size and sector sizes only
+ *
+ * @param device_path Path to the device or file
+ * @param info Pointer where the topology will be stored
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int platform_get_device_info(const char *device_path, platform_device_info_t *info) {
+    if (!device_path || !info) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->logical_sector = 512;
+    info->physical_sector = 512;
+    info->rotational = -1;
+
+#ifdef PLATFORM_LINUX
+    int fd = open(device_path, O_RDONLY);
+    if (fd < 0) {
+        return ETDK_ERROR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return ETDK_ERROR_IO;
+    }
+
+    if (!S_ISBLK(st.st_mode)) {
+        // Regular file: the filesystem block size is the direct I/O alignment
+        info->size = (uint64_t)st.st_size;
+        if (st.st_blksize >= 512)
+            info->physical_sector = (uint32_t)st.st_blksize;
+        close(fd);
+        return ETDK_SUCCESS;
+    }
+
+    info->is_device = 1;
+    if (ioctl(fd, BLKGETSIZE64, &info->size) < 0) {
+        close(fd);
+        return ETDK_ERROR_IO;
+    }
+    int lbs = 0;
+    unsigned int pbs = 0, io_min = 0, io_opt = 0;
+    unsigned short rotational = 0;
+    if (ioctl(fd, BLKSSZGET, &lbs) == 0 && lbs > 0)
+        info->logical_sector = (uint32_t)lbs;
+    info->physical_sector = (ioctl(fd, BLKPBSZGET, &pbs) == 0 && pbs >= info->logical_sector) ? pbs
+                                                                                                : info->logical_sector;
+    if (ioctl(fd, BLKIOMIN, &io_min) == 0)
+        info->minimum_io = io_min;
+    if (ioctl(fd, BLKIOOPT, &io_opt) == 0)
+        info->optimal_io = io_opt;
+    if (ioctl(fd, BLKROTATIONAL, &rotational) == 0)
+        info->rotational = rotational ? 1 : 0;
+    close(fd);
+
+    uint64_t value;
+    if (info->rotational < 0 && read_queue_attribute(&st, "rotational", &value) == 0)
+        info->rotational = value ? 1 : 0;
+    if (read_queue_attribute(&st, "max_hw_sectors_kb", &value) == 0)
+        info->max_hw_bytes = value * 1024;
+    if (read_queue_attribute(&st, "nr_requests", &value) == 0)
+        info->nr_requests = (uint32_t)value;
+    return ETDK_SUCCESS;
+#else
+    int result = platform_get_device_size(device_path, &info->size);
+    if (result != ETDK_SUCCESS) {
+        return result;
+    }
+    info->is_device = platform_is_device(device_path);
+    return platform_get_sector_size(device_path, &info->logical_sector, &info->physical_sector);
+#endif
+}
+
+/**
+ * @brief Get the logical and physical sector size of a device or file
+ *
+ * The logical sector size is the smallest unit the device can address;
+ * the physical sector size is the unit it writes internally. O_DIRECT
+ * buffers, offsets and lengths must be aligned to these sizes.
+ *
+ * Platform-specific implementation:
+ * - Linux: Uses ioctl() with BLKSSZGET/BLKPBSZGET, st_blksize for files
+ * - macOS: Uses ioctl() with DKIOCGETBLOCKSIZE/DKIOCGETPHYSICALBLOCKSIZE
+ * - Windows: Reports 512-byte sectors
+ *
+ * @param device_path Path to the device or file
+ * @param logical Pointer where the logical sector size will be stored
+ * @param physical Pointer where the physical sector size will be stored
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int platform_get_sector_size(const char *device_path, uint32_t *logical, uint32_t *physical) {
+    if (!device_path || !logical || !physical) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    *logical = 512;
+    *physical = 512;
+
+#ifdef PLATFORM_WINDOWS
+    (void)device_path;
+#else
+    int fd = open(device_path, O_RDONLY);
+    if (fd < 0) {
+        return ETDK_ERROR_IO;
+    }
+
+#if defined(PLATFORM_LINUX)
+    /* Linux: BLKSSZGET returns the logical sector size (int),
+     * BLKPBSZGET the physical sector size (unsigned int)
+     */
+    int lbs = 0;
+    unsigned int pbs = 0;
+    if (ioctl(fd, BLKSSZGET, &lbs) == 0 && lbs > 0) {
+        *logical = (uint32_t)lbs;
+        *physical = (ioctl(fd, BLKPBSZGET, &pbs) == 0 && pbs >= (unsigned int)lbs) ? pbs : (uint32_t)lbs;
+        close(fd);
+        return ETDK_SUCCESS;
+    }
+#elif defined(PLATFORM_MACOS)
+    uint32_t lbs = 0;
+    uint32_t pbs = 0;
+    if (ioctl(fd, DKIOCGETBLOCKSIZE, &lbs) == 0 && lbs > 0) {
+        *logical = lbs;
+        *physical = (ioctl(fd, DKIOCGETPHYSICALBLOCKSIZE, &pbs) == 0 && pbs >= lbs) ? pbs : lbs;
+        close(fd);
+        return ETDK_SUCCESS;
+    }
+#endif
+
+    /* Not a block device: use the filesystem's preferred block size
+     * as physical alignment for direct I/O on regular files
+     */
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_blksize >= 512) {
+        *physical = (uint32_t)st.st_blksize;
+    }
+    close(fd);
+#endif
+
+    return ETDK_SUCCESS;
+}
+
 /**
  * @brief Check if a path points to a block device
  *
@@ -148,6 +344,26 @@ int platform_is_device(const char *path) {
 #endif
 }
 
+/**
+ * @brief Check if a path points to a directory
+ *
+ * Symbolic links are followed, so a link to a directory counts as one.
+ *
+ * @param path Path to check
+ * @return 1 if path is a directory, 0 otherwise
+ */
+int platform_is_directory(const char *path) {
+    if (!path)
+        return 0;
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return 0;
+    }
+
+    return S_ISDIR(st.st_mode) ? 1 : 0;
+}
+
 /**
  * @brief Lock memory pages to prevent swapping to disk
  *
@@ -191,3 +407,324 @@ int platform_unlock_memory(void *addr, size_t len) {
     return (munlock(addr, len) == 0) ? ETDK_SUCCESS : ETDK_ERROR_PLATFORM;
 #endif
 }
+
+/**
+ * @brief Move the process into the idle I/O scheduling class
+ *
+ * Idle-class requests are only dispatched when no other process has I/O
+ * pending on the device, so a background wipe does not add to the latency
+ * of the services still running on the host. Call this before starting
+ * threads; they inherit the class.
+ *
+ * Platform-specific implementation:
+ * - Linux: ioprio_set(IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE), honoured
+ *   by the BFQ and CFQ schedulers; mq-deadline and none ignore it
+ * - macOS: setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, IOPOL_THROTTLE)
+ * - Windows: PROCESS_MODE_BACKGROUND_BEGIN (low I/O and memory priority)
+ *
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_PLATFORM on failure
+ */
+int platform_set_idle_io_priority(void) {
+#if defined(PLATFORM_WINDOWS)
+    return SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN) ? ETDK_SUCCESS : ETDK_ERROR_PLATFORM;
+#elif defined(PLATFORM_LINUX) && defined(SYS_ioprio_set)
+    // Values from linux/ioprio.h, which not every libc ships
+    const int ioprio_who_process = 1;
+    const int ioprio_class_idle = 3;
+    const int ioprio_class_shift = 13;
+    return syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_class_idle << ioprio_class_shift) == 0
+               ? ETDK_SUCCESS
+               : ETDK_ERROR_PLATFORM;
+#elif defined(PLATFORM_MACOS)
+    return setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, IOPOL_THROTTLE) == 0 ? ETDK_SUCCESS
+                                                                                     : ETDK_ERROR_PLATFORM;
+#else
+    return ETDK_ERROR_PLATFORM;
+#endif
+}
+
+/**
+ * @brief Set the CPU scheduling niceness of the process
+ *
+ * Lowers the priority of the cipher work so it only uses CPU time other
+ * processes leave idle. Call before starting threads; they inherit it.
+ *
+ * Platform-specific implementation:
+ * - Unix: setpriority(PRIO_PROCESS, 0, value)
+ * - Windows: IDLE_PRIORITY_CLASS for positive values
+ *
+ * @param value Niceness from -20 (highest) to 19 (lowest); negative values need privileges
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_PLATFORM on failure
+ */
+int platform_set_nice(int value) {
+#ifdef PLATFORM_WINDOWS
+    return SetPriorityClass(GetCurrentProcess(), value > 0 ? IDLE_PRIORITY_CLASS : NORMAL_PRIORITY_CLASS)
+               ? ETDK_SUCCESS
+               : ETDK_ERROR_PLATFORM;
+#else
+    return setpriority(PRIO_PROCESS, 0, value) == 0 ? ETDK_SUCCESS : ETDK_ERROR_PLATFORM;
+#endif
+}
+
+/**
+ * @brief Read a monotonic clock in seconds
+ *
+ * Used for elapsed-time and throughput reporting. The origin is
+ * arbitrary, only differences between two readings are meaningful.
+ *
+ * Platform-specific implementation:
+ * - Windows: Uses QueryPerformanceCounter()
+ * - Unix: Uses clock_gettime(CLOCK_MONOTONIC)
+ *
+ * @return Seconds since an unspecified starting point
+ */
+double platform_monotonic_seconds(void) {
+#ifdef PLATFORM_WINDOWS
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * @brief CPU time consumed by the calling thread
+ *
+ * Used by the cipher benchmark to turn CPU time into cycles per byte
+ * independently of how busy the rest of the machine is.
+ *
+ * Platform-specific implementation:
+ * - Windows: Uses GetThreadTimes()
+ * - Unix: Uses clock_gettime(CLOCK_THREAD_CPUTIME_ID)
+ *
+ * @return Seconds of user and system time of this thread
+ */
+double platform_thread_cpu_seconds(void) {
+#ifdef PLATFORM_WINDOWS
+    FILETIME creation, exit_time, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit_time, &kernel, &user))
+        return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (double)(k.QuadPart + u.QuadPart) / 1e7; // 100 ns units
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0.0;
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * @brief Nominal CPU clock rate
+ *
+ * Cycles per byte are derived from CPU time times this rate, so with
+ * turbo or power saving they are an approximation, like every figure
+ * based on the nominal clock.
+ *
+ * Platform-specific implementation:
+ * - Linux: cpufreq base_frequency, then cpuinfo_max_freq, then "cpu MHz" in /proc/cpuinfo
+ * - macOS: sysctl hw.cpufrequency (not available on Apple silicon)
+ * - Windows: not implemented
+ *
+ * @return Cycles per second, 0 if unknown
+ */
+uint64_t platform_cpu_hz(void) {
+#ifdef PLATFORM_LINUX
+    static const char *const sources[] = {"/sys/devices/system/cpu/cpu0/cpufreq/base_frequency",
+                                          "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq"};
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        FILE *file = fopen(sources[i], "r");
+        unsigned long long khz = 0;
+        if (file) {
+            int ok = fscanf(file, "%llu", &khz) == 1;
+            fclose(file);
+            if (ok && khz > 0)
+                return (uint64_t)khz * 1000;
+        }
+    }
+
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo) {
+        char line[256];
+        double mhz = 0.0;
+        while (fgets(line, sizeof(line), cpuinfo)) {
+            if (sscanf(line, "cpu MHz : %lf", &mhz) == 1 && mhz > 0)
+                break;
+        }
+        fclose(cpuinfo);
+        if (mhz > 0)
+            return (uint64_t)(mhz * 1e6);
+    }
+    return 0;
+#elif defined(PLATFORM_MACOS)
+    uint64_t hz = 0;
+    size_t len = sizeof(hz);
+    if (sysctlbyname("hw.cpufrequency", &hz, &len, NULL, 0) != 0)
+        return 0;
+    return hz;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Probe the offload commands of a block device
+ *
+ * Discard and write-zeroes support are advertised by the block layer in
+ * /sys/block/<dev>/queue (discard_max_bytes, write_zeroes_max_bytes; zero
+ * means unsupported). Secure discard has no sysfs attribute, so it is
+ * reported as unknown on devices that discard at all and is only known
+ * once BLKSECDISCARD is issued. BLKZEROOUT works on every block device:
+ * without a write-zeroes command the kernel writes zero pages itself.
+ *
+ * Platform-specific implementation:
+ * - Linux: Reads /sys/dev/block/<major>:<minor>/queue
+ * - Windows/macOS: Not supported
+ *
+ * @param device_path Path to the block device
+ * @param caps Pointer where the capabilities will be stored
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+int platform_get_offload_caps(const char *device_path, platform_offload_caps_t *caps) {
+    if (!device_path || !caps) {
+        return ETDK_ERROR_PLATFORM;
+    }
+    memset(caps, 0, sizeof(*caps));
+
+#ifdef PLATFORM_LINUX
+    struct stat st;
+    if (stat(device_path, &st) != 0) {
+        return ETDK_ERROR_IO;
+    }
+    if (!S_ISBLK(st.st_mode)) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    read_queue_attribute(&st, "discard_granularity", &caps->discard_granularity);
+    read_queue_attribute(&st, "discard_max_bytes", &caps->discard_max_bytes);
+    read_queue_attribute(&st, "write_zeroes_max_bytes", &caps->write_zeroes_max_bytes);
+
+    caps->discard = caps->discard_max_bytes > 0;
+    caps->secure_discard = caps->discard ? -1 : 0;
+    caps->write_zeroes = caps->write_zeroes_max_bytes > 0;
+    return ETDK_SUCCESS;
+#else
+    return ETDK_ERROR_PLATFORM;
+#endif
+}
+
+/**
+ * @brief Human readable name of an offload operation
+ * @param op ETDK_OFFLOAD_* value
+ * @return Name of the ioctl that implements it
+ */
+const char *platform_offload_name(int op) {
+    switch (op) {
+    case ETDK_OFFLOAD_DISCARD:
+        return "BLKDISCARD";
+    case ETDK_OFFLOAD_SECURE_DISCARD:
+        return "BLKSECDISCARD";
+    case ETDK_OFFLOAD_ZEROOUT:
+        return "BLKZEROOUT";
+    default:
+        return "none";
+    }
+}
+
+/**
+ * @brief Discard or zero an entire block device with device commands
+ *
+ * The device is processed in ETDK_OFFLOAD_RANGE pieces; the kernel splits
+ * each piece into requests of at most discard_max_bytes or
+ * write_zeroes_max_bytes. Each ioctl also drops the page cache for its
+ * range, so later reads see what the device returns.
+ *
+ * Platform-specific implementation:
+ * - Linux: ioctl() with BLKDISCARD, BLKSECDISCARD or BLKZEROOUT
+ * - Windows/macOS: Not supported
+ *
+ * @param device_path Path to the block device
+ * @param op ETDK_OFFLOAD_* operation
+ * @param show_progress Non-zero to print progress after every range
+ * @param bytes Pointer where the number of bytes processed will be stored (may be NULL)
+ * @return ETDK_SUCCESS on success, ETDK_ERROR_PLATFORM if the device does
+ *         not support @p op, ETDK_ERROR_IO on other failures
+ */
+int platform_offload_device(const char *device_path, int op, int show_progress, uint64_t *bytes) {
+    if (bytes)
+        *bytes = 0;
+    if (!device_path || op == ETDK_OFFLOAD_NONE) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+#ifdef PLATFORM_LINUX
+    unsigned long request;
+    switch (op) {
+    case ETDK_OFFLOAD_DISCARD:
+        request = BLKDISCARD;
+        break;
+    case ETDK_OFFLOAD_SECURE_DISCARD:
+        request = BLKSECDISCARD;
+        break;
+    case ETDK_OFFLOAD_ZEROOUT:
+        request = BLKZEROOUT;
+        break;
+    default:
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    platform_offload_caps_t caps;
+    int result = platform_get_offload_caps(device_path, &caps);
+    if (result != ETDK_SUCCESS) {
+        return result;
+    }
+    if (op != ETDK_OFFLOAD_ZEROOUT && !caps.discard) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    // The discard ioctls require a descriptor opened for writing
+    int fd = open(device_path, O_WRONLY);
+    if (fd < 0) {
+        return ETDK_ERROR_IO;
+    }
+    uint64_t size = 0;
+    if (ioctl(fd, BLKGETSIZE64, &size) < 0) {
+        close(fd);
+        return ETDK_ERROR_IO;
+    }
+
+    uint64_t offset = 0;
+    while (offset < size) {
+        uint64_t len = size - offset < ETDK_OFFLOAD_RANGE ? size - offset : ETDK_OFFLOAD_RANGE;
+        uint64_t range[2] = {offset, len};
+        if (ioctl(fd, request, range) < 0) {
+            result = (errno == EOPNOTSUPP || errno == ENOTTY) ? ETDK_ERROR_PLATFORM : ETDK_ERROR_IO;
+            break;
+        }
+        offset += len;
+        if (bytes)
+            *bytes = offset;
+        if (show_progress) {
+            printf("\rProgress: %.2f GB / %.2f GB (%.1f%%)  ", offset / (1024.0 * 1024.0 * 1024.0),
+                   size / (1024.0 * 1024.0 * 1024.0), offset * 100.0 / size);
+            fflush(stdout);
+        }
+    }
+    if (show_progress && offset > 0)
+        printf("\n");
+
+    close(fd);
+    return result;
+#else
+    (void)show_progress;
+    return ETDK_ERROR_PLATFORM;
+#endif
+}
@@ -0,0 +1,324 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * Progress Module - Rate-limited progress line and JSON-lines progress stream
+ *
+ * The engines report their position after every chunk; this module turns
+ * that into at most one terminal update and one JSON record per
+ * ETDK_PROGRESS_INTERVAL, so progress costs no system call per chunk.
+ *
+ * With --progress-fd every record is one JSON object on its own line,
+ * written with a single write() so lines from one process never interleave:
+ *
+ *   {"event":"start","target":"/dev/sdb","bytes_total":1000204886016,"bytes_start":0}
+ *   {"event":"progress","target":"/dev/sdb","phase":"encrypt","bytes_done":536870912,...}
+ *   {"event":"phase","target":"/dev/sdb","phase":"flush","elapsed_s":1873.210}
+ *   {"event":"summary","target":"/dev/sdb","result":"ok","bytes":1000204886016,...}
+ *   {"event":"run","result":"ok","targets":1,"bytes":1000204886016,...}
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/** @brief Longest JSON record, including the escaped target path */
+#define PROGRESS_RECORD_MAX (ETDK_JOURNAL_PATH_MAX * 6 + 512)
+
+/**
+ * @brief Name of a phase in the JSON records
+ * @param phase ETDK_PHASE_*
+ * @return "encrypt", "checkpoint", "tail" or "flush"
+ */
+static const char *phase_name(int phase) {
+    switch (phase) {
+    case ETDK_PHASE_CHECKPOINT:
+        return "checkpoint";
+    case ETDK_PHASE_TAIL:
+        return "tail";
+    case ETDK_PHASE_FLUSH:
+        return "flush";
+    case ETDK_PHASE_ENCRYPT:
+    default:
+        return "encrypt";
+    }
+}
+
+/**
+ * @brief Escape a string for use inside a JSON string literal
+ * @param out Output buffer
+ * @param size Size of out (at least 6 * strlen(in) + 1 to never truncate)
+ * @param in String to escape
+ */
+static void json_escape(char *out, size_t size, const char *in) {
+    size_t pos = 0;
+
+    for (; *in && pos + 7 < size; in++) {
+        unsigned char c = (unsigned char)*in;
+        if (c == '"' || c == '\\') {
+            out[pos++] = '\\';
+            out[pos++] = (char)c;
+        } else if (c < 0x20) {
+            pos += (size_t)snprintf(out + pos, size - pos, "\\u%04x", c);
+        } else {
+            out[pos++] = (char)c;
+        }
+    }
+    out[pos] = '\0';
+}
+
+/**
+ * @brief Write one JSON record (a line) to the progress descriptor
+ *
+ * A failed write (e.g. the reader closed the pipe) disables the stream
+ * for the rest of the target instead of failing the wipe.
+ *
+ * @param fd Pointer to the descriptor, set to -1 on error
+ * @param record Record without the trailing newline
+ * @param len Length of record, at most PROGRESS_RECORD_MAX - 2
+ */
+static void emit_record(int *fd, char *record, size_t len) {
+    record[len++] = '\n';
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(*fd, record + written, len - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            *fd = -1;
+            return;
+        }
+        written += (size_t)n;
+    }
+}
+
+/**
+ * @brief Format a record into buf and emit it
+ * @param fd Pointer to the descriptor
+ * @param buf Buffer of PROGRESS_RECORD_MAX bytes
+ * @param len Formatted length returned by snprintf
+ */
+static void emit_formatted(int *fd, char *buf, int len) {
+    if (len > 0 && (size_t)len < PROGRESS_RECORD_MAX - 1)
+        emit_record(fd, buf, (size_t)len);
+}
+
+/**
+ * @brief Print the terminal line and emit a "progress" record
+ * @param progress Progress
+ * @param now Current time
+ */
+static void report(etdk_progress_t *progress, double now) {
+    double remaining = progress->total > progress->done ? (double)(progress->total - progress->done) : 0.0;
+    double eta = progress->ewma > 0 ? remaining / progress->ewma : -1.0;
+
+    if (progress->show && progress->total > 0) {
+        printf("\rProgress: %.2f GB / %.2f GB (%.1f%%)", progress->done / (1024.0 * 1024.0 * 1024.0),
+               progress->total / (1024.0 * 1024.0 * 1024.0), progress->done * 100.0 / progress->total);
+        if (progress->ewma > 0)
+            printf("  %.1f MB/s", progress->ewma / (1024.0 * 1024.0));
+        if (eta >= 0 && remaining > 0)
+            printf("  ETA %u:%02u:%02u", (unsigned)(eta / 3600), (unsigned)(eta / 60) % 60, (unsigned)eta % 60);
+        printf("  ");
+        fflush(stdout);
+    }
+
+    if (progress->fd >= 0) {
+        char target[ETDK_JOURNAL_PATH_MAX * 6];
+        char buf[PROGRESS_RECORD_MAX];
+        json_escape(target, sizeof(target), progress->target);
+        int len = snprintf(buf, sizeof(buf),
+                           "{\"event\":\"progress\",\"target\":\"%s\",\"phase\":\"%s\",\"bytes_done\":%llu,"
+                           "\"bytes_total\":%llu,\"percent\":%.2f,\"rate_bps\":%.0f,\"ewma_bps\":%.0f,",
+                           target, phase_name(progress->phase), (unsigned long long)progress->done,
+                           (unsigned long long)progress->total,
+                           progress->total ? progress->done * 100.0 / progress->total : 100.0, progress->rate,
+                           progress->ewma);
+        if (len > 0 && (size_t)len < sizeof(buf)) {
+            if (eta >= 0) {
+                len += snprintf(buf + len, sizeof(buf) - (size_t)len, "\"eta_s\":%.1f,", eta);
+            } else {
+                len += snprintf(buf + len, sizeof(buf) - (size_t)len, "\"eta_s\":null,");
+            }
+        }
+        if (len > 0 && (size_t)len < sizeof(buf)) {
+            len += snprintf(buf + len, sizeof(buf) - (size_t)len, "\"elapsed_s\":%.3f}", now - progress->started);
+        }
+        emit_formatted(&progress->fd, buf, len);
+    }
+}
+
+/**
+ * @brief Update the instantaneous and smoothed throughput
+ * @param progress Progress
+ * @param now Current time, at least ETDK_PROGRESS_INTERVAL after the last sample
+ */
+static void sample(etdk_progress_t *progress, double now) {
+    uint64_t bytes = progress->done > progress->last_done ? progress->done - progress->last_done : 0;
+
+    progress->rate = bytes / (now - progress->last);
+    progress->ewma = progress->ewma > 0
+                         ? ETDK_PROGRESS_EWMA_WEIGHT * progress->rate + (1.0 - ETDK_PROGRESS_EWMA_WEIGHT) * progress->ewma
+                         : progress->rate;
+    progress->last = now;
+    progress->last_done = progress->done;
+}
+
+/**
+ * @brief Start reporting progress for a target
+ *
+ * @param progress Progress to initialize
+ * @param target Target path (must stay valid until progress_finish())
+ * @param total Target size in bytes
+ * @param first Offset the run starts at (bytes before it count as done)
+ * @param show Non-zero to print the terminal progress line
+ * @param fd JSON-lines descriptor, -1 for none
+ */
+void progress_init(etdk_progress_t *progress, const char *target, uint64_t total, uint64_t first, int show, int fd) {
+    memset(progress, 0, sizeof(*progress));
+    progress->target = target;
+    progress->show = show;
+    progress->fd = fd;
+    progress->total = total;
+    progress->first = first;
+    progress->done = first;
+    progress->last_done = first;
+    progress->started = platform_monotonic_seconds();
+    progress->last = progress->started;
+    progress->phase = ETDK_PHASE_ENCRYPT;
+    progress->phase_started = progress->started;
+
+    if (progress->fd >= 0) {
+        char escaped[ETDK_JOURNAL_PATH_MAX * 6];
+        char buf[PROGRESS_RECORD_MAX];
+        json_escape(escaped, sizeof(escaped), target);
+        int len = snprintf(buf, sizeof(buf), "{\"event\":\"start\",\"target\":\"%s\",\"bytes_total\":%llu,"
+                                             "\"bytes_start\":%llu}",
+                           escaped, (unsigned long long)total, (unsigned long long)first);
+        emit_formatted(&progress->fd, buf, len);
+    }
+}
+
+/**
+ * @brief Record progress
+ *
+ * Called after every chunk. Only reads the clock unless
+ * ETDK_PROGRESS_INTERVAL has passed since the last update, so the
+ * terminal line and the JSON stream cost at most one write each per
+ * interval regardless of the chunk size.
+ *
+ * @param progress Progress, NULL for none
+ * @param done Offset processed so far
+ */
+void progress_update(etdk_progress_t *progress, uint64_t done) {
+    if (!progress)
+        return;
+
+    progress->done = done;
+    if (!progress->show && progress->fd < 0)
+        return;
+
+    double now = platform_monotonic_seconds();
+    if (now - progress->last < ETDK_PROGRESS_INTERVAL)
+        return;
+    sample(progress, now);
+    report(progress, now);
+}
+
+/**
+ * @brief Switch to another phase
+ *
+ * Reports the current position first, so every phase boundary (e.g. the
+ * end of the main range before a checkpoint) shows up in the terminal
+ * line and the stream even between two intervals.
+ *
+ * @param progress Progress, NULL for none
+ * @param phase ETDK_PHASE_*
+ */
+void progress_phase(etdk_progress_t *progress, int phase) {
+    if (!progress || phase < 0 || phase >= ETDK_PHASE_COUNT)
+        return;
+
+    double now = platform_monotonic_seconds();
+    if (now - progress->last >= ETDK_PROGRESS_INTERVAL)
+        sample(progress, now);
+    report(progress, now);
+
+    progress->phase_seconds[progress->phase] += now - progress->phase_started;
+    progress->phase = phase;
+    progress->phase_started = now;
+
+    if (progress->fd >= 0) {
+        char target[ETDK_JOURNAL_PATH_MAX * 6];
+        char buf[PROGRESS_RECORD_MAX];
+        json_escape(target, sizeof(target), progress->target);
+        int len = snprintf(buf, sizeof(buf), "{\"event\":\"phase\",\"target\":\"%s\",\"phase\":\"%s\",\"elapsed_s\":%.3f}",
+                           target, phase_name(phase), now - progress->started);
+        emit_formatted(&progress->fd, buf, len);
+    }
+}
+
+/**
+ * @brief Finish a target and emit its "summary" record
+ *
+ * The summary carries the bytes processed by this run, the average
+ * throughput and the time spent in every phase. Prints nothing on the
+ * terminal; the last line was drawn by the final progress_phase().
+ *
+ * @param progress Progress
+ * @param result ETDK_SUCCESS or the error code of the run
+ */
+void progress_finish(etdk_progress_t *progress, int result) {
+    double now = platform_monotonic_seconds();
+    double elapsed = now - progress->started;
+
+    progress->phase_seconds[progress->phase] += now - progress->phase_started;
+    progress->phase_started = now;
+
+    if (progress->fd < 0)
+        return;
+
+    uint64_t bytes = progress->done > progress->first ? progress->done - progress->first : 0;
+    char target[ETDK_JOURNAL_PATH_MAX * 6];
+    char buf[PROGRESS_RECORD_MAX];
+    json_escape(target, sizeof(target), progress->target);
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"event\":\"summary\",\"target\":\"%s\",\"result\":\"%s\",\"code\":%d,\"bytes\":%llu,"
+                       "\"elapsed_s\":%.3f,\"avg_bps\":%.0f,\"phases\":{",
+                       target, result == ETDK_SUCCESS ? "ok" : "error", result, (unsigned long long)bytes, elapsed,
+                       elapsed > 0 ? bytes / elapsed : 0.0);
+    for (int phase = 0; phase < ETDK_PHASE_COUNT && len > 0 && (size_t)len < sizeof(buf); phase++) {
+        len += snprintf(buf + len, sizeof(buf) - (size_t)len, "%s\"%s\":%.3f", phase ? "," : "", phase_name(phase),
+                        progress->phase_seconds[phase]);
+    }
+    if (len > 0 && (size_t)len < sizeof(buf))
+        len += snprintf(buf + len, sizeof(buf) - (size_t)len, "}}");
+    emit_formatted(&progress->fd, buf, len);
+}
+
+/**
+ * @brief Emit the "run" record after all targets
+ *
+ * @param fd JSON-lines descriptor, -1 for none
+ * @param result ETDK_SUCCESS, or an error code if any target failed
+ * @param targets Number of targets
+ * @param bytes Bytes encrypted in total
+ * @param elapsed Seconds for all targets
+ * @param throttled Seconds held back by the rate limiter
+ */
+void progress_report_run(int fd, int result, size_t targets, uint64_t bytes, double elapsed, double throttled) {
+    if (fd < 0)
+        return;
+
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"event\":\"run\",\"result\":\"%s\",\"targets\":%zu,\"bytes\":%llu,\"elapsed_s\":%.3f,"
+                       "\"avg_bps\":%.0f,\"throttled_s\":%.3f}",
+                       result == ETDK_SUCCESS ? "ok" : "error", targets, (unsigned long long)bytes, elapsed,
+                       elapsed > 0 ? bytes / elapsed : 0.0, throttled);
+    if (len > 0 && (size_t)len < sizeof(buf) - 1)
+        emit_record(&fd, buf, (size_t)len);
+}
@@ -0,0 +1,760 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * Tree Module - Recursive directory and batch encryption with a work-stealing file scheduler
+ *
+ * Every worker owns a deque of pending paths. A worker pushes the entries
+ * of the directories it scans onto its own deque and pops from the same
+ * end (depth first, warm dentry cache). Idle workers steal from the other
+ * end of a peer's deque, which holds the oldest and usually largest
+ * subtrees, so a single huge directory is spread over all threads.
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <dirent.h>
+#include <errno.h>
+#include <openssl/crypto.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+// cppcheck-suppress-end missingIncludeSystem
+
+/** @brief Suffix of the temporary ciphertext file in CBC mode (same as the CLI) */
+#define TEMP_SUFFIX ".tmp_encrypted"
+
+/** @brief Minimum interval between two progress lines in seconds */
+#define PROGRESS_INTERVAL 0.25
+
+/** @brief Small files a worker collects before handing them to io_uring as one batch */
+#define BATCH_FILES 64
+
+/**
+ * @brief Per-worker deque of pending paths
+ *
+ * items[head..tail) are valid. The owner pushes and pops at the tail,
+ * thieves take from the head. A mutex per deque keeps it simple: it is
+ * only contended when a thief visits, and every item stands for at least
+ * one open/stat system call, which dwarfs the lock.
+ */
+typedef struct {
+    pthread_mutex_t lock; /**< Protects all fields */
+    char **items;         /**< Heap-allocated paths */
+    size_t head;          /**< Oldest item (steal end) */
+    size_t tail;          /**< One past the newest item (owner end) */
+    size_t capacity;      /**< Allocated slots */
+} work_deque_t;
+
+struct tree_run;
+
+/**
+ * @brief Worker state
+ */
+typedef struct {
+    struct tree_run *run;               /**< Shared state */
+    unsigned id;                        /**< Index into run->workers */
+    work_deque_t deque;                 /**< This worker's pending paths */
+    crypto_context_t ctx;               /**< Private key copy and cipher context (data_unit is set per file) */
+    io_buffer_pool_t small;             /**< ETDK_SMALL_FILE_BUFFER buffers: one, or BATCH_FILES when batching */
+    int batching;                       /**< Collect small files for io_uring_batch_run() */
+    size_t batched;                     /**< Files collected in batch */
+    io_batch_file_t batch[BATCH_FILES]; /**< Collected small files (paths are owned) */
+    uint64_t batch_index[BATCH_FILES];  /**< Session index of each collected file, once it was read */
+    int batch_begun[BATCH_FILES];       /**< session_begin() was called for the file */
+    pthread_t thread;                   /**< Thread handle (unused for worker 0) */
+} tree_worker_t;
+
+/**
+ * @brief State shared by all workers
+ */
+typedef struct tree_run {
+    tree_worker_t *workers;        /**< Worker array */
+    unsigned count;                /**< Number of started workers */
+    etdk_options_t file_opts;      /**< Options used for every file */
+    atomic_size_t pending;         /**< Paths queued or in progress */
+    atomic_int error;              /**< Fatal error code, ETDK_SUCCESS if none */
+    atomic_uint_least64_t files;   /**< Regular files encrypted */
+    atomic_uint_least64_t failed;  /**< Entries that could not be processed */
+    atomic_uint_least64_t dirs;    /**< Directories scanned */
+    atomic_uint_least64_t skipped; /**< Entries that are neither files nor directories */
+    atomic_uint_least64_t bytes;   /**< Plaintext bytes encrypted */
+    int show_progress;             /**< Print a progress line from worker 0 */
+    int note_short;                /**< Name the files of 1 to 15 bytes XTS left to the CBC copy format */
+    atomic_int batch_warned;       /**< The io_uring fallback warning has been printed */
+} tree_run_t;
+
+/**
+ * @brief Initialize an empty deque
+ * @return 0 on success, -1 on failure
+ */
+static int deque_init(work_deque_t *dq) {
+    memset(dq, 0, sizeof(*dq));
+    return pthread_mutex_init(&dq->lock, NULL) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Free a deque and any paths left in it
+ */
+static void deque_free(work_deque_t *dq) {
+    for (size_t i = dq->head; i < dq->tail; i++)
+        free(dq->items[i]);
+    free(dq->items);
+    pthread_mutex_destroy(&dq->lock);
+}
+
+/**
+ * @brief Append a path at the owner end
+ * @return 0 on success, -1 on allocation failure
+ */
+static int deque_push(work_deque_t *dq, char *path) {
+    pthread_mutex_lock(&dq->lock);
+
+    if (dq->tail == dq->capacity) {
+        if (dq->head > 0) {
+            // Reuse the slots freed by thieves before growing
+            memmove(dq->items, dq->items + dq->head, (dq->tail - dq->head) * sizeof(char *));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        } else {
+            size_t capacity = dq->capacity ? dq->capacity * 2 : 64;
+            char **items = realloc(dq->items, capacity * sizeof(char *));
+            if (!items) {
+                pthread_mutex_unlock(&dq->lock);
+                return -1;
+            }
+            dq->items = items;
+            dq->capacity = capacity;
+        }
+    }
+
+    dq->items[dq->tail++] = path;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+/**
+ * @brief Take the newest path (owner end)
+ * @return Path, or NULL if the deque is empty
+ */
+static char *deque_pop(work_deque_t *dq) {
+    char *path = NULL;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        path = dq->items[--dq->tail];
+        if (dq->tail == dq->head)
+            dq->head = dq->tail = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return path;
+}
+
+/**
+ * @brief Take the oldest path (steal end)
+ * @return Path, or NULL if the deque is empty
+ */
+static char *deque_steal(work_deque_t *dq) {
+    char *path = NULL;
+
+    // Do not wait on a busy owner, try the next victim instead
+    if (pthread_mutex_trylock(&dq->lock) != 0)
+        return NULL;
+    if (dq->tail > dq->head) {
+        path = dq->items[dq->head++];
+        if (dq->tail == dq->head)
+            dq->head = dq->tail = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return path;
+}
+
+/**
+ * @brief Queue a path on a worker's own deque
+ *
+ * Takes ownership of path. On failure the path is freed and the run
+ * is aborted with ETDK_ERROR_MEMORY.
+ */
+static void schedule(tree_worker_t *self, char *path) {
+    atomic_fetch_add(&self->run->pending, 1);
+    if (deque_push(&self->deque, path) != 0) {
+        free(path);
+        atomic_fetch_sub(&self->run->pending, 1);
+        int expected = ETDK_SUCCESS;
+        atomic_compare_exchange_strong(&self->run->error, &expected, ETDK_ERROR_MEMORY);
+    }
+}
+
+/**
+ * @brief Join a directory path and an entry name
+ * @return Newly allocated path, or NULL on allocation failure
+ */
+static char *join_path(const char *dir, const char *name) {
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    int slash = dlen > 0 && dir[dlen - 1] != '/';
+
+    char *path = malloc(dlen + (size_t)slash + nlen + 1);
+    if (!path)
+        return NULL;
+
+    memcpy(path, dir, dlen);
+    if (slash)
+        path[dlen] = '/';
+    memcpy(path + dlen + (size_t)slash, name, nlen + 1);
+    return path;
+}
+
+/**
+ * @brief Read a directory and queue all of its entries
+ *
+ * The whole listing is read before anything is queued, so the temporary
+ * files created by CBC workers in this directory never show up in it.
+ */
+static void scan_directory(tree_worker_t *self, const char *path) {
+    tree_run_t *run = self->run;
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "\nCannot open directory %s: %s\n", path, strerror(errno));
+        atomic_fetch_add(&run->failed, 1);
+        return;
+    }
+
+    char **entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    int oom = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 64;
+            char **items = realloc(entries, grown * sizeof(char *));
+            if (!items) {
+                oom = 1;
+                break;
+            }
+            entries = items;
+            capacity = grown;
+        }
+
+        entries[count] = join_path(path, entry->d_name);
+        if (!entries[count]) {
+            oom = 1;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    if (oom) {
+        int expected = ETDK_SUCCESS;
+        atomic_compare_exchange_strong(&run->error, &expected, ETDK_ERROR_MEMORY);
+        for (size_t i = 0; i < count; i++)
+            free(entries[i]);
+    } else {
+        for (size_t i = 0; i < count; i++)
+            schedule(self, entries[i]);
+    }
+
+    free(entries);
+    atomic_fetch_add(&run->dirs, 1);
+}
+
+/**
+ * @brief Encrypt one regular file with the worker's current key
+ *
+ * Small files take one read and one write through the worker's buffer;
+ * the rest, and small files that are read-only or have grown meanwhile,
+ * go through the general paths below.
+ *
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+static int encrypt_file(tree_worker_t *self, const char *path, uint64_t size) {
+    const etdk_options_t *opts = &self->run->file_opts;
+
+    if (size <= ETDK_SMALL_FILE_MAX && self->small.buffers && !opts->direct_io && !opts->keystream_only) {
+        int result = crypto_encrypt_small_file(path, &self->ctx, opts, self->small.buffers[0]);
+        if (result != ETDK_ERROR_PLATFORM)
+            return result;
+    }
+
+    if (opts->in_place) {
+        return crypto_encrypt_file_inplace(path, &self->ctx, opts);
+    }
+
+    char *temp_path = malloc(strlen(path) + sizeof(TEMP_SUFFIX));
+    if (!temp_path) {
+        return ETDK_ERROR_MEMORY;
+    }
+    sprintf(temp_path, "%s%s", path, TEMP_SUFFIX);
+
+    int result = crypto_encrypt_file(path, temp_path, &self->ctx, opts);
+    if (result == ETDK_SUCCESS && (remove(path) != 0 || rename(temp_path, path) != 0)) {
+        fprintf(stderr, "\nFailed to replace %s with its encrypted version: %s\n", path, strerror(errno));
+        result = ETDK_ERROR_IO;
+    }
+    if (result != ETDK_SUCCESS) {
+        remove(temp_path);
+    }
+
+    free(temp_path);
+    return result;
+}
+
+/**
+ * @brief Encrypt one regular file with the run's mode
+ *
+ * XTS files are encrypted in place; CBC files are written to a temporary
+ * file that then replaces the original, like the single-file CLI path,
+ * unless they are small enough to be rewritten from memory.
+ * In a session the file first gets its own index and derived keys.
+ *
+ * @return ETDK_SUCCESS on success, error code on failure
+ */
+static int encrypt_one(tree_worker_t *self, const char *path, uint64_t size) {
+    const etdk_options_t *opts = &self->run->file_opts;
+
+    uint64_t index = 0;
+    if (opts->session) {
+        int status = session_begin(opts->session, path, size, &self->ctx, &index);
+        if (status != ETDK_SUCCESS)
+            return status;
+    }
+
+    int result = encrypt_file(self, path, size);
+    if (result != ETDK_SUCCESS && opts->session)
+        session_fail(opts->session, index);
+    return result;
+}
+
+/**
+ * @brief Count a processed regular file
+ *
+ * A file that became a symbolic link before it was opened counts as
+ * skipped, like the symlinks lstat() finds.
+ */
+static void record_file(tree_run_t *run, const char *path, uint64_t size, int result) {
+    if (result == ETDK_ERROR_SYMLINK) {
+        atomic_fetch_add(&run->skipped, 1);
+    } else if (result == ETDK_SUCCESS) {
+        atomic_fetch_add(&run->files, 1);
+        atomic_fetch_add(&run->bytes, size);
+        // Decrypting these takes --mode cbc, so the user must know which they are
+        if (run->note_short && size > 0 && size < AES_BLOCK_SIZE)
+            printf("\nCBC copy format (shorter than one AES block): %s\n", path);
+    } else {
+        fprintf(stderr, "\nFailed: %s\n", path);
+        atomic_fetch_add(&run->failed, 1);
+    }
+}
+
+/**
+ * @brief Encrypt one file of a batch once io_uring has read it (io_batch_fn)
+ *
+ * In a session the file gets its index and keys here, after the read and
+ * before the write, so the manifest still lists it before it is touched.
+ */
+static int batch_encrypt(void *arg, size_t index, unsigned char *buf, size_t len, size_t *out_len) {
+    tree_worker_t *self = arg;
+    const etdk_options_t *opts = &self->run->file_opts;
+
+    if (opts->session) {
+        int status = session_begin(opts->session, self->batch[index].path, len, &self->ctx, &self->batch_index[index]);
+        if (status != ETDK_SUCCESS)
+            return status;
+        self->batch_begun[index] = 1;
+    }
+    io_limiter_wait(opts->limiter, len, 2);
+    return crypto_encrypt_buffer(&self->ctx, buf, len, out_len);
+}
+
+/**
+ * @brief Run the collected small files through io_uring and count them
+ *
+ * Files the batch left untouched (read-only, changed since they were
+ * listed, or no io_uring support at all) take the one-by-one path.
+ */
+static void flush_batch(tree_worker_t *self) {
+    tree_run_t *run = self->run;
+    const etdk_options_t *opts = &run->file_opts;
+    size_t count = self->batched;
+    self->batched = 0;
+
+    // After a fatal error only drain, like the queues
+    int status = ETDK_ERROR_IO;
+    if (atomic_load(&run->error) == ETDK_SUCCESS)
+        status = io_uring_batch_run(self->batch, count, opts->in_place, batch_encrypt, self);
+
+    if (status == ETDK_ERROR_PLATFORM) {
+        self->batching = 0;
+        if (atomic_exchange(&run->batch_warned, 1) == 0)
+            fprintf(stderr, "\nWarning: io_uring batches unavailable, encrypting small files one by one\n");
+        for (size_t i = 0; i < count; i++)
+            self->batch[i].result = ETDK_ERROR_PLATFORM;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        io_batch_file_t *file = &self->batch[i];
+        if (atomic_load(&run->error) == ETDK_SUCCESS) {
+            int result = file->result;
+            if (result != ETDK_SUCCESS) {
+                OPENSSL_cleanse(file->buf, ETDK_SMALL_FILE_BUFFER);
+                if (self->batch_begun[i])
+                    session_fail(opts->session, self->batch_index[i]);
+            }
+            if (result == ETDK_ERROR_PLATFORM)
+                result = encrypt_one(self, file->path, file->size);
+            record_file(run, file->path, file->size, result);
+        }
+        free((char *)file->path);
+        file->path = NULL;
+    }
+}
+
+/**
+ * @brief Add a small file to the worker's batch, running the batch once it is full
+ */
+static void batch_add(tree_worker_t *self, const char *path, uint64_t size) {
+    char *copy = strdup(path);
+    if (!copy) {
+        record_file(self->run, path, size, encrypt_one(self, path, size));
+        return;
+    }
+
+    io_batch_file_t *file = &self->batch[self->batched];
+    file->path = copy;
+    file->size = size;
+    file->buf = self->small.buffers[self->batched];
+    self->batch_begun[self->batched] = 0;
+    if (++self->batched == BATCH_FILES)
+        flush_batch(self);
+}
+
+/**
+ * @brief Process one path: scan a directory or encrypt a regular file
+ */
+static void process_path(tree_worker_t *self, const char *path) {
+    tree_run_t *run = self->run;
+    struct stat st;
+
+    // lstat: never follow symbolic links out of the tree
+    if (lstat(path, &st) != 0) {
+        fprintf(stderr, "\nCannot access %s: %s\n", path, strerror(errno));
+        atomic_fetch_add(&run->failed, 1);
+        return;
+    }
+
+    // The manifest is written while the tree is walked; it must stay readable
+    const etdk_session_t *session = run->file_opts.session;
+    if (session && (uint64_t)st.st_dev == session->manifest_dev && (uint64_t)st.st_ino == session->manifest_ino) {
+        atomic_fetch_add(&run->skipped, 1);
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        scan_directory(self, path);
+    } else if (S_ISREG(st.st_mode)) {
+        if (self->batching && (uint64_t)st.st_size <= ETDK_SMALL_FILE_MAX) {
+            batch_add(self, path, (uint64_t)st.st_size);
+        } else {
+            record_file(run, path, (uint64_t)st.st_size, encrypt_one(self, path, (uint64_t)st.st_size));
+        }
+    } else {
+        atomic_fetch_add(&run->skipped, 1);
+    }
+}
+
+/**
+ * @brief Find the next path: own deque first, then steal from peers
+ * @return Path to process, or NULL if nothing is available right now
+ */
+static char *next_path(tree_worker_t *self) {
+    char *path = deque_pop(&self->deque);
+    if (path)
+        return path;
+
+    tree_run_t *run = self->run;
+    for (unsigned i = 1; i < run->count; i++) {
+        tree_worker_t *victim = &run->workers[(self->id + i) % run->count];
+        path = deque_steal(&victim->deque);
+        if (path)
+            return path;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Print the file counters on one line
+ */
+static void print_tree_progress(tree_run_t *run) {
+    printf("\rFiles: %llu encrypted, %llu failed, %llu directories  ",
+           (unsigned long long)atomic_load(&run->files), (unsigned long long)atomic_load(&run->failed),
+           (unsigned long long)atomic_load(&run->dirs));
+    fflush(stdout);
+}
+
+/**
+ * @brief Worker loop
+ *
+ * Runs until no path is queued or in progress anywhere. A worker that
+ * finds nothing to do backs off like the device pipeline stages: it
+ * yields for a while, then sleeps briefly.
+ */
+static void *tree_worker_main(void *arg) {
+    tree_worker_t *self = arg;
+    tree_run_t *run = self->run;
+    double last_report = 0.0;
+    unsigned spins = 0;
+
+    while (1) {
+        char *path = next_path(self);
+
+        if (!path) {
+            // Nothing else to do right now: do not hold back a partial batch
+            if (self->batched > 0) {
+                flush_batch(self);
+                continue;
+            }
+            if (atomic_load(&run->pending) == 0)
+                break;
+            if (++spins < 64) {
+                sched_yield();
+            } else {
+                struct timespec ts = {0, 50000}; // 50 us
+                nanosleep(&ts, NULL);
+            }
+            continue;
+        }
+        spins = 0;
+
+        // After a fatal error only drain the queues
+        if (atomic_load(&run->error) == ETDK_SUCCESS)
+            process_path(self, path);
+        free(path);
+        atomic_fetch_sub(&run->pending, 1);
+
+        if (self->id == 0 && run->show_progress) {
+            double now = platform_monotonic_seconds();
+            if (now - last_report >= PROGRESS_INTERVAL) {
+                print_tree_progress(run);
+                last_report = now;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Encrypt a list of files and directory trees with one worker pool
+ *
+ * Seeds the workers' deques with the given paths (round robin) and runs
+ * opts->threads workers (default: online CPUs). Directories are walked
+ * recursively. Each file is encrypted with the same key by a single-
+ * threaded synchronous engine, so parallelism comes from processing many
+ * files at once rather than from splitting one file. The given paths are
+ * resolved with realpath(); below them, symbolic links, devices, sockets
+ * and FIFOs are skipped and links are never followed.
+ *
+ * With opts->in_place files are encrypted in place with XTS, otherwise
+ * each file is replaced by its AES-256-CBC ciphertext. CTR is rejected:
+ * one key and IV for many files would reuse the keystream, and the XOR
+ * of two ciphertexts would reveal the XOR of the plaintexts even after
+ * the key is gone. With opts->session every file gets its own key and
+ * IV derived from the session master key, so CTR in place works too.
+ *
+ * With opts->io_engine set to io_uring, files up to ETDK_SMALL_FILE_MAX
+ * are collected per worker and rewritten in batches by
+ * io_uring_batch_run(); larger files still use the synchronous engine.
+ *
+ * A file that cannot be encrypted is reported and counted, and the run
+ * continues. For XTS, ctx->data_unit is set to the block size of the
+ * first path's filesystem, which is the data unit used for files on it.
+ *
+ * @param paths Files and directories to encrypt
+ * @param count Number of paths
+ * @param ctx Pointer to initialized crypto_context_t
+ * @param opts I/O options, or NULL for defaults
+ * @param stats Optional pointer where counters will be stored
+ * @return ETDK_SUCCESS if every file was encrypted, ETDK_ERROR_IO if any failed, or a fatal error code
+ */
+int crypto_encrypt_paths(const char *const *paths, size_t count, crypto_context_t *ctx, const etdk_options_t *opts,
+                         etdk_tree_stats_t *stats) {
+    if (!paths || count == 0 || !ctx) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    /* A keystream-only overwrite never combines the keystream with data, and
+     * a session gives every file its own key, so CTR reuse is harmless there
+     */
+    int own_keystream = opts && (opts->keystream_only || opts->session);
+    if ((ctx->mode == ETDK_MODE_CTR && !own_keystream) || (opts && opts->in_place && ctx->mode == ETDK_MODE_CBC) ||
+        (!(opts && opts->in_place) && ctx->mode != ETDK_MODE_CBC)) {
+        fprintf(stderr, "Encrypting multiple files requires CBC, or XTS in place\n");
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    tree_run_t run;
+    memset(&run, 0, sizeof(run));
+    if (opts) {
+        run.file_opts = *opts;
+    } else {
+        etdk_options_init(&run.file_opts);
+    }
+    run.show_progress = !run.file_opts.quiet;
+    run.note_short = run.show_progress && ctx->mode == ETDK_MODE_XTS && !run.file_opts.keystream_only;
+
+    // One file per worker, one thread per file
+    unsigned threads = run.file_opts.threads;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned)online : 1;
+    }
+    run.file_opts.threads = 1;
+    // With io_uring, small files go to the kernel in batches of linked requests; the rest stays synchronous
+    int batching = run.file_opts.io_engine == ETDK_ENGINE_IO_URING && !run.file_opts.direct_io &&
+                   !run.file_opts.keystream_only;
+    run.file_opts.io_engine = ETDK_ENGINE_SYNC;
+    run.file_opts.quiet = 1;
+    run.file_opts.progress_fd = -1; // One record per file would flood the stream; main() reports the run
+
+    atomic_init(&run.pending, 0);
+    atomic_init(&run.error, ETDK_SUCCESS);
+    atomic_init(&run.files, 0);
+    atomic_init(&run.failed, 0);
+    atomic_init(&run.dirs, 0);
+    atomic_init(&run.skipped, 0);
+    atomic_init(&run.bytes, 0);
+    atomic_init(&run.batch_warned, 0);
+
+    uint32_t logical = 512;
+    uint32_t physical = 512;
+    platform_get_sector_size(paths[0], &logical, &physical);
+    if (ctx->mode == ETDK_MODE_XTS) {
+        ctx->data_unit = logical;
+    }
+
+    run.workers = calloc(threads, sizeof(tree_worker_t));
+    if (!run.workers) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return ETDK_ERROR_MEMORY;
+    }
+    // Workers hold key copies: keep them out of swap
+    platform_lock_memory(run.workers, threads * sizeof(tree_worker_t));
+
+    unsigned initialized = 0;
+    for (; initialized < threads; initialized++) {
+        tree_worker_t *w = &run.workers[initialized];
+        if (deque_init(&w->deque) != 0)
+            break;
+        w->run = &run;
+        w->id = initialized;
+        w->ctx = *ctx;
+        w->ctx.cipher_ctx = NULL;
+        // Without the buffers the worker just takes the general path for every file
+        w->batching = batching && io_pool_init(&w->small, BATCH_FILES, ETDK_SMALL_FILE_BUFFER,
+                                               ETDK_BUFFER_ALIGNMENT) == ETDK_SUCCESS;
+        if (!w->batching)
+            io_pool_init(&w->small, 1, ETDK_SMALL_FILE_BUFFER, ETDK_BUFFER_ALIGNMENT);
+    }
+    run.count = initialized;
+
+    int result = ETDK_SUCCESS;
+    if (initialized == 0) {
+        fprintf(stderr, "Cannot create worker queues\n");
+        result = ETDK_ERROR_PLATFORM;
+    } else {
+        // Spread the given paths over all deques; resolve links the user named explicitly
+        for (size_t i = 0; i < count; i++) {
+            char *start = realpath(paths[i], NULL);
+            if (!start) {
+                fprintf(stderr, "Cannot access %s: %s\n", paths[i], strerror(errno));
+                atomic_fetch_add(&run.failed, 1);
+                continue;
+            }
+            schedule(&run.workers[i % initialized], start);
+        }
+
+        if (run.show_progress) {
+            printf("\n");
+            printf("Encrypting files with %s (%u worker%s%s)...\n", crypto_mode_name(ctx->mode), initialized,
+                   initialized == 1 ? "" : "s", batching ? ", io_uring batches of small files" : "");
+            printf("\n");
+        }
+
+        // The calling thread is worker 0; fewer started threads just means fewer thieves
+        unsigned started = 1;
+        for (; started < initialized; started++) {
+            if (pthread_create(&run.workers[started].thread, NULL, tree_worker_main, &run.workers[started]) != 0)
+                break;
+        }
+
+        tree_worker_main(&run.workers[0]);
+
+        for (unsigned i = 1; i < started; i++)
+            pthread_join(run.workers[i].thread, NULL);
+
+        if (run.show_progress) {
+            print_tree_progress(&run);
+            printf("\n\n");
+        }
+
+        result = atomic_load(&run.error);
+        if (result == ETDK_SUCCESS && atomic_load(&run.failed) > 0)
+            result = ETDK_ERROR_IO;
+    }
+
+    if (stats) {
+        stats->files = atomic_load(&run.files);
+        stats->failed = atomic_load(&run.failed);
+        stats->directories = atomic_load(&run.dirs);
+        stats->skipped = atomic_load(&run.skipped);
+        stats->bytes = atomic_load(&run.bytes);
+    }
+
+    // Each worker's key copy owns the cipher context it re-keyed for every file
+    for (unsigned i = 0; i < initialized; i++) {
+        deque_free(&run.workers[i].deque);
+        crypto_cleanup(&run.workers[i].ctx);
+        io_pool_free(&run.workers[i].small);
+    }
+    OPENSSL_cleanse(run.workers, threads * sizeof(tree_worker_t));
+    platform_unlock_memory(run.workers, threads * sizeof(tree_worker_t));
+    free(run.workers);
+
+    return result;
+}
+
+/**
+ * @brief Encrypt every regular file below a directory
+ *
+ * Single-root form of crypto_encrypt_paths().
+ *
+ * @param root Directory to encrypt
+ * @param ctx Pointer to initialized crypto_context_t
+ * @param opts I/O options, or NULL for defaults
+ * @param stats Optional pointer where counters will be stored
+ * @return ETDK_SUCCESS if every file was encrypted, ETDK_ERROR_IO if any failed, or a fatal error code
+ */
+int crypto_encrypt_tree(const char *root, crypto_context_t *ctx, const etdk_options_t *opts,
+                        etdk_tree_stats_t *stats) {
+    if (!root || !ctx) {
+        return ETDK_ERROR_CRYPTO;
+    }
+
+    if (!platform_is_directory(root)) {
+        fprintf(stderr, "%s is not a directory\n", root);
+        return ETDK_ERROR_IO;
+    }
+
+    return crypto_encrypt_paths(&root, 1, ctx, opts, stats);
+}
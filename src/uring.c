@@ -0,0 +1,710 @@
+/*
+ * ETDK - Encrypt-then-Delete-Key
+ * io_uring Module - Asynchronous device engine with fixed buffers and a
+ * batched small-file engine with linked request chains (Linux only)
+ *
+ * Talks to the kernel through the raw io_uring_setup/io_uring_enter/
+ * io_uring_register system calls so that no extra library is required.
+ */
+
+#include "etdk.h"
+// cppcheck-suppress-begin missingIncludeSystem
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+// cppcheck-suppress-end missingIncludeSystem
+
+#ifdef HAVE_IO_URING
+
+/**
+ * @brief Minimal view of the shared submission and completion rings
+ */
+typedef struct {
+    int fd;                     /**< io_uring file descriptor */
+    unsigned *sq_head;          /**< Submission queue head (kernel-owned) */
+    unsigned *sq_tail;          /**< Submission queue tail (owned by us) */
+    unsigned *sq_mask;          /**< Submission ring index mask */
+    unsigned *sq_array;         /**< Indirection array into sqes */
+    unsigned sq_entries;        /**< Number of submission entries */
+    struct io_uring_sqe *sqes;  /**< Submission queue entries */
+    unsigned *cq_head;          /**< Completion queue head (owned by us) */
+    unsigned *cq_tail;          /**< Completion queue tail (kernel-owned) */
+    unsigned *cq_mask;          /**< Completion ring index mask */
+    struct io_uring_cqe *cqes;  /**< Completion queue entries */
+    void *sq_ptr;               /**< Mapping of the submission ring */
+    size_t sq_len;              /**< Length of the submission ring mapping */
+    void *cq_ptr;               /**< Mapping of the completion ring */
+    size_t cq_len;              /**< Length of the completion ring mapping */
+    size_t sqes_len;            /**< Length of the sqe array mapping */
+    unsigned pending;           /**< Prepared but not yet submitted entries */
+} uring_t;
+
+/**
+ * @brief Release all mappings and the ring descriptor
+ * @param ring Ring to tear down
+ */
+static void uring_exit(uring_t *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * @brief Create an io_uring instance and map its rings
+ * @param ring Ring to initialize
+ * @param entries Requested number of submission entries
+ * @return 0 on success, -1 if io_uring is unavailable
+ */
+static int uring_setup(uring_t *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    // Kernel 5.4+: both rings live in a single mapping
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len)
+            ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr =
+        mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        uring_exit(ring);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                            IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            uring_exit(ring);
+            return -1;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        uring_exit(ring);
+        return -1;
+    }
+
+    unsigned char *sq = ring->sq_ptr;
+    unsigned char *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+/**
+ * @brief Take the next free submission entry
+ * @param ring Ring to queue on
+ * @param opcode IORING_OP_* operation
+ * @param user_data Value returned in the completion
+ * @return Cleared entry, already counted as pending, or NULL if the submission queue is full
+ */
+static struct io_uring_sqe *uring_next_sqe(uring_t *ring, uint8_t opcode, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+
+    // The kernel only looks at the entry in io_uring_enter(), after the caller has filled it in
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+
+    return sqe;
+}
+
+/**
+ * @brief Queue one read or write request
+ *
+ * @param ring Ring to queue on
+ * @param opcode IORING_OP_* operation
+ * @param fd Target file descriptor
+ * @param addr Buffer address
+ * @param len Number of bytes
+ * @param offset Absolute file offset
+ * @param buf_index Registered buffer index (fixed opcodes only)
+ * @param user_data Value returned in the completion
+ * @return 0 on success, -1 if the submission queue is full
+ */
+static int uring_queue(uring_t *ring, uint8_t opcode, int fd, void *addr, unsigned len, uint64_t offset,
+                       uint16_t buf_index, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_next_sqe(ring, opcode, user_data);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->buf_index = buf_index;
+
+    return 0;
+}
+
+/**
+ * @brief Submit pending requests and optionally wait for completions
+ * @param ring Ring to submit on
+ * @param wait_nr Minimum number of completions to wait for
+ * @return 0 on success, -errno on failure
+ */
+static int uring_submit(uring_t *ring, unsigned wait_nr) {
+    while (1) {
+        unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->pending, wait_nr, flags, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        ring->pending -= (unsigned)ret < ring->pending ? (unsigned)ret : ring->pending;
+        return 0;
+    }
+}
+
+/** @brief Slot lifecycle in the async engine */
+enum { SLOT_FREE = 0, SLOT_READING, SLOT_READ_DONE, SLOT_WRITING };
+
+/**
+ * @brief Per-buffer request state
+ */
+typedef struct {
+    int state;       /**< SLOT_* */
+    uint64_t seq;    /**< Chunk sequence number (transform order) */
+    uint64_t offset; /**< Absolute offset of the chunk */
+    size_t len;      /**< Chunk length in bytes */
+    size_t done;     /**< Bytes completed for the current read/write */
+} uring_slot_t;
+
+/**
+ * @brief Queue the remaining part of a slot's read or write
+ *
+ * Uses the fixed-buffer opcodes when the pool is registered with the ring.
+ *
+ * @return 0 on success, -1 if the submission queue is full
+ */
+static int uring_queue_slot(uring_t *ring, int fd, const io_buffer_pool_t *pool, uring_slot_t *slot, size_t index,
+                            int fixed) {
+    int is_write = slot->state == SLOT_WRITING;
+    uint8_t opcode;
+    if (fixed) {
+        opcode = is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    } else {
+        opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+
+    return uring_queue(ring, opcode, fd, pool->buffers[index] + slot->done, (unsigned)(slot->len - slot->done),
+                       slot->offset + slot->done, (uint16_t)index, index);
+}
+
+/**
+ * @brief Process a byte range asynchronously with io_uring
+ *
+ * Keeps up to depth reads and depth writes in flight so the device never
+ * waits for the CPU. The pool must hold 2 * depth buffers; they are
+ * registered as fixed buffers when the kernel and RLIMIT_MEMLOCK allow it.
+ * Completions may arrive in any order, but the transform is applied in
+ * strict offset order, which keeps chained modes such as CBC correct.
+ */
+int io_uring_engine_run(int fd, uint64_t offset, uint64_t end, const io_buffer_pool_t *pool, size_t chunk_size,
+                        unsigned depth, io_transform_fn transform, void *arg) {
+    if (!pool || !transform || depth == 0 || chunk_size == 0 || chunk_size > pool->size || pool->count < 2 * depth) {
+        return ETDK_ERROR_IO;
+    }
+
+    const size_t nslots = 2 * (size_t)depth;
+    uring_t ring;
+    if (uring_setup(&ring, (unsigned)nslots) != 0) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    uring_slot_t slots[nslots];
+    memset(slots, 0, sizeof(slots));
+
+    // Register buffers once so the kernel does not pin pages per request
+    struct iovec iov[nslots];
+    for (size_t i = 0; i < nslots; i++) {
+        iov[i].iov_base = pool->buffers[i];
+        iov[i].iov_len = pool->size;
+    }
+    int fixed = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iov, (unsigned)nslots) == 0;
+
+    int result = ETDK_SUCCESS;
+    uint64_t next_offset = offset;
+    uint64_t next_read_seq = 0;
+    uint64_t next_transform_seq = 0;
+    unsigned reads_inflight = 0;
+    unsigned writes_inflight = 0;
+    int eof = 0;
+
+    while (1) {
+        // Fill free slots with new reads while under the queue depth
+        for (size_t i = 0; i < nslots && result == ETDK_SUCCESS && !eof; i++) {
+            if (slots[i].state != SLOT_FREE || reads_inflight >= depth || next_offset >= end)
+                continue;
+
+            size_t len = chunk_size;
+            if (end - next_offset < len)
+                len = (size_t)(end - next_offset);
+
+            slots[i].state = SLOT_READING;
+            slots[i].seq = next_read_seq++;
+            slots[i].offset = next_offset;
+            slots[i].len = len;
+            slots[i].done = 0;
+            if (uring_queue_slot(&ring, fd, pool, &slots[i], i, fixed) != 0) {
+                result = ETDK_ERROR_IO;
+                break;
+            }
+            next_offset += len;
+            reads_inflight++;
+        }
+
+        if (reads_inflight + writes_inflight == 0) {
+            break;
+        }
+
+        int ret = uring_submit(&ring, 1);
+        if (ret < 0) {
+            errno = -ret;
+            perror("\nio_uring submit failed");
+            result = ETDK_ERROR_IO;
+            break;
+        }
+
+        // Reap every available completion
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            size_t index = (size_t)cqe->user_data;
+            uring_slot_t *slot = &slots[index];
+            int res = cqe->res;
+
+            if (res == -EINTR || res == -EAGAIN) {
+                res = 0; // Retry the same request below
+            } else if (res < 0) {
+                errno = -res;
+                perror(slot->state == SLOT_WRITING ? "\nError writing output" : "\nError reading input");
+                result = ETDK_ERROR_IO;
+            } else if (res == 0 && slot->state == SLOT_READING) {
+                // End of device before the expected end: truncate this chunk
+                slot->len = slot->done;
+                eof = 1;
+            } else if (res == 0) {
+                errno = ENOSPC;
+                perror("\nError writing output");
+                result = ETDK_ERROR_IO;
+            }
+            slot->done += (size_t)(res > 0 ? res : 0);
+
+            if (slot->done < slot->len && result == ETDK_SUCCESS) {
+                // Short transfer: queue the rest of the same chunk
+                if (uring_queue_slot(&ring, fd, pool, slot, index, fixed) != 0)
+                    result = ETDK_ERROR_IO;
+                continue;
+            }
+
+            if (slot->state == SLOT_READING) {
+                reads_inflight--;
+                slot->state = SLOT_READ_DONE;
+            } else {
+                writes_inflight--;
+                slot->state = SLOT_FREE;
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+        if (result != ETDK_SUCCESS) {
+            // Wait for outstanding requests before the buffers go away
+            while (reads_inflight + writes_inflight > 0 && uring_submit(&ring, 1) == 0) {
+                head = *ring.cq_head;
+                tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++) {
+                    uring_slot_t *slot = &slots[ring.cqes[head & *ring.cq_mask].user_data];
+                    if (slot->state == SLOT_READING)
+                        reads_inflight--;
+                    else if (slot->state == SLOT_WRITING)
+                        writes_inflight--;
+                    slot->state = SLOT_FREE;
+                }
+                __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+            }
+            break;
+        }
+
+        // Transform completed reads in sequence order and queue their writes
+        int progressed = 1;
+        while (progressed && result == ETDK_SUCCESS) {
+            progressed = 0;
+            for (size_t i = 0; i < nslots; i++) {
+                if (slots[i].state != SLOT_READ_DONE || slots[i].seq != next_transform_seq)
+                    continue;
+
+                next_transform_seq++;
+                progressed = 1;
+
+                if (slots[i].len == 0) {
+                    slots[i].state = SLOT_FREE;
+                    break;
+                }
+
+                if (transform(arg, pool->buffers[i], slots[i].len, slots[i].offset) != ETDK_SUCCESS) {
+                    result = ETDK_ERROR_CRYPTO;
+                    slots[i].state = SLOT_FREE;
+                    break;
+                }
+
+                slots[i].state = SLOT_WRITING;
+                slots[i].done = 0;
+                if (uring_queue_slot(&ring, fd, pool, &slots[i], i, fixed) != 0) {
+                    result = ETDK_ERROR_IO;
+                    slots[i].state = SLOT_FREE;
+                    break;
+                }
+                writes_inflight++;
+                break;
+            }
+        }
+
+        if (result != ETDK_SUCCESS && reads_inflight + writes_inflight == 0) {
+            break;
+        }
+    }
+
+    if (fixed) {
+        syscall(__NR_io_uring_register, ring.fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    uring_exit(&ring);
+
+    return result;
+}
+
+#else // !HAVE_IO_URING
+
+/**
+ * @brief io_uring is not available on this platform
+ * @return ETDK_ERROR_PLATFORM so the caller falls back to synchronous I/O
+ */
+int io_uring_engine_run(int fd, uint64_t offset, uint64_t end, const io_buffer_pool_t *pool, size_t chunk_size,
+                        unsigned depth, io_transform_fn transform, void *arg) {
+    (void)fd;
+    (void)offset;
+    (void)end;
+    (void)pool;
+    (void)chunk_size;
+    (void)depth;
+    (void)transform;
+    (void)arg;
+    return ETDK_ERROR_PLATFORM;
+}
+
+#endif // HAVE_IO_URING
+
+#if defined(HAVE_IO_URING) && defined(IORING_RSRC_REGISTER_SPARSE)
+
+/** @brief Requests of a file's chains, stored next to the file index in user_data */
+enum { BATCH_OPEN = 0, BATCH_READ, BATCH_WRITE, BATCH_FSYNC, BATCH_CLOSE, BATCH_OPS };
+
+/** @brief Stage of a file in a batch */
+enum { BATCH_READING = 0, BATCH_FINISHING, BATCH_DONE };
+
+/**
+ * @brief Per-file request state of a batch
+ */
+typedef struct {
+    int stage;         /**< BATCH_READING, BATCH_FINISHING or BATCH_DONE */
+    unsigned inflight; /**< Requests of the current chain still to complete */
+    int open_res;      /**< Result of openat: direct descriptor slot or -errno */
+    int read_res;      /**< Bytes read or -errno */
+    size_t out_len;    /**< Bytes to write back */
+    int unsent;        /**< The write was withdrawn before the kernel saw it (file untouched) */
+} batch_slot_t;
+
+/**
+ * @brief Queue the chain that ends a file: write -> fsync -> close, or just close
+ *
+ * Hard links keep the chain going when a write or fsync fails, so the
+ * close always runs and no direct descriptor stays open.
+ *
+ * @return 0 on success, -1 if the submission queue has no room for the chain
+ */
+static int batch_queue_finish(uring_t *ring, const io_batch_file_t *file, batch_slot_t *slot, size_t index,
+                              int write, int flush) {
+    unsigned needed = write ? (flush ? 3 : 2) : 1;
+    unsigned used = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_entries - used < needed) {
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe;
+    if (write) {
+        sqe = uring_next_sqe(ring, IORING_OP_WRITE, index * BATCH_OPS + BATCH_WRITE);
+        sqe->fd = (int)index;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->addr = (uint64_t)(uintptr_t)file->buf;
+        sqe->len = (unsigned)slot->out_len;
+        if (flush) {
+            sqe = uring_next_sqe(ring, IORING_OP_FSYNC, index * BATCH_OPS + BATCH_FSYNC);
+            sqe->fd = (int)index;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        }
+    }
+    sqe = uring_next_sqe(ring, IORING_OP_CLOSE, index * BATCH_OPS + BATCH_CLOSE);
+    sqe->file_index = (uint32_t)index + 1;
+
+    slot->inflight = needed;
+    slot->stage = BATCH_FINISHING;
+    return 0;
+}
+
+/**
+ * @brief Decide what happens to a file once its openat -> read chain is complete
+ *
+ * Transforms a complete read and queues its write chain; anything else
+ * only closes the file.
+ *
+ * @return 1 if the file still has requests in flight, 0 if it is done
+ */
+static int batch_read_done(uring_t *ring, io_batch_file_t *file, batch_slot_t *slot, size_t index, int flush,
+                           io_batch_fn transform, void *arg) {
+    if (slot->open_res < 0) {
+        // Writable only through its directory: the caller's general path copies it
+        if (slot->open_res == -EACCES || slot->open_res == -EPERM) {
+            file->result = ETDK_ERROR_PLATFORM;
+        } else if (slot->open_res == -ELOOP) {
+            file->result = ETDK_ERROR_SYMLINK; // Swapped for a symlink since it was listed
+        } else {
+            fprintf(stderr, "\nCannot open %s: %s\n", file->path, strerror(-slot->open_res));
+            file->result = ETDK_ERROR_IO;
+        }
+        slot->stage = BATCH_DONE;
+        return 0;
+    }
+
+    int write = 0;
+    if (slot->read_res < 0) {
+        fprintf(stderr, "\nError reading %s: %s\n", file->path, strerror(-slot->read_res));
+        file->result = ETDK_ERROR_IO;
+    } else if ((uint64_t)slot->read_res != file->size) {
+        // Changed since it was listed (the read asks for one byte more than expected)
+        file->result = ETDK_ERROR_PLATFORM;
+    } else {
+        file->result = transform(arg, index, file->buf, (size_t)slot->read_res, &slot->out_len);
+        write = file->result == ETDK_SUCCESS;
+    }
+
+    if (batch_queue_finish(ring, file, slot, index, write, flush) != 0) {
+        // Not expected with 4 entries per file; the ring teardown closes the descriptor
+        file->result = ETDK_ERROR_IO;
+        slot->stage = BATCH_DONE;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Rewrite a batch of small files through linked io_uring chains
+ *
+ * Each file has a sparse slot in the ring's file table. openat installs
+ * the file there (a direct descriptor, never in the process's table) and
+ * is linked to a read of the whole file, so both go out for the whole
+ * batch in one io_uring_enter(). Reads are transformed as they complete
+ * and answered with a write -> fsync -> close chain while the other
+ * reads are still in flight. Needs kernel 5.19 (sparse file registration).
+ */
+int io_uring_batch_run(io_batch_file_t *files, size_t count, int flush, io_batch_fn transform, void *arg) {
+    if (!files || count == 0 || !transform) {
+        return ETDK_ERROR_IO;
+    }
+
+    // Up to 2 requests per file are in the first chain and 3 in the second
+    uring_t ring;
+    if (uring_setup(&ring, (unsigned)(4 * count)) != 0) {
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = (uint32_t)count;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) != 0) {
+        uring_exit(&ring);
+        return ETDK_ERROR_PLATFORM;
+    }
+
+    batch_slot_t slots[count];
+    memset(slots, 0, sizeof(slots));
+    for (size_t i = 0; i < count; i++) {
+        files[i].result = ETDK_SUCCESS;
+
+        struct io_uring_sqe *sqe = uring_next_sqe(&ring, IORING_OP_OPENAT, i * BATCH_OPS + BATCH_OPEN);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)files[i].path;
+        // The path was checked with lstat() long before; a symlink put there since must not be followed
+        sqe->open_flags = O_RDWR | O_NOFOLLOW;
+        sqe->file_index = (uint32_t)i + 1;
+        sqe->flags = IOSQE_IO_LINK;
+
+        sqe = uring_next_sqe(&ring, IORING_OP_READ, i * BATCH_OPS + BATCH_READ);
+        sqe->fd = (int)i;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->addr = (uint64_t)(uintptr_t)files[i].buf;
+        sqe->len = (unsigned)files[i].size + 1;
+        slots[i].inflight = 2;
+    }
+
+    int result = ETDK_SUCCESS;
+    size_t active = count;
+    while (active > 0) {
+        int ret = uring_submit(&ring, 1);
+        if (ret < 0) {
+            errno = -ret;
+            perror("\nio_uring submit failed");
+            result = ETDK_ERROR_IO;
+            break;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            size_t index = (size_t)(cqe->user_data / BATCH_OPS);
+            int op = (int)(cqe->user_data % BATCH_OPS);
+            io_batch_file_t *file = &files[index];
+            batch_slot_t *slot = &slots[index];
+            int res = cqe->res;
+
+            if (op == BATCH_OPEN) {
+                slot->open_res = res;
+            } else if (op == BATCH_READ) {
+                slot->read_res = res;
+            } else if (file->result == ETDK_SUCCESS &&
+                       (res < 0 || (op == BATCH_WRITE && (size_t)res != slot->out_len))) {
+                // A short write is not retried: the close is already linked behind it
+                fprintf(stderr, "\nError %s %s: %s\n",
+                        op == BATCH_WRITE ? "writing" : (op == BATCH_FSYNC ? "flushing" : "closing"), file->path,
+                        strerror(res < 0 ? -res : ENOSPC));
+                file->result = ETDK_ERROR_IO;
+            }
+
+            if (--slot->inflight > 0)
+                continue;
+            if (slot->stage == BATCH_READING &&
+                batch_read_done(&ring, file, slot, index, flush, transform, arg) != 0)
+                continue;
+            slot->stage = BATCH_DONE;
+            active--;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (result != ETDK_SUCCESS) {
+        /* Withdraw what never left the submission queue (the kernel only
+         * reads entries in io_uring_enter()), then wait for every request it
+         * accepted before the buffers and direct descriptors go away. Each
+         * of those completes exactly once, links behind a failure with
+         * -ECANCELED.
+         */
+        unsigned sq_head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        for (unsigned pos = sq_head; pos != *ring.sq_tail; pos++) {
+            uint64_t user_data = ring.sqes[ring.sq_array[pos & *ring.sq_mask]].user_data;
+            batch_slot_t *slot = &slots[user_data / BATCH_OPS];
+            slot->inflight--;
+            if (user_data % BATCH_OPS == BATCH_WRITE)
+                slot->unsent = 1;
+        }
+        __atomic_store_n(ring.sq_tail, sq_head, __ATOMIC_RELEASE);
+        ring.pending = 0;
+
+        size_t waiting = 0;
+        for (size_t i = 0; i < count; i++)
+            waiting += slots[i].inflight;
+        while (waiting > 0 && uring_submit(&ring, 1) == 0) {
+            unsigned head = *ring.cq_head;
+            unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                slots[ring.cqes[head & *ring.cq_mask].user_data / BATCH_OPS].inflight--;
+                waiting--;
+            }
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        // Files that were never written are untouched and can take the general path
+        for (size_t i = 0; i < count; i++) {
+            if (slots[i].stage == BATCH_DONE || files[i].result != ETDK_SUCCESS)
+                continue;
+            int untouched = slots[i].stage == BATCH_READING || slots[i].unsent;
+            files[i].result = untouched ? ETDK_ERROR_PLATFORM : ETDK_ERROR_IO;
+        }
+    }
+
+    // Closing the ring also drops its file table, and with it any direct descriptor still open
+    uring_exit(&ring);
+    return result;
+}
+
+#else // !HAVE_IO_URING || !IORING_RSRC_REGISTER_SPARSE
+
+/**
+ * @brief Batched small-file rewrites need io_uring with sparse file tables
+ * @return ETDK_ERROR_PLATFORM so the caller processes the files one by one
+ */
+int io_uring_batch_run(io_batch_file_t *files, size_t count, int flush, io_batch_fn transform, void *arg) {
+    (void)files;
+    (void)count;
+    (void)flush;
+    (void)transform;
+    (void)arg;
+    return ETDK_ERROR_PLATFORM;
+}
+
+#endif // HAVE_IO_URING && IORING_RSRC_REGISTER_SPARSE